@@ -27,10 +27,20 @@ static std::string GeneratedFilename(const std::filesystem::path &package_name,
   return package_name / target_name / filename;
 }
 
+// Protos that are only used by the generator (for the sato field options).
+// No code is generated for them.
+bool IsGeneratorOnly(const google::protobuf::FileDescriptor *file) {
+  return file->name() == "sato/options.proto" ||
+         file->name() == "google/protobuf/descriptor.proto";
+}
+
 bool CodeGenerator::Generate(
     const google::protobuf::FileDescriptor *file, const std::string &parameter,
     google::protobuf::compiler::GeneratorContext *generator_context,
     std::string *error) const {
+  if (IsGeneratorOnly(file)) {
+    return true;
+  }
 
   // The options for the compiler are passed in the --sato_out parameter
   // as a comma separated list of key=value pairs, followed by a colon
@@ -45,10 +55,13 @@ bool CodeGenerator::Generate(
       package_name_ = option.second;
     } else if (option.first == "target_name") {
       target_name_ = option.second;
+    } else if (option.first == "ros_structs") {
+      ros_structs_ = option.second == "true";
     }
   }
 
   Generator gen(file, added_namespace_, package_name_, target_name_);
+  gen.SetROSStructs(ros_structs_);
 
   gen.Compile();
 
@@ -232,6 +245,9 @@ void Generator::GenerateHeaders(std::ostream &os) {
   os << "#include \"sato/runtime/runtime.h\"\n";
   os << "#include \"sato/runtime/message.h\"\n";
   for (int i = 0; i < file_->dependency_count(); i++) {
+    if (IsGeneratorOnly(file_->dependency(i))) {
+      continue;
+    }
     std::string base = GeneratedFilename(package_name_, target_name_,
                                          file_->dependency(i)->name());
     std::filesystem::path p(base);
@@ -249,6 +265,14 @@ void Generator::GenerateHeaders(std::ostream &os) {
     msg_gen->GenerateHeader(os);
   }
 
+  if (ros_structs_) {
+    os << "namespace ros {\n";
+    for (auto &msg_gen : message_gens_) {
+      msg_gen->GenerateStruct(os, true);
+    }
+    os << "} // namespace ros\n";
+  }
+
   CloseNamespace(os);
 }
 
@@ -264,6 +288,14 @@ void Generator::GenerateSources(std::ostream &os) {
     msg_gen->GenerateSource(os);
   }
 
+  if (ros_structs_) {
+    os << "namespace ros {\n";
+    for (auto &msg_gen : message_gens_) {
+      msg_gen->GenerateStruct(os, false);
+    }
+    os << "} // namespace ros\n";
+  }
+
   CloseNamespace(os);
 }
 } // namespace sato
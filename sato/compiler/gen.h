@@ -20,6 +20,8 @@
 #include "zip.h"
 namespace sato {
 
+bool IsGeneratorOnly(const google::protobuf::FileDescriptor *file);
+
 class CodeGenerator : public google::protobuf::compiler::CodeGenerator {
 public:
   CodeGenerator() = default;
@@ -34,6 +36,7 @@ public:
   mutable std::string added_namespace_;
   mutable std::string package_name_;
   mutable std::string target_name_;
+  mutable bool ros_structs_ = false;
 };
 
 
@@ -46,6 +49,9 @@ public:
   void GenerateSources(std::ostream& os);
   void GenerateROSMessagesZip(std::ostream& os);
 
+  // Also generate plain ROS structs.
+  void SetROSStructs(bool ros_structs) { ros_structs_ = ros_structs; }
+
 private:
   void OpenNamespace(std::ostream& os);
   void CloseNamespace(std::ostream& os);
@@ -56,6 +62,7 @@ private:
   const std::string& added_namespace_;
   const std::string& package_name_;
   const std::string& target_name_;
+  bool ros_structs_ = false;
 };
 
 } // namespace sato
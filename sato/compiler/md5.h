@@ -0,0 +1,16 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace sato {
+
+// MD5 (RFC 1321) of the data as 32 lower case hex digits.  This is only used
+// for the ROS1 message MD5 sums, which are computed by the generator.
+std::string Md5Sum(std::string_view data);
+
+} // namespace sato
@@ -3,15 +3,23 @@
 // Copyright (C) 2025 David Allison.  All Rights Reserved.
 
 #include "sato/compiler/message_gen.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/str_replace.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "sato/compiler/md5.h"
 #include "sato/compiler/zip_utils.h"
+#include "sato/options.pb.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <ctype.h>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <unistd.h>
 #include <vector>
@@ -136,12 +144,151 @@ bool IsCppReservedWord(const std::string &s) {
   return reserved_words.contains(s);
 }
 
+// Name of the accessors for a field.
+static std::string AccessorName(const std::string &name) {
+  return IsCppReservedWord(name) ? name + "_" : name;
+}
+
+// Size of the ROS array for a field with (sato.ros_fixed_size), or 0.
+static uint32_t ROSFixedSize(const google::protobuf::FieldDescriptor *field) {
+  uint32_t size = field->options().GetExtension(::sato::ros_fixed_size);
+  if (size == 0) {
+    return 0;
+  }
+  bool numeric = true;
+  switch (field->type()) {
+  case google::protobuf::FieldDescriptor::TYPE_BOOL:
+  case google::protobuf::FieldDescriptor::TYPE_STRING:
+  case google::protobuf::FieldDescriptor::TYPE_BYTES:
+  case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
+  case google::protobuf::FieldDescriptor::TYPE_GROUP:
+    numeric = false;
+    break;
+  default:
+    break;
+  }
+  if (!field->is_repeated() || !numeric) {
+    std::cerr << "(sato.ros_fixed_size) is only supported on repeated numeric "
+                 "fields: "
+              << field->full_name() << "\n";
+    exit(1);
+  }
+  return size;
+}
+
+// True for a bytes field with (sato.ros_type) = "uint8[]".
+static bool IsROSByteArray(const google::protobuf::FieldDescriptor *field) {
+  const std::string &type = field->options().GetExtension(::sato::ros_type);
+  if (type.empty()) {
+    return false;
+  }
+  if (type != "uint8[]" || field->is_repeated() ||
+      field->type() != google::protobuf::FieldDescriptor::TYPE_BYTES) {
+    std::cerr << "Unsupported (sato.ros_type) \"" << type << "\" for "
+              << field->full_name()
+              << ", only \"uint8[]\" for a bytes field is supported\n";
+    exit(1);
+  }
+  return true;
+}
+
+// True for a message that can be a record of a blob field: only singular
+// scalar fields.
+static bool IsROSRecord(const google::protobuf::Descriptor *desc) {
+  if (desc->field_count() == 0) {
+    return false;
+  }
+  for (int i = 0; i < desc->field_count(); i++) {
+    const google::protobuf::FieldDescriptor *field = desc->field(i);
+    if (field->is_repeated() || field->containing_oneof() != nullptr) {
+      return false;
+    }
+    switch (field->type()) {
+    case google::protobuf::FieldDescriptor::TYPE_STRING:
+    case google::protobuf::FieldDescriptor::TYPE_BYTES:
+    case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
+    case google::protobuf::FieldDescriptor::TYPE_GROUP:
+      return false;
+    default:
+      break;
+    }
+  }
+  return true;
+}
+
+// True for a field with (sato.ros_blob) = true.
+static bool IsROSBlob(const google::protobuf::FieldDescriptor *field) {
+  if (!field->options().GetExtension(::sato::ros_blob)) {
+    return false;
+  }
+  if (!field->is_repeated() || field->is_map() ||
+      field->type() != google::protobuf::FieldDescriptor::TYPE_MESSAGE ||
+      field->options().lazy() || !IsROSRecord(field->message_type())) {
+    std::cerr << "(sato.ros_blob) is only supported on a repeated message "
+                 "field whose message has only scalar fields: "
+              << field->full_name() << "\n";
+    exit(1);
+  }
+  return true;
+}
+
+// The google.protobuf well-known types that map to ROS builtins.  Like Any,
+// they are hand-coded messages in the runtime (well_known.h).
+struct WellKnownType {
+  const char *full_name;
+  const char *ros_type;
+  size_t ros_size; // 0 if not fixed.
+};
+
+static const WellKnownType *
+FindWellKnownType(const google::protobuf::Descriptor *desc) {
+  static const WellKnownType types[] = {
+      {"google.protobuf.Timestamp", "time", 8},
+      {"google.protobuf.Duration", "duration", 8},
+      {"google.protobuf.DoubleValue", "float64", 8},
+      {"google.protobuf.FloatValue", "float32", 4},
+      {"google.protobuf.Int64Value", "int64", 8},
+      {"google.protobuf.UInt64Value", "uint64", 8},
+      {"google.protobuf.Int32Value", "int32", 4},
+      {"google.protobuf.UInt32Value", "uint32", 4},
+      {"google.protobuf.BoolValue", "bool", 1},
+      {"google.protobuf.StringValue", "string", 0},
+      {"google.protobuf.BytesValue", "string", 0},
+  };
+  for (const WellKnownType &type : types) {
+    if (desc->full_name() == type.full_name) {
+      return &type;
+    }
+  }
+  return nullptr;
+}
+
+// True for a field with (sato.ros_header) = true.  The field's message is
+// written as the std_msgs/Header of the top level message.
+static bool IsROSHeader(const google::protobuf::FieldDescriptor *field) {
+  if (!field->options().GetExtension(::sato::ros_header)) {
+    return false;
+  }
+  if (field->type() != google::protobuf::FieldDescriptor::TYPE_MESSAGE ||
+      field->is_repeated() || field->containing_oneof() != nullptr ||
+      field->containing_type()->containing_type() != nullptr) {
+    std::cerr << "(sato.ros_header) is only supported on a message field of a "
+                 "top level message: "
+              << field->full_name() << "\n";
+    exit(1);
+  }
+  return true;
+}
+
 std::string
 MessageGenerator::MessageName(const google::protobuf::Descriptor *desc,
                               bool is_ref) {
   if (is_ref && IsAny(desc)) {
     return "::sato::AnyMessage";
   }
+  if (is_ref && FindWellKnownType(desc) != nullptr) {
+    return "::sato::" + desc->name() + "Message";
+  }
   std::string full_name = desc->full_name();
   // If the message is in our package, use the short name.
   if (full_name.find(package_name_) == std::string::npos) {
@@ -166,6 +313,9 @@ std::string MessageGenerator::MessageROSName(const google::protobuf::Descriptor
   if (IsAny(desc)) {
     return "google_protobuf/Any";
   }
+  if (const WellKnownType *type = FindWellKnownType(desc); type != nullptr) {
+    return type->ros_type;
+  }
   std::string full_name = desc->full_name();
 
  // If the message is in our package, use the short name.
@@ -182,44 +332,53 @@ std::string MessageGenerator::MessageROSName(const google::protobuf::Descriptor
 
 std::string MessageGenerator::FieldCFieldType(
     const google::protobuf::FieldDescriptor *field) {
+  // The field number is a template parameter of all field types.
+  std::string number = std::to_string(field->number());
   switch (field->type()) {
   case google::protobuf::FieldDescriptor::TYPE_INT32:
-    return "Int32Field<false, false>";
+    return "Int32Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_SINT32:
-    return "Int32Field<false, true>";
+    return "Int32Field<" + number + ", false, true>";
   case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
-    return "Int32Field<true, false>";
+    return "Int32Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_INT64:
-    return "Int64Field<false, false>";
+    return "Int64Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_SINT64:
-    return "Int64Field<false, true>";
+    return "Int64Field<" + number + ", false, true>";
   case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
-    return "Int64Field<true, false>";
+    return "Int64Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_UINT32:
-    return "Uint32Field<false, false>";
+    return "Uint32Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_FIXED32:
-    return "Uint32Field<true, false>";
+    return "Uint32Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_UINT64:
-    return "Uint64Field<false, false>";
+    return "Uint64Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_FIXED64:
-    return "Uint64Field<true, false>";
+    return "Uint64Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
-    return "DoubleField<true, false>";
+    return "DoubleField<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_FLOAT:
-    return "FloatField<true, false>";
+    return "FloatField<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_BOOL:
-    return "BoolField<false, false>";
+    return "BoolField<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_ENUM:
-    return "Uint32Field<false, false>"; // We use a uint32_t to store the enum
+    return "Uint32Field<" + number + ", false, false>"; // We use a uint32_t to store the enum
                                         // value.
   case google::protobuf::FieldDescriptor::TYPE_STRING:
   case google::protobuf::FieldDescriptor::TYPE_BYTES:
-    return "StringField";
+    if (IsROSByteArray(field)) {
+      return "BytesField<" + number + ">";
+    }
+    return "StringField<" + number + ">";
   case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
     if (IsAny(field)) {
-      return "AnyField";
+      return "AnyField<" + number + ">";
     }
-    return "MessageField<" + MessageName(field->message_type(), true) + ">";
+    if (field->options().lazy()) {
+      return "LazyMessageField<" + number + ", " +
+             MessageName(field->message_type(), true) + ">";
+    }
+    return "MessageField<" + number + ", " + MessageName(field->message_type(), true) + ">";
 
   case google::protobuf::FieldDescriptor::TYPE_GROUP:
     std::cerr << "Groups are not supported\n";
@@ -267,6 +426,13 @@ MessageGenerator::FieldCType(const google::protobuf::FieldDescriptor *field) {
 
 std::string
 MessageGenerator::FieldROSType(const google::protobuf::FieldDescriptor *field) {
+  if (IsROSByteArray(field)) {
+    return "uint8[]";
+  }
+  // An array of bytes.
+  if (IsROSBlob(field)) {
+    return "uint8";
+  }
   switch (field->type()) {
   case google::protobuf::FieldDescriptor::TYPE_INT32:
   case google::protobuf::FieldDescriptor::TYPE_SINT32:
@@ -304,41 +470,58 @@ MessageGenerator::FieldROSType(const google::protobuf::FieldDescriptor *field) {
 
 std::string MessageGenerator::FieldRepeatedCType(
     const google::protobuf::FieldDescriptor *field) {
-  std::string packed = field->is_packed() ? ", true>" : ", false>";
+  // The field number is a template parameter of all field types.
+  std::string number = std::to_string(field->number());
+  std::string packed = field->is_packed() ? ", true" : ", false";
+  // Fixed size ROS arrays have the size as the last template argument.
+  std::string vector = "PrimitiveVectorField<";
+  if (uint32_t size = ROSFixedSize(field); size > 0) {
+    vector = "FixedArrayField<";
+    packed += ", " + std::to_string(size);
+  }
+  packed += ">";
   switch (field->type()) {
   case google::protobuf::FieldDescriptor::TYPE_INT32:
-    return "PrimitiveVectorField<int32_t, false, false" + packed;
+    return vector + number + ", int32_t, false, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_SINT32:
-    return "PrimitiveVectorField<int32_t, false, true" + packed;
+    return vector + number + ", int32_t, false, true" + packed;
   case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
-    return "PrimitiveVectorField<int32_t, true, false" + packed;
+    return vector + number + ", int32_t, true, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_INT64:
-    return "PrimitiveVectorField<int64_t, false, false" + packed;
+    return vector + number + ", int64_t, false, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_SINT64:
-    return "PrimitiveVectorField<int64_t, false, true" + packed;
+    return vector + number + ", int64_t, false, true" + packed;
   case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
-    return "PrimitiveVectorField<int64_t, true, false" + packed;
+    return vector + number + ", int64_t, true, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_UINT32:
-    return "PrimitiveVectorField<uint32_t, false, false" + packed;
+    return vector + number + ", uint32_t, false, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_FIXED32:
-    return "PrimitiveVectorField<uint32_t, true, false" + packed;
+    return vector + number + ", uint32_t, true, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_UINT64:
-    return "PrimitiveVectorField<uint64_t, false, false" + packed;
+    return vector + number + ", uint64_t, false, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_FIXED64:
-    return "PrimitiveVectorField<uint64_t, true, false" + packed;
+    return vector + number + ", uint64_t, true, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
-    return "PrimitiveVectorField<double, true, false" + packed;
+    return vector + number + ", double, true, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_FLOAT:
-    return "PrimitiveVectorField<float, true, false" + packed;
+    return vector + number + ", float, true, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_BOOL:
-    return "PrimitiveVectorField<bool, false, false" + packed;
+    return vector + number + ", bool, false, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_ENUM:
-    return "PrimitiveVectorField<uint32_t, false, false" + packed;
+    return vector + number + ", uint32_t, false, false" + packed;
   case google::protobuf::FieldDescriptor::TYPE_STRING:
   case google::protobuf::FieldDescriptor::TYPE_BYTES:
-    return "StringVectorField";
+    return "StringVectorField<" + number + ">";
   case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
-    return "MessageVectorField<" + MessageName(field->message_type(), true) +
+    if (field->options().lazy()) {
+      return "LazyMessageVectorField<" + number + ", " +
+             MessageName(field->message_type(), true) + ">";
+    }
+    if (IsROSBlob(field)) {
+      return "BlobVectorField<" + number + ", " +
+             MessageName(field->message_type(), true) + ">";
+    }
+    return "MessageVectorField<" + number + ", " + MessageName(field->message_type(), true) +
            ">";
   case google::protobuf::FieldDescriptor::TYPE_GROUP:
     std::cerr << "Groups are not supported\n";
@@ -347,42 +530,101 @@ std::string MessageGenerator::FieldRepeatedCType(
   return "::sato::FieldType::kFieldUnknown";
 }
 
+// Codec for the key or value of a map entry.  Bools are held as uint8_t so
+// that they can be stored in a vector and referenced.
+std::string
+MessageGenerator::FieldMapCodec(const google::protobuf::FieldDescriptor *field) {
+  switch (field->type()) {
+  case google::protobuf::FieldDescriptor::TYPE_INT32:
+    return "::sato::PrimitiveCodec<int32_t, false, false>";
+  case google::protobuf::FieldDescriptor::TYPE_SINT32:
+    return "::sato::PrimitiveCodec<int32_t, false, true>";
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
+    return "::sato::PrimitiveCodec<int32_t, true, false>";
+  case google::protobuf::FieldDescriptor::TYPE_INT64:
+    return "::sato::PrimitiveCodec<int64_t, false, false>";
+  case google::protobuf::FieldDescriptor::TYPE_SINT64:
+    return "::sato::PrimitiveCodec<int64_t, false, true>";
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
+    return "::sato::PrimitiveCodec<int64_t, true, false>";
+  case google::protobuf::FieldDescriptor::TYPE_UINT32:
+    return "::sato::PrimitiveCodec<uint32_t, false, false>";
+  case google::protobuf::FieldDescriptor::TYPE_FIXED32:
+    return "::sato::PrimitiveCodec<uint32_t, true, false>";
+  case google::protobuf::FieldDescriptor::TYPE_UINT64:
+    return "::sato::PrimitiveCodec<uint64_t, false, false>";
+  case google::protobuf::FieldDescriptor::TYPE_FIXED64:
+    return "::sato::PrimitiveCodec<uint64_t, true, false>";
+  case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+    return "::sato::PrimitiveCodec<double, true, false>";
+  case google::protobuf::FieldDescriptor::TYPE_FLOAT:
+    return "::sato::PrimitiveCodec<float, true, false>";
+  case google::protobuf::FieldDescriptor::TYPE_BOOL:
+    return "::sato::PrimitiveCodec<uint8_t, false, false>";
+  case google::protobuf::FieldDescriptor::TYPE_ENUM:
+    return "::sato::PrimitiveCodec<uint32_t, false, false>";
+  case google::protobuf::FieldDescriptor::TYPE_STRING:
+  case google::protobuf::FieldDescriptor::TYPE_BYTES:
+    return "::sato::StringCodec";
+  case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
+    return "::sato::MessageCodec<" + MessageName(field->message_type(), true) +
+           ">";
+  case google::protobuf::FieldDescriptor::TYPE_GROUP:
+    std::cerr << "Groups are not supported\n";
+    exit(1);
+  }
+  return "unknown";
+}
+
+std::string
+MessageGenerator::FieldMapCType(const google::protobuf::FieldDescriptor *field) {
+  const google::protobuf::Descriptor *entry = field->message_type();
+  return "MapField<" + std::to_string(field->number()) + ", " +
+         FieldMapCodec(entry->FindFieldByNumber(1)) + ", " +
+         FieldMapCodec(entry->FindFieldByNumber(2)) + ">";
+}
+
 std::string MessageGenerator::FieldUnionCType(
     const google::protobuf::FieldDescriptor *field) {
+  // The field number is a template parameter of all field types.
+  std::string number = std::to_string(field->number());
   switch (field->type()) {
   case google::protobuf::FieldDescriptor::TYPE_INT32:
-    return "UnionInt32Field<false, false>";
+    return "UnionInt32Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_SINT32:
-    return "UnionInt32Field<false, true>";
+    return "UnionInt32Field<" + number + ", false, true>";
   case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
-    return "UnionInt32Field<true, false>";
+    return "UnionInt32Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_INT64:
-    return "UnionInt64Field<false, false>";
+    return "UnionInt64Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_SINT64:
-    return "UnionInt64Field<false, true>";
+    return "UnionInt64Field<" + number + ", false, true>";
   case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
-    return "UnionInt64Field<true, false>";
+    return "UnionInt64Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_UINT32:
-    return "UnionUint32Field<false, false>";
+    return "UnionUint32Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_FIXED32:
-    return "UnionUint32Field<true, false>";
+    return "UnionUint32Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_UINT64:
-    return "UnionUint64Field<false, false>";
+    return "UnionUint64Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_FIXED64:
-    return "UnionUint64Field<true, false>";
+    return "UnionUint64Field<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
-    return "UnionDoubleField<true, false>";
+    return "UnionDoubleField<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_FLOAT:
-    return "UnionFloatField<true, false>";
+    return "UnionFloatField<" + number + ", true, false>";
   case google::protobuf::FieldDescriptor::TYPE_BOOL:
-    return "UnionBoolField<false, false>";
+    return "UnionBoolField<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_ENUM:
-    return "UnionUint32Field<false, false>";
+    return "UnionUint32Field<" + number + ", false, false>";
   case google::protobuf::FieldDescriptor::TYPE_STRING:
   case google::protobuf::FieldDescriptor::TYPE_BYTES:
-    return "UnionStringField";
+    if (IsROSByteArray(field)) {
+      return "BytesField<" + number + ">";
+    }
+    return "UnionStringField<" + number + ">";
   case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
-    return "UnionMessageField<" + MessageName(field->message_type(), true) +
+    return "UnionMessageField<" + number + ", " + MessageName(field->message_type(), true) +
            ">";
   case google::protobuf::FieldDescriptor::TYPE_GROUP:
     std::cerr << "Groups are not supported\n";
@@ -452,6 +694,8 @@ void MessageGenerator::CompileFields() {
         fields_in_order_.push_back(union_info);
       }
       continue;
+    } else if (field->is_map()) {
+      field_type = FieldMapCType(field);
     } else if (field->is_repeated()) {
       field_type = FieldRepeatedCType(field);
     } else {
@@ -464,8 +708,150 @@ void MessageGenerator::CompileFields() {
     fields_.push_back(std::make_shared<FieldInfo>(field, field->name() + "_",
                                                   field_type, FieldCType(field),
                                                   FieldROSType(field)));
+    fields_.back()->presence_bit = int(fields_.size() - 1);
     fields_in_order_.push_back(fields_.back());
   }
+  // The field bound to the std_msgs/Header is not a field in ROS.
+  for (auto &field : fields_in_order_) {
+    if (!field->IsUnion() && IsROSHeader(field->field)) {
+      if (header_field_ != nullptr) {
+        std::cerr << "Only one (sato.ros_header) field is allowed in "
+                  << message_->full_name() << "\n";
+        exit(1);
+      }
+      header_field_ = field;
+      continue;
+    }
+    ros_fields_.push_back(field);
+  }
+}
+
+// The fields of the message bound to the std_msgs/Header.
+static const google::protobuf::FieldDescriptor *
+ROSHeaderField(const google::protobuf::Descriptor *header,
+               const std::vector<std::string> &names,
+               std::vector<google::protobuf::FieldDescriptor::Type> types) {
+  for (const std::string &name : names) {
+    const google::protobuf::FieldDescriptor *field =
+        header->FindFieldByName(name);
+    if (field == nullptr) {
+      continue;
+    }
+    if (field->is_repeated() ||
+        std::find(types.begin(), types.end(), field->type()) == types.end() ||
+        (field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+         field->message_type()->full_name() != "google.protobuf.Timestamp")) {
+      std::cerr << "Unsupported type for ROS header field " << field->full_name()
+                << "\n";
+      exit(1);
+    }
+    return field;
+  }
+  return nullptr;
+}
+
+// Expression for the frame_id of the header field, or empty if there isn't
+// one.
+std::string MessageGenerator::ROSHeaderFrameId() {
+  if (header_field_ == nullptr) {
+    return "";
+  }
+  auto frame_id =
+      ROSHeaderField(header_field_->field->message_type(), {"frame_id"},
+                     {google::protobuf::FieldDescriptor::TYPE_STRING});
+  if (frame_id == nullptr) {
+    return "";
+  }
+  return "this->" + header_field_->member_name + ".Get()." +
+         AccessorName(frame_id->name()) + "()";
+}
+
+// Arguments to WriteROSHeader from the header field.  The timestamp passed
+// to WriteROS is used if the header has no stamp.
+std::string MessageGenerator::ROSHeaderArgs() {
+  if (header_field_ == nullptr) {
+    return "timestamp";
+  }
+  const google::protobuf::Descriptor *header =
+      header_field_->field->message_type();
+  std::string h = "this->" + header_field_->member_name + ".Get().";
+  std::string args = "timestamp";
+  if (auto stamp = ROSHeaderField(
+          header, {"timestamp", "stamp"},
+          {google::protobuf::FieldDescriptor::TYPE_UINT64,
+           google::protobuf::FieldDescriptor::TYPE_INT64,
+           google::protobuf::FieldDescriptor::TYPE_FIXED64,
+           google::protobuf::FieldDescriptor::TYPE_MESSAGE})) {
+    std::string value = h + AccessorName(stamp->name()) + "()";
+    if (stamp->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+      value += ".ToNanos()";
+    }
+    args = "uint64_t(" + value + ") != 0 ? uint64_t(" + value +
+           ") : timestamp";
+  }
+  std::string frame_id = ROSHeaderFrameId();
+  args += ", " + (frame_id.empty() ? "{}" : frame_id);
+  if (auto seq = ROSHeaderField(
+          header, {"seq"}, {google::protobuf::FieldDescriptor::TYPE_UINT32})) {
+    args += ", " + h + AccessorName(seq->name()) + "()";
+  }
+  return args;
+}
+
+// Parse the std_msgs/Header of a top level message, into the header field if
+// there is one.
+void MessageGenerator::GenerateROSHeaderParse(std::ostream &os) {
+  if (header_field_ == nullptr) {
+    os << "  if (absl::Status status = ::sato::SkipROSHeader(buffer); "
+          "!status.ok()) return status;\n";
+    return;
+  }
+  const google::protobuf::Descriptor *header =
+      header_field_->field->message_type();
+  os << "  {\n";
+  os << "    uint64_t stamp = 0;\n";
+  os << "    std::string_view frame_id;\n";
+  os << "    uint32_t seq = 0;\n";
+  os << "    if (absl::Status status = ::sato::ReadROSHeader(buffer, stamp, "
+        "frame_id, seq); !status.ok()) return status;\n";
+  os << "    if (stamp != 0 || !frame_id.empty() || seq != 0) {\n";
+  os << "      presence_.Set(" << header_field_->presence_bit << ");\n";
+  os << "      auto *ros_header = this->" << header_field_->member_name
+     << ".Mutable();\n";
+  if (auto stamp = ROSHeaderField(
+          header, {"timestamp", "stamp"},
+          {google::protobuf::FieldDescriptor::TYPE_UINT64,
+           google::protobuf::FieldDescriptor::TYPE_INT64,
+           google::protobuf::FieldDescriptor::TYPE_FIXED64,
+           google::protobuf::FieldDescriptor::TYPE_MESSAGE})) {
+    if (stamp->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+      os << "      ros_header->mutable_" << stamp->name()
+         << "()->set_seconds(int64_t(stamp / 1000000000)).set_nanos(int32_t("
+            "stamp % 1000000000));\n";
+    } else {
+      os << "      ros_header->set_" << stamp->name() << "(stamp);\n";
+    }
+  }
+  if (ROSHeaderField(header, {"frame_id"},
+                     {google::protobuf::FieldDescriptor::TYPE_STRING})) {
+    os << "      ros_header->set_frame_id(frame_id);\n";
+  }
+  if (ROSHeaderField(header, {"seq"},
+                     {google::protobuf::FieldDescriptor::TYPE_UINT32})) {
+    os << "      ros_header->set_seq(seq);\n";
+  }
+  os << "    }\n";
+  os << "  }\n";
+}
+
+static std::optional<size_t>
+FixedFieldROSSize(const google::protobuf::FieldDescriptor *field, int depth);
+
+// Name of the constant for a field number in the .msg file.
+static std::string
+FieldNumberName(const google::protobuf::FieldDescriptor *field) {
+  std::string name = field->camelcase_name();
+  return absl::StrFormat("k%c%sFieldNumber", toupper(name[0]), name.substr(1));
 }
 
 void MessageGenerator::GenerateROSMessage(zip_t *zip, int level) {
@@ -477,20 +863,87 @@ void MessageGenerator::GenerateROSMessage(zip_t *zip, int level) {
     enum_gen->GenerateROSMessage(zip);
   }
 
-  // Write the message to a stringstream
+  std::string content = ROSMessageText(nullptr, nullptr);
+
+  if (absl::Status status = AddFileToZip(zip, message_->full_name(), content); !status.ok()) {
+    std::cerr << "Failed to add file to zip: " << status.message() << "\n";
+    exit(1);
+  }
+
+}
+
+// The ROS1 datatype of a message, which is where its .msg file is in the zip.
+static std::string ROSDataType(const google::protobuf::Descriptor *desc) {
+  std::string full_name = desc->full_name();
+  size_t pos = full_name.rfind(".");
+  std::string dirname = absl::StrReplaceAll(full_name.substr(0, pos), {{".", "_"}});
+  return dirname + "/" + full_name.substr(pos + 1);
+}
+
+// std_msgs/Header, which is in the definition of every top level message.
+static const ROSTypeInfo &ROSHeaderType() {
+  static const ROSTypeInfo *header = [] {
+    ROSTypeInfo *type = new ROSTypeInfo{
+        "std_msgs/Header", "uint32 seq\ntime stamp\nstring frame_id\n", "", {}};
+    type->md5 = Md5Sum("uint32 seq\ntime stamp\nstring frame_id");
+    return type;
+  }();
+  return *header;
+}
+
+// The contents of the .msg file for the message.  If md5_text is not null
+// it is set to the text that the ROS1 MD5 sum is computed from, as genmsg
+// does: no comments, constants as "type name=value" and message types
+// replaced by their MD5 sums.  The message types used are added to depends.
+std::string
+MessageGenerator::ROSMessageText(std::string *md5_text,
+                                 std::vector<const ROSTypeInfo *> *depends) {
   std::stringstream ss;
+  std::stringstream md5;
 
   GenerateFieldNumbers(ss);
   ss << "\n";
+  for (auto &field : fields_) {
+    md5 << "int32 " << FieldNumberName(field->field) << "="
+        << field->field->number() << "\n";
+  }
+  for (auto &[oneof, u] : unions_) {
+    for (auto &field : u->members) {
+      md5 << "int32 " << FieldNumberName(field->field) << "="
+          << field->field->number() << "\n";
+    }
+  }
+
+  // A message type is replaced by its MD5 sum.  Well-known types are
+  // builtins.
+  auto add_md5_field = [&](const google::protobuf::FieldDescriptor *f,
+                           const std::string &type, const std::string &name) {
+    if (md5_text == nullptr ||
+        f->type() != google::protobuf::FieldDescriptor::TYPE_MESSAGE ||
+        FindWellKnownType(f->message_type()) != nullptr || IsROSBlob(f)) {
+      md5 << type << " " << name << "\n";
+      return;
+    }
+    const ROSTypeInfo &sub = ROSType(f->message_type());
+    md5 << sub.md5 << " " << name << "\n";
+    if (std::find(depends->begin(), depends->end(), &sub) == depends->end()) {
+      depends->push_back(&sub);
+    }
+  };
 
   // All top level messages have a header.
-  if (level == 0) {
+  if (message_->containing_type() == nullptr) {
     ss << "std_msgs/Header header\n\n";
+    md5 << ROSHeaderType().md5 << " header\n";
+    if (depends != nullptr) {
+      depends->push_back(&ROSHeaderType());
+    }
   }
 
-  for (auto &field : fields_in_order_) {
+  for (auto &field : ros_fields_) {
     if (field->IsUnion()) {
       ss << "int32 " << field->ros_member_name << "_case\n";
+      md5 << "int32 " << field->ros_member_name << "_case\n";
       // Expand all members of the union.
       auto u = static_cast<UnionInfo *>(field.get());
       for (auto &member : u->members) {
@@ -498,26 +951,185 @@ void MessageGenerator::GenerateROSMessage(zip_t *zip, int level) {
             google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
           // Messages fields are an array so that they are optional.
           ss << member->ros_type << "[] " << member->ros_member_name << "\n";
+          add_md5_field(member->field, member->ros_type + "[]",
+                        member->ros_member_name);
         } else {
           ss << member->ros_type << " " << member->ros_member_name << "\n";
+          add_md5_field(member->field, member->ros_type,
+                        member->ros_member_name);
         }
       }
+    } else if (uint32_t size = ROSFixedSize(field->field); size > 0) {
+      ss << field->ros_type << "[" << size << "] " << field->ros_member_name
+         << "\n";
+      add_md5_field(field->field,
+                    absl::StrFormat("%s[%d]", field->ros_type, size),
+                    field->ros_member_name);
+    } else if (IsROSBlob(field->field)) {
+      // Describe the records as there's nothing in the ROS message.
+      const google::protobuf::Descriptor *record = field->field->message_type();
+      ss << "# Packed " << MessageROSName(record) << " records:";
+      size_t offset = 0;
+      for (int i = 0; i < record->field_count(); i++) {
+        ss << (i == 0 ? " " : ", ") << record->field(i)->name() << " "
+           << FieldROSType(record->field(i)) << " at " << offset;
+        offset += *FixedFieldROSSize(record->field(i), 0);
+      }
+      ss << "\n";
+      ss << field->ros_type << "[] " << field->ros_member_name << "\n";
+      add_md5_field(field->field, field->ros_type + "[]",
+                    field->ros_member_name);
     } else if (field->field->is_repeated()) {
       ss << field->ros_type << "[] " << field->ros_member_name << "\n";
+      add_md5_field(field->field, field->ros_type + "[]",
+                    field->ros_member_name);
     } else {
       ss << field->ros_type << " " << field->ros_member_name << "\n";
+      add_md5_field(field->field, field->ros_type, field->ros_member_name);
     }
     ss << "\n";
   }
 
-  // Extract the string from the stringstream
-  std::string content = ss.str();
+  if (md5_text != nullptr) {
+    *md5_text = md5.str();
+    // Without the final newline.
+    if (!md5_text->empty()) {
+      md5_text->pop_back();
+    }
+  }
+  return ss.str();
+}
 
-  if (absl::Status status = AddFileToZip(zip, message_->full_name(), content); !status.ok()) {
-    std::cerr << "Failed to add file to zip: " << status.message() << "\n";
-    exit(1);
+// The ROS type of a message, including those in other files.  They are
+// computed once and never freed, so the dependencies can point to them.  A
+// message that contains itself (which ROS can't express) sees an empty MD5
+// sum for the nested reference.
+const ROSTypeInfo &
+MessageGenerator::ROSType(const google::protobuf::Descriptor *desc) {
+  static auto *types =
+      new std::map<const google::protobuf::Descriptor *, ROSTypeInfo>();
+  if (auto it = types->find(desc); it != types->end()) {
+    return it->second;
+  }
+  ROSTypeInfo &type = (*types)[desc];
+  MessageGenerator gen(desc, added_namespace_, desc->file()->package());
+  gen.Compile();
+  std::string md5_text;
+  type.datatype = ROSDataType(desc);
+  type.text = gen.ROSMessageText(&md5_text, &type.depends);
+  type.md5 = Md5Sum(md5_text);
+  return type;
+}
+
+// The full definition of a message for the ROS1 connection header, as
+// generated by gendeps: the message's definition followed by the
+// definitions of all the types it uses.
+std::string MessageGenerator::ROSFullDefinition(const ROSTypeInfo &type) {
+  std::vector<const ROSTypeInfo *> all;
+  std::function<void(const ROSTypeInfo &)> add_depends =
+      [&](const ROSTypeInfo &t) {
+        for (const ROSTypeInfo *dep : t.depends) {
+          if (std::find(all.begin(), all.end(), dep) != all.end()) {
+            continue;
+          }
+          all.push_back(dep);
+          add_depends(*dep);
+        }
+      };
+  add_depends(type);
+
+  std::string definition = type.text + "\n";
+  for (const ROSTypeInfo *dep : all) {
+    absl::StrAppend(&definition, std::string(80, '='), "\nMSG: ", dep->datatype,
+                    "\n", dep->text, "\n");
+  }
+  definition.pop_back();
+  return definition;
+}
+
+void MessageGenerator::GenerateROSMetadata(std::ostream &os) {
+  const ROSTypeInfo &type = ROSType(message_);
+  os << "  // ROS1 connection metadata.\n";
+  os << "  static constexpr std::string_view ROSDataType() { return \""
+     << type.datatype << "\"; }\n";
+  os << "  static constexpr std::string_view ROSMd5Sum() { return \""
+     << type.md5 << "\"; }\n";
+  os << "  static constexpr std::string_view ROSDefinition() {\n";
+  os << "    return \"" << absl::CEscape(ROSFullDefinition(type)) << "\";\n";
+  os << "  }\n\n";
+}
+
+static std::optional<size_t>
+FixedROSSize(const google::protobuf::Descriptor *desc, int depth = 0);
+
+// Size of a field in ROS format if it is always the same.
+static std::optional<size_t>
+FixedFieldROSSize(const google::protobuf::FieldDescriptor *field, int depth) {
+  if (field->containing_oneof() != nullptr) {
+    return std::nullopt;
+  }
+  // Only fixed size arrays of repeated fields.
+  size_t count = 1;
+  if (field->is_repeated()) {
+    count = ROSFixedSize(field);
+    if (count == 0) {
+      return std::nullopt;
+    }
+  }
+  switch (field->type()) {
+  case google::protobuf::FieldDescriptor::TYPE_INT64:
+  case google::protobuf::FieldDescriptor::TYPE_SINT64:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
+  case google::protobuf::FieldDescriptor::TYPE_UINT64:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED64:
+  case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+    return 8 * count;
+  case google::protobuf::FieldDescriptor::TYPE_INT32:
+  case google::protobuf::FieldDescriptor::TYPE_SINT32:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
+  case google::protobuf::FieldDescriptor::TYPE_UINT32:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED32:
+  case google::protobuf::FieldDescriptor::TYPE_FLOAT:
+  case google::protobuf::FieldDescriptor::TYPE_ENUM:
+    return 4 * count;
+  case google::protobuf::FieldDescriptor::TYPE_BOOL:
+    return 1;
+  case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
+    if (field->message_type()->full_name() == "google.protobuf.Any" ||
+        field->options().lazy() || IsROSHeader(field)) {
+      return std::nullopt;
+    }
+    if (const WellKnownType *type = FindWellKnownType(field->message_type());
+        type != nullptr) {
+      if (type->ros_size == 0) {
+        return std::nullopt;
+      }
+      return type->ros_size;
+    }
+    return FixedROSSize(field->message_type(), depth + 1);
+  default:
+    return std::nullopt;
   }
+}
 
+// A message has a fixed ROS layout if all its fields do.  Top level
+// messages include the 16 byte header.  Messages that contain themselves
+// are cut off by the depth limit.
+static std::optional<size_t>
+FixedROSSize(const google::protobuf::Descriptor *desc, int depth) {
+  if (depth > 32) {
+    return std::nullopt;
+  }
+  size_t size = desc->containing_type() == nullptr ? 16 : 0;
+  for (int i = 0; i < desc->field_count(); i++) {
+    std::optional<size_t> field_size =
+        FixedFieldROSSize(desc->field(i), depth);
+    if (!field_size.has_value()) {
+      return std::nullopt;
+    }
+    size += *field_size;
+  }
+  return size;
 }
 
 void MessageGenerator::Compile() {
@@ -527,6 +1139,7 @@ void MessageGenerator::Compile() {
 
   CompileFields();
   CompileUnions();
+  fixed_ros_size_ = FixedROSSize(message_);
 }
 
 void MessageGenerator::GenerateHeader(std::ostream &os) {
@@ -534,7 +1147,10 @@ void MessageGenerator::GenerateHeader(std::ostream &os) {
     nested->GenerateHeader(os);
   }
 
-  os << "class " << MessageName(message_) << " : public ::sato::Message {\n";
+  // Final so that calls through the concrete type (nested message fields,
+  // the multiplexer and ::sato::Convert) don't go through the vtable.
+  os << "class " << MessageName(message_)
+     << " final : public ::sato::Message {\n";
   os << " public:\n";
   // Generate constructors.
   GenerateConstructors(os, true);
@@ -545,7 +1161,8 @@ void MessageGenerator::GenerateHeader(std::ostream &os) {
      << "\"; }\n\n";
 
   os << "  std::string GetName() const override { return Name(); }\n";
-  os << "  std::string GetFullName() const override { return FullName(); }\n";
+  os << "  std::string GetFullName() const override { return FullName(); }\n\n";
+  GenerateROSMetadata(os);
 
   // Generate serialized size.
   GenerateSerializedSize(os, true, 0);
@@ -553,10 +1170,21 @@ void MessageGenerator::GenerateHeader(std::ostream &os) {
   GenerateROSToProto(os, true, 0);
   // Generate deserializer.
   GenerateProtoToROS(os, true, 0);
+  GenerateFixedROS(os, true, 0);
+  GenerateROSRecord(os, true);
+  GenerateConstant(os);
+
+  GenerateIsPresent(os);
+  GenerateAccessors(os);
+  GenerateProtoObject(os, true);
 
   os << " private:\n";
   GenerateFieldDeclarations(os);
   os << "};\n\n";
+
+  GenerateProtoObject(os, false);
+
+  GenerateROSView(os, true);
 }
 
 void MessageGenerator::GenerateSource(std::ostream &os, int level) {
@@ -572,99 +1200,696 @@ void MessageGenerator::GenerateSource(std::ostream &os, int level) {
   GenerateROSToProto(os, false, level);
   // Generate deserializer.
   GenerateProtoToROS(os, false, level);
+  GenerateFixedROS(os, false, level);
+  GenerateROSRecord(os, false);
+  GenerateROSView(os, false);
 
   // multiplexer
   GenerateMultiplexer(os);
 }
 
+// Rank of a field for placing it in the class.  The scalars come first so
+// that they are packed together in the first cache line with the presence
+// bits, biggest first so there is no padding between them.  They are followed
+// by the strings and unions, with the repeated fields and nested messages,
+// which hold pointers to other memory, at the end.
+static int FieldRank(const FieldInfo &field) {
+  if (field.IsUnion()) {
+    return 5;
+  }
+  if (field.field->is_repeated()) {
+    return 6;
+  }
+  switch (field.field->type()) {
+  case google::protobuf::FieldDescriptor::TYPE_INT64:
+  case google::protobuf::FieldDescriptor::TYPE_SINT64:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
+  case google::protobuf::FieldDescriptor::TYPE_UINT64:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED64:
+  case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+    return 0;
+  case google::protobuf::FieldDescriptor::TYPE_BOOL:
+    return 2;
+  case google::protobuf::FieldDescriptor::TYPE_STRING:
+  case google::protobuf::FieldDescriptor::TYPE_BYTES:
+    return 3;
+  case google::protobuf::FieldDescriptor::TYPE_MESSAGE:
+  case google::protobuf::FieldDescriptor::TYPE_GROUP:
+    return 7;
+  default:
+    return 1; // 4 byte scalars.
+  }
+}
+
 void MessageGenerator::GenerateFieldDeclarations(std::ostream &os) {
-  for (auto &field : fields_) {
+  os << "  ::sato::PresenceBits<" << fields_.size() << "> presence_;\n";
+  std::vector<FieldInfo *> fields;
+  for (auto &field : fields_in_order_) {
+    fields.push_back(field.get());
+  }
+  std::stable_sort(fields.begin(), fields.end(),
+                   [](const FieldInfo *a, const FieldInfo *b) {
+                     return FieldRank(*a) < FieldRank(*b);
+                   });
+  for (auto &field : fields) {
     os << "  ::sato::" << field->member_type << " " << field->member_name
        << ";\n";
   }
-  for (auto &[oneof, u] : unions_) {
-    os << "  ::sato::" << u->member_type << " " << u->member_name << ";\n";
-  }
 }
 
-void MessageGenerator::GenerateEnums(std::ostream &os) {
-  // Nested enums.
-  for (auto &msg : nested_message_gens_) {
-    msg->GenerateEnums(os);
+void MessageGenerator::GenerateIsPresent(std::ostream &os) {
+  // A message is present if any of its fields are.
+  os << "  bool IsPresent() const {\n";
+  os << "    return presence_.Any()";
+  for (auto &[oneof, u] : unions_) {
+    os << " || " << u->member_name << ".Discriminator() != 0";
   }
+  os << ";\n";
+  os << "  }\n\n";
 }
 
-void MessageGenerator::GenerateFieldNumbers(std::ostream &os) {
-  for (auto &field : fields_) {
-    std::string name = field->field->camelcase_name();
-    name = absl::StrFormat("k%c%s", toupper(name[0]), name.substr(1));
-    os << "int32 " << name << "FieldNumber = " << field->field->number()
-       << "\n";
-  }
-  for (auto &[oneof, u] : unions_) {
-    for (auto &field : u->members) {
-      std::string name = field->field->camelcase_name();
-      name = absl::StrFormat("k%c%s", toupper(name[0]), name.substr(1));
-      os << "int32 " << name << "FieldNumber = " << field->field->number()
-         << "\n";
+// Accessors for the fields, named like protobuf's.  Setters return the
+// message so they can be chained to build a message.
+void MessageGenerator::GenerateAccessors(std::ostream &os) {
+  std::string self = MessageName(message_);
+  os << "  // Strings are not copied by the setters so they must outlive the "
+        "message.\n";
+  for (auto &field : fields_in_order_) {
+    if (field->IsUnion()) {
+      auto u = std::static_pointer_cast<UnionInfo>(field);
+      os << "  int32_t " << u->oneof->name() << "_case() const { return "
+         << u->member_name << ".Discriminator(); }\n";
+      os << "  void clear_" << u->oneof->name() << "() { " << u->member_name
+         << ".Clear(); }\n";
+      for (size_t i = 0; i < u->members.size(); i++) {
+        const google::protobuf::FieldDescriptor *f = u->members[i]->field;
+        std::string name = AccessorName(f->name());
+        std::string member =
+            u->member_name + ".Get<" + std::to_string(i) + ">()";
+        std::string mutable_member =
+            u->member_name + ".Mutable<" + std::to_string(i) + ">()";
+        os << "  bool has_" << f->name() << "() const { return "
+           << u->member_name << ".Discriminator() == " << f->number()
+           << "; }\n";
+        if (f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+          std::string type = MessageName(f->message_type(), true);
+          os << "  const " << type << " &" << name << "() const { return "
+             << member << ".Get(); }\n";
+          os << "  " << type << " *mutable_" << f->name() << "() { return "
+             << mutable_member << "->Mutable(); }\n";
+        } else {
+          std::string type = u->members[i]->c_type;
+          os << "  " << type << " " << name << "() const { return " << member
+             << ".Value(); }\n";
+          os << "  " << self << " &set_" << f->name() << "(" << type
+             << " v) { " << mutable_member << "->Set(v); return *this; }\n";
+        }
+      }
+      continue;
+    }
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string name = AccessorName(f->name());
+    std::string presence =
+        "presence_.Set(" + std::to_string(field->presence_bit) + "); ";
+    bool is_message =
+        f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE;
+    bool is_lazy = is_message && f->options().lazy();
+    if (f->is_map() || f->is_repeated()) {
+      // The whole field, with size(), Get(i) and Add functions.
+      std::string type = "::sato::" + field->member_type;
+      os << "  const " << type << " &" << name << "() const { return "
+         << field->member_name << "; }\n";
+      os << "  " << type << " *mutable_" << f->name() << "() { " << presence
+         << "return &" << field->member_name << "; }\n";
+      if (f->is_map()) {
+        os << "  size_t " << f->name() << "_size() const { return "
+           << field->member_name << ".size(); }\n";
+        continue;
+      }
+      std::string elements =
+          is_lazy ? field->member_name + ".Get()" : field->member_name;
+      std::string mutable_elements = is_lazy
+                                         ? field->member_name + ".Mutable()->"
+                                         : field->member_name + ".";
+      os << "  size_t " << f->name() << "_size() const { return " << elements
+         << ".size(); }\n";
+      if (IsROSBlob(f)) {
+        // The elements are records so they are copied.
+        std::string elem = MessageName(f->message_type(), true);
+        os << "  " << elem << " " << name << "(size_t i) const { return "
+           << elements << ".Get(i); }\n";
+        os << "  " << self << " &add_" << f->name() << "(const " << elem
+           << " &v) { " << presence << mutable_elements
+           << "Add(v); return *this; }\n";
+      } else if (is_message) {
+        std::string elem = MessageName(f->message_type(), true);
+        os << "  const " << elem << " &" << name << "(size_t i) const { return "
+           << elements << ".Get(i); }\n";
+        os << "  " << elem << " *mutable_" << f->name() << "(size_t i) { "
+           << "return " << mutable_elements << "Mutable(i); }\n";
+        os << "  " << elem << " *add_" << f->name() << "() { " << presence
+           << "return " << mutable_elements << "Add(); }\n";
+      } else {
+        os << "  " << field->c_type << " " << name << "(size_t i) const { "
+           << "return " << elements << ".Get(i); }\n";
+        os << "  " << self << " &add_" << f->name() << "(" << field->c_type
+           << " v) { " << presence << mutable_elements
+           << "Add(v); return *this; }\n";
+      }
+      continue;
+    }
+    os << "  bool has_" << f->name() << "() const { return presence_.IsPresent("
+       << field->presence_bit << "); }\n";
+    if (is_message) {
+      std::string type = MessageName(f->message_type(), true);
+      os << "  const " << type << " &" << name << "() const { return "
+         << field->member_name << ".Get(); }\n";
+      os << "  " << type << " *mutable_" << f->name() << "() { " << presence
+         << "return " << field->member_name << ".Mutable(); }\n";
+    } else {
+      os << "  " << field->c_type << " " << name << "() const { return "
+         << field->member_name << ".Value(); }\n";
+      os << "  " << self << " &set_" << f->name() << "(" << field->c_type
+         << " v) { " << presence << field->member_name
+         << ".Set(v); return *this; }\n";
     }
   }
+  os << "\n";
 }
 
-void MessageGenerator::GenerateConstructors(std::ostream &os, bool decl) {
-  GenerateDefaultConstructor(os, decl);
+// Name of the libprotobuf accessors for a field.
+static std::string
+ProtoAccessorName(const google::protobuf::FieldDescriptor *f) {
+  std::string name = absl::AsciiStrToLower(f->name());
+  return IsCppReservedWord(name) ? name + "_" : name;
 }
 
-void MessageGenerator::GenerateDefaultConstructor(std::ostream &os, bool decl) {
-  if (decl) {
-    os << "  " << MessageName(message_) << "();\n";
-    return;
-  }
-  os << MessageName(message_) << "::" << MessageName(message_) << "()\n";
-  // Generate field initializers.
-  GenerateFieldInitializers(os);
-  os << "{}\n\n";
+static bool IsEnum(const google::protobuf::FieldDescriptor *f) {
+  return f->type() == google::protobuf::FieldDescriptor::TYPE_ENUM;
 }
 
-void MessageGenerator::GenerateFieldInitializers(std::ostream &os,
-                                                 const char *sep) {
-  if (fields_.empty() && unions_.empty()) {
-    return;
-  }
+static bool IsString(const google::protobuf::FieldDescriptor *f) {
+  return f->type() == google::protobuf::FieldDescriptor::TYPE_STRING ||
+         f->type() == google::protobuf::FieldDescriptor::TYPE_BYTES;
+}
 
-  for (auto &field : fields_) {
-    os << sep << field->member_name << "(" << field->field->number() << ")\n";
-    sep = ", ";
-  }
-  for (auto &[oneof, u] : unions_) {
-    os << sep << u->member_name << "({";
-    const char *num_sep = "";
-    for (auto &field : u->members) {
-      os << num_sep << field->field->number();
-      num_sep = ",";
-    }
-    os << "})\n";
-    sep = ", ";
-  }
+static bool IsMessage(const google::protobuf::FieldDescriptor *f) {
+  return f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE;
 }
 
-void MessageGenerator::GenerateSerializedSize(std::ostream &os, bool decl, int level) {
+// Conversion from and to libprotobuf message objects.  These are templates
+// on the protobuf class so the generated code doesn't depend on the
+// libprotobuf generated headers; they are only instantiated by programs
+// that use them.  Only the generated accessors are used, no reflection.
+void MessageGenerator::GenerateProtoObject(std::ostream &os, bool decl) {
   if (decl) {
-    os << "  size_t SerializedProtoSize() const override;\n";
-    os << "  size_t SerializedROSSize() const override;\n";
+    os << "  // Conversion from and to the libprotobuf message object.  "
+          "Strings are not\n";
+    os << "  // copied so the object must outlive this message.\n";
+    os << "  template <typename Proto> absl::Status FromProtoObject(const "
+          "Proto &pb);\n";
+    os << "  template <typename Proto> absl::Status ToProtoObject(Proto *pb) "
+          "const;\n\n";
     return;
   }
-  os << "size_t " << MessageName(message_)
-     << "::SerializedProtoSize() const {\n";
+  const char *check = "; !status.ok()) return status;\n";
+  std::string self = MessageName(message_);
+
+  os << "template <typename Proto>\n";
+  os << "absl::Status " << self << "::FromProtoObject(const Proto &pb) {\n";
+  os << "  if (IsPopulated()) { return absl::InvalidArgumentError(\""
+        "Message has already been parsed\"); }\n";
+  os << "  SetPopulated(true);\n";
+  for (auto &field : fields_in_order_) {
+    if (field->IsUnion()) {
+      auto u = std::static_pointer_cast<UnionInfo>(field);
+      os << "  switch (int(pb." << absl::AsciiStrToLower(u->oneof->name())
+         << "_case())) {\n";
+      for (size_t i = 0; i < u->members.size(); i++) {
+        const google::protobuf::FieldDescriptor *f = u->members[i]->field;
+        std::string member =
+            u->member_name + ".Mutable<" + std::to_string(i) + ">()";
+        std::string value = "pb." + ProtoAccessorName(f) + "()";
+        os << "  case " << f->number() << ":\n";
+        if (IsMessage(f)) {
+          os << "    if (absl::Status status = " << member
+             << "->Mutable()->FromProtoObject(" << value << ")" << check;
+        } else {
+          os << "    " << member << "->Set(" << u->members[i]->c_type << "("
+             << value << "));\n";
+        }
+        os << "    break;\n";
+      }
+      os << "  }\n";
+      continue;
+    }
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string name = ProtoAccessorName(f);
+    std::string member = field->member_name;
+    std::string presence =
+        "presence_.Set(" + std::to_string(field->presence_bit) + ");";
+    if (f->is_map()) {
+      const google::protobuf::FieldDescriptor *value_field =
+          f->message_type()->map_value();
+      os << "  for (const auto &[key, value] : pb." << name << "()) {\n";
+      if (IsMessage(value_field)) {
+        os << "    if (absl::Status status = " << member
+           << ".Add(key)->FromProtoObject(value)" << check;
+      } else if (IsEnum(value_field)) {
+        os << "    *" << member << ".Add(key) = uint32_t(value);\n";
+      } else {
+        os << "    *" << member << ".Add(key) = value;\n";
+      }
+      os << "  }\n";
+      os << "  if (pb." << name << "_size() > 0) " << presence << "\n";
+    } else if (f->is_repeated()) {
+      std::string elements =
+          f->options().lazy() ? member + ".Mutable()->" : member + ".";
+      os << "  " << elements << "Reserve(pb." << name << "_size());\n";
+      os << "  for (const auto &value : pb." << name << "()) {\n";
+      if (IsROSBlob(f)) {
+        os << "    if (absl::Status status = " << elements
+           << "AddFromProtoObject(value)" << check;
+      } else if (IsMessage(f)) {
+        os << "    if (absl::Status status = " << elements
+           << "Add()->FromProtoObject(value)" << check;
+      } else {
+        os << "    " << elements << "Add(" << field->c_type << "(value));\n";
+      }
+      os << "  }\n";
+      os << "  if (pb." << name << "_size() > 0) " << presence << "\n";
+    } else if (IsMessage(f)) {
+      os << "  if (pb.has_" << name << "()) {\n";
+      os << "    " << presence << "\n";
+      os << "    if (absl::Status status = " << member
+         << ".Mutable()->FromProtoObject(pb." << name << "())" << check;
+      os << "  }\n";
+    } else if (IsString(f)) {
+      os << "  if (!pb." << name << "().empty()) { " << member << ".Set(pb."
+         << name << "()); " << presence << " }\n";
+    } else {
+      os << "  if (pb." << name << "() != 0) { " << member << ".Set("
+         << field->c_type << "(pb." << name << "())); " << presence << " }\n";
+    }
+  }
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+
+  os << "template <typename Proto>\n";
+  os << "absl::Status " << self << "::ToProtoObject(Proto *pb) const {\n";
+  for (auto &field : fields_in_order_) {
+    if (field->IsUnion()) {
+      auto u = std::static_pointer_cast<UnionInfo>(field);
+      os << "  switch (" << u->member_name << ".Discriminator()) {\n";
+      for (size_t i = 0; i < u->members.size(); i++) {
+        const google::protobuf::FieldDescriptor *f = u->members[i]->field;
+        std::string name = ProtoAccessorName(f);
+        std::string member =
+            u->member_name + ".Get<" + std::to_string(i) + ">()";
+        os << "  case " << f->number() << ":\n";
+        if (IsMessage(f)) {
+          os << "    if (absl::Status status = " << member
+             << ".Get().ToProtoObject(pb->mutable_" << name << "())" << check;
+        } else if (IsString(f)) {
+          os << "    pb->set_" << name << "(std::string(" << member
+             << ".Value()));\n";
+        } else if (IsEnum(f)) {
+          os << "    pb->set_" << name
+             << "(static_cast<std::decay_t<decltype(pb->" << name << "())>>("
+             << member << ".Value()));\n";
+        } else {
+          os << "    pb->set_" << name << "(" << member << ".Value());\n";
+        }
+        os << "    break;\n";
+      }
+      os << "  }\n";
+      continue;
+    }
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string name = ProtoAccessorName(f);
+    std::string member = field->member_name;
+    os << "  if (presence_.IsPresent(" << field->presence_bit << ")) {\n";
+    if (f->is_map()) {
+      const google::protobuf::FieldDescriptor *key_field =
+          f->message_type()->map_key();
+      const google::protobuf::FieldDescriptor *value_field =
+          f->message_type()->map_value();
+      os << "    auto &map = *pb->mutable_" << name << "();\n";
+      os << "    for (size_t i = 0; i < " << member << ".size(); i++) {\n";
+      std::string key = member + ".GetKey(i)";
+      std::string value = member + ".GetValue(i)";
+      if (IsString(key_field)) {
+        key = "std::string(" + key + ")";
+      }
+      os << "      auto &value = map[" << key << "];\n";
+      if (IsMessage(value_field)) {
+        os << "      if (absl::Status status = " << value
+           << ".ToProtoObject(&value)" << check;
+      } else if (IsString(value_field)) {
+        os << "      value = std::string(" << value << ");\n";
+      } else {
+        os << "      value = static_cast<std::decay_t<decltype(value)>>("
+           << value << ");\n";
+      }
+      os << "    }\n";
+    } else if (f->is_repeated()) {
+      std::string elements = f->options().lazy() ? member + ".Get()" : member;
+      os << "    pb->mutable_" << name << "()->Reserve(int(" << elements
+         << ".size()));\n";
+      os << "    for (size_t i = 0; i < " << elements << ".size(); i++) {\n";
+      std::string value = elements + ".Get(i)";
+      if (IsMessage(f)) {
+        os << "      if (absl::Status status = " << value
+           << ".ToProtoObject(pb->add_" << name << "())" << check;
+      } else if (IsString(f)) {
+        os << "      pb->add_" << name << "(std::string(" << value << "));\n";
+      } else if (IsEnum(f)) {
+        os << "      pb->add_" << name
+           << "(static_cast<std::decay_t<decltype(pb->" << name << "(0))>>("
+           << value << "));\n";
+      } else {
+        os << "      pb->add_" << name << "(" << value << ");\n";
+      }
+      os << "    }\n";
+    } else if (IsMessage(f)) {
+      os << "    if (absl::Status status = " << member
+         << ".Get().ToProtoObject(pb->mutable_" << name << "())" << check;
+    } else if (IsString(f)) {
+      os << "    pb->set_" << name << "(std::string(" << member
+         << ".Value()));\n";
+    } else if (IsEnum(f)) {
+      os << "    pb->set_" << name << "(static_cast<std::decay_t<decltype(pb->"
+         << name << "())>>(" << member << ".Value()));\n";
+    } else {
+      os << "    pb->set_" << name << "(" << member << ".Value());\n";
+    }
+    os << "  }\n";
+  }
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+}
+
+// Name of the plain ROS struct for a message.  They are in a nested "ros"
+// namespace.
+std::string
+MessageGenerator::StructName(const google::protobuf::Descriptor *desc) {
+  if (IsAny(desc)) {
+    return "::sato::AnyStruct";
+  }
+  // The well-known messages are used as they are, apart from the ones that
+  // hold a string as the structs own their strings.
+  if (const WellKnownType *type = FindWellKnownType(desc); type != nullptr) {
+    return type->ros_size == 0 ? "::sato::StringValueStruct"
+                               : MessageName(desc, true);
+  }
+  std::string name = MessageName(desc, true);
+  size_t pos = name.rfind("::");
+  if (pos == std::string::npos) {
+    return name;
+  }
+  return name.substr(0, pos) + "::ros" + name.substr(pos);
+}
+
+std::string MessageGenerator::StructCodec(
+    const google::protobuf::FieldDescriptor *field) {
+  if (IsString(field)) {
+    return "::sato::OwnedStringCodec";
+  }
+  if (IsMessage(field)) {
+    return "::sato::MessageCodec<" + StructName(field->message_type()) + ">";
+  }
+  return FieldMapCodec(field);
+}
+
+std::string MessageGenerator::StructCType(
+    const google::protobuf::FieldDescriptor *field) {
+  if (IsString(field)) {
+    return "std::string";
+  }
+  if (IsMessage(field)) {
+    return StructName(field->message_type());
+  }
+  // As in ROS, bools are uint8_t.
+  if (field->type() == google::protobuf::FieldDescriptor::TYPE_BOOL) {
+    return "uint8_t";
+  }
+  return FieldCType(field);
+}
+
+// A plain struct with the layout of the ROS message that is converted
+// directly from and to protobuf wire format.
+void MessageGenerator::GenerateStruct(std::ostream &os, bool decl) {
+  for (auto &nested : nested_message_gens_) {
+    nested->GenerateStruct(os, decl);
+  }
+  std::string name = MessageName(message_);
+  if (decl) {
+    os << "struct " << name << " {\n";
+    if (message_->containing_type() == nullptr) {
+      os << "  ::sato::ROSHeader ros_header;\n";
+    }
+    for (auto &field : fields_in_order_) {
+      if (field->IsUnion()) {
+        auto u = std::static_pointer_cast<UnionInfo>(field);
+        os << "  int32_t " << u->oneof->name() << "_case = 0;\n";
+        for (auto &member : u->members) {
+          const google::protobuf::FieldDescriptor *f = member->field;
+          if (IsMessage(f)) {
+            // Messages are an array of 0 or 1 as in ROS.
+            os << "  std::vector<" << StructCType(f) << "> "
+               << AccessorName(f->name()) << ";\n";
+          } else {
+            os << "  " << StructCType(f) << " " << AccessorName(f->name())
+               << (IsString(f) ? ";\n" : " = {};\n");
+          }
+        }
+        continue;
+      }
+      const google::protobuf::FieldDescriptor *f = field->field;
+      if (f->is_repeated()) {
+        // Maps are arrays of their entry structs.
+        os << "  std::vector<" << StructCType(f) << "> "
+           << AccessorName(f->name()) << ";\n";
+      } else {
+        os << "  " << StructCType(f) << " " << AccessorName(f->name())
+           << (IsString(f) || IsMessage(f) ? ";\n" : " = {};\n");
+      }
+    }
+    os << "\n";
+    os << "  size_t SerializedProtoSize() const;\n";
+    os << "  absl::Status WriteProto(::sato::ProtoBuffer &buffer) const;\n";
+    os << "  absl::Status ParseProto(::sato::ProtoBuffer &buffer);\n";
+    os << "};\n\n";
+    return;
+  }
+
+  const char *check = "; !status.ok()) return status;\n";
+  auto repeated_codec = [this](const google::protobuf::FieldDescriptor *f) {
+    return "::sato::RepeatedCodec<" + std::to_string(f->number()) + ", " +
+           StructCodec(f) + ", " + (f->is_packed() ? "true" : "false") + ">";
+  };
+  // Members are referenced through this so that they don't clash with the
+  // locals and parameters.  Default values are not written, as in proto3.  There is no presence so
+  // a nested message is written only if it has a value.
+  auto not_default = [](const google::protobuf::FieldDescriptor *f,
+                        const std::string &v) -> std::string {
+    if (IsString(f)) {
+      return "!" + v + ".empty()";
+    }
+    return v + " != 0";
+  };
+
+  os << "size_t " << name << "::SerializedProtoSize() const {\n";
   os << "  size_t size = 0;\n";
-  for (auto &field : fields_) {
-    if (field->field->is_repeated()) {
-      os << "  size += " << field->member_name << ".SerializedProtoSize();\n";
+  for (auto &field : fields_in_order_) {
+    if (field->IsUnion()) {
+      auto u = std::static_pointer_cast<UnionInfo>(field);
+      os << "  switch (" << u->oneof->name() << "_case) {\n";
+      for (auto &member : u->members) {
+        const google::protobuf::FieldDescriptor *f = member->field;
+        std::string v = "this->" + AccessorName(f->name());
+        os << "  case " << f->number() << ":\n";
+        if (IsMessage(f)) {
+          os << "    if (!" << v << ".empty()) ";
+          v += "[0]";
+        } else {
+          os << "    ";
+        }
+        os << "size += " << StructCodec(f) << "::ProtoSize<" << f->number()
+           << ">(" << v << ");\n";
+        os << "    break;\n";
+      }
+      os << "  }\n";
+      continue;
+    }
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string v = "this->" + AccessorName(f->name());
+    if (f->is_repeated()) {
+      os << "  size += " << repeated_codec(f) << "::ProtoSize(" << v
+         << ");\n";
+    } else if (IsMessage(f)) {
+      os << "  if (size_t n = " << v
+         << ".SerializedProtoSize(); n > 0) size += "
+            "::sato::ProtoBuffer::LengthDelimitedSize<"
+         << f->number() << ">(n);\n";
     } else {
-      os << "  if (" << field->member_name << ".IsPresent()) {\n";
-      os << "    size += " << field->member_name << ".SerializedProtoSize();\n";
+      os << "  if (" << not_default(f, v) << ") size += " << StructCodec(f)
+         << "::ProtoSize<" << f->number() << ">(" << v << ");\n";
+    }
+  }
+  os << "  return size;\n";
+  os << "}\n\n";
+
+  os << "absl::Status " << name
+     << "::WriteProto(::sato::ProtoBuffer &buffer) const {\n";
+  for (auto &field : fields_in_order_) {
+    if (field->IsUnion()) {
+      auto u = std::static_pointer_cast<UnionInfo>(field);
+      os << "  switch (" << u->oneof->name() << "_case) {\n";
+      for (auto &member : u->members) {
+        const google::protobuf::FieldDescriptor *f = member->field;
+        std::string v = "this->" + AccessorName(f->name());
+        os << "  case " << f->number() << ":\n";
+        if (IsMessage(f)) {
+          os << "    if (!" << v << ".empty()) ";
+          v += "[0]";
+        } else {
+          os << "    ";
+        }
+        os << "if (absl::Status status = " << StructCodec(f) << "::WriteProto<"
+           << f->number() << ">(buffer, " << v << ")" << check;
+        os << "    break;\n";
+      }
       os << "  }\n";
+      continue;
     }
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string v = "this->" + AccessorName(f->name());
+    if (f->is_repeated()) {
+      os << "  if (absl::Status status = " << repeated_codec(f)
+         << "::WriteProto(buffer, " << v << ")" << check;
+    } else if (IsMessage(f)) {
+      os << "  if (size_t n = " << v << ".SerializedProtoSize(); n > 0) {\n";
+      os << "    if (absl::Status status = "
+            "buffer.SerializeLengthDelimitedHeader<"
+         << f->number() << ">(n)" << check;
+      os << "    if (absl::Status status = " << v << ".WriteProto(buffer)"
+         << check;
+      os << "  }\n";
+    } else {
+      os << "  if (" << not_default(f, v) << ") {\n";
+      os << "    if (absl::Status status = " << StructCodec(f)
+         << "::WriteProto<" << f->number() << ">(buffer, " << v << ")"
+         << check;
+      os << "  }\n";
+    }
+  }
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+
+  os << "absl::Status " << name
+     << "::ParseProto(::sato::ProtoBuffer &buffer) {\n";
+  os << R"XXX(  while (!buffer.Eof()) {
+    absl::StatusOr<uint32_t> tag = buffer.DeserializeTag();
+    if (!tag.ok()) {
+      return tag.status();
+    }
+    absl::Status status;
+    switch (*tag >> ::sato::ProtoBuffer::kFieldIdShift) {
+)XXX";
+  for (auto &field : fields_in_order_) {
+    if (field->IsUnion()) {
+      auto u = std::static_pointer_cast<UnionInfo>(field);
+      for (auto &member : u->members) {
+        const google::protobuf::FieldDescriptor *f = member->field;
+        std::string v = "this->" + AccessorName(f->name());
+        os << "    case " << f->number() << ":\n";
+        os << "      " << u->oneof->name() << "_case = " << f->number()
+           << ";\n";
+        if (IsMessage(f)) {
+          os << "      if (" << v << ".empty()) " << v << ".emplace_back();\n";
+          v += "[0]";
+        }
+        os << "      status = " << StructCodec(f) << "::ParseProto(buffer, "
+           << v << ");\n";
+        os << "      break;\n";
+      }
+      continue;
+    }
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string v = "this->" + AccessorName(f->name());
+    os << "    case " << f->number() << ":\n";
+    if (f->is_repeated()) {
+      os << "      status = " << repeated_codec(f)
+         << "::ParseProto(buffer, *tag, " << v << ");\n";
+    } else {
+      os << "      status = " << StructCodec(f) << "::ParseProto(buffer, "
+         << v << ");\n";
+    }
+    os << "      break;\n";
+  }
+  os << R"XXX(    default:
+      status = buffer.SkipTag(*tag);
+      break;
+    }
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+)XXX";
+}
+
+void MessageGenerator::GenerateEnums(std::ostream &os) {
+  // Nested enums.
+  for (auto &msg : nested_message_gens_) {
+    msg->GenerateEnums(os);
+  }
+}
+
+void MessageGenerator::GenerateFieldNumbers(std::ostream &os) {
+  for (auto &field : fields_) {
+    os << "int32 " << FieldNumberName(field->field) << " = "
+       << field->field->number() << "\n";
+  }
+  for (auto &[oneof, u] : unions_) {
+    for (auto &field : u->members) {
+      os << "int32 " << FieldNumberName(field->field) << " = "
+         << field->field->number() << "\n";
+    }
+  }
+}
+
+void MessageGenerator::GenerateConstructors(std::ostream &os, bool decl) {
+  GenerateDefaultConstructor(os, decl);
+}
+
+void MessageGenerator::GenerateDefaultConstructor(std::ostream &os, bool decl) {
+  if (decl) {
+    os << "  " << MessageName(message_) << "();\n";
+    return;
+  }
+  // The field numbers are template parameters so the fields need no
+  // initializers.
+  os << MessageName(message_) << "::" << MessageName(message_) << "() {}\n\n";
+}
+
+void MessageGenerator::GenerateSerializedSize(std::ostream &os, bool decl, int level) {
+  if (decl) {
+    os << "  size_t SerializedProtoSize() const override;\n";
+    os << "  size_t SerializedROSSize() const override;\n";
+    return;
+  }
+  os << "size_t " << MessageName(message_)
+     << "::SerializedProtoSize() const {\n";
+  os << "  size_t size = 0;\n";
+  // Gated on presence as in WriteProto, which a projection clears.
+  for (auto &field : fields_) {
+    os << "  if (presence_.IsPresent(" << field->presence_bit << ")) {\n";
+    os << "    size += " << field->member_name << ".SerializedProtoSize();\n";
+    os << "  }\n";
   }
   for (auto &[oneof, u] : unions_) {
     os << "  switch (" << u->member_name << ".Discriminator()) {\n";
@@ -681,13 +1906,25 @@ void MessageGenerator::GenerateSerializedSize(std::ostream &os, bool decl, int l
   os << "}\n\n";
 
   os << "size_t " << MessageName(message_) << "::SerializedROSSize() const {\n";
+  if (fixed_ros_size_.has_value()) {
+    os << "  return kFixedROSSize;\n";
+    os << "}\n\n";
+    return;
+  }
   if (level == 0) {
-    // Header is 16 bytes.
-    os << "  size_t size = 16;\n";
+    // Header is 16 bytes with an empty frame_id.
+    if (std::string frame_id = ROSHeaderFrameId(); !frame_id.empty()) {
+      os << "  size_t size = 16 + " << frame_id << ".size();\n";
+    } else {
+      os << "  size_t size = 16;\n";
+    }
   } else {
     os << "  size_t size = 0;\n";
   }
   for (auto &field : fields_) {
+    if (field == header_field_) {
+      continue;
+    }
     os << "  size += " << field->member_name << ".SerializedROSSize();\n";
   }
   // In ROS format we expand all the union members into the message.  ROS has no
@@ -702,6 +1939,8 @@ void MessageGenerator::GenerateSerializedSize(std::ostream &os, bool decl, int l
 void MessageGenerator::GenerateROSToProto(std::ostream &os, bool decl, int level) {
   if (decl) {
     os << "  absl::Status ParseROS(::sato::ROSBuffer &buffer) override;\n";
+    os << "  static absl::Status SkipROS(::sato::ROSBuffer &buffer);\n";
+    os << "  void ApplyProjection();\n";
     os << "  absl::Status WriteProto(::sato::ProtoBuffer &buffer) const override;\n";
     return;
   }
@@ -710,18 +1949,72 @@ void MessageGenerator::GenerateROSToProto(std::ostream &os, bool decl, int level
      << "::ParseROS(::sato::ROSBuffer &buffer) {\n";
   os << "  if (IsPopulated()) { return absl::InvalidArgumentError(\""
         "Message has already been parsed\"); }\n";
+  if (fixed_ros_size_.has_value()) {
+    // Anything that doesn't fit the fixed layout (a short buffer or a header
+    // with a frame_id) takes the general path.
+    os << "  if (ABSL_PREDICT_TRUE(buffer.HasFixedLayout() && "
+          "buffer.Check(kFixedROSSize).ok() && "
+          "HasFixedROSHeaders(buffer.Addr()))) {\n";
+    os << "    ParseROSFixed(buffer.Addr());\n";
+    os << "    buffer.Addr() += kFixedROSSize;\n";
+    os << "    if (ABSL_PREDICT_FALSE(GetProjection() != nullptr)) "
+          "ApplyProjection();\n";
+    os << "    return absl::OkStatus();\n";
+    os << "  }\n";
+  }
   os << "  SetPopulated(true);\n";
   if (level == 0) {
-    // Just skip the header as it won't be present in the protobuf message.
-    os << "  if (absl::Status status = buffer.Skip(16); !status.ok()) return status;\n";
+    // The header isn't in the protobuf message unless a field is bound to it.
+    GenerateROSHeaderParse(os);
   }
-  for (auto &field : fields_in_order_) {
+  for (auto &field : ros_fields_) {
     os << "  if (absl::Status status = " << field->member_name
        << ".ParseROS(buffer); !status.ok()) return status;\n";
+    if (!field->IsUnion()) {
+      // ROS has no presence so a field is present if it has a value.
+      os << "  if (" << field->member_name << ".HasValue()) presence_.Set("
+         << field->presence_bit << ");\n";
+    }
   }
+  os << "  if (ABSL_PREDICT_FALSE(GetProjection() != nullptr)) "
+        "ApplyProjection();\n";
   os << "  return absl::OkStatus();\n";
   os << "}\n\n";
 
+  // Move past the message without parsing it.
+  os << "absl::Status " << MessageName(message_)
+     << "::SkipROS(::sato::ROSBuffer &buffer) {\n";
+  if (fixed_ros_size_.has_value()) {
+    // CDR has padding and compact buffers can't be looked into, so they
+    // take the general path, as do headers with a frame_id.
+    os << "  if (ABSL_PREDICT_TRUE(buffer.HasFixedLayout() && "
+          "buffer.Check(kFixedROSSize).ok() && "
+          "HasFixedROSHeaders(buffer.Addr()))) return "
+          "buffer.Skip(kFixedROSSize);\n";
+  }
+  if (level == 0) {
+    os << "  if (absl::Status status = ::sato::SkipROSHeader(buffer); !status.ok()) return status;\n";
+  }
+  for (auto &field : ros_fields_) {
+    os << "  if (absl::Status status = ::sato::" << field->member_type
+       << "::SkipROS(buffer); !status.ok()) return status;\n";
+  }
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+
+  // Fields that are not in the projection are not written to protobuf.
+  os << "void " << MessageName(message_) << "::ApplyProjection() {\n";
+  for (auto &field : fields_) {
+    os << "  if (!IsProjected(" << field->field->number()
+       << ")) presence_.Clear(" << field->presence_bit << ");\n";
+  }
+  for (auto &[oneof, u] : unions_) {
+    os << "  if (" << u->member_name << ".Discriminator() != 0 && !IsProjected("
+       << u->member_name << ".Discriminator())) " << u->member_name
+       << ".Clear();\n";
+  }
+  os << "}\n\n";
+
   os << "absl::Status " << MessageName(message_)
      << "::WriteProto(::sato::ProtoBuffer &buffer) const {\n";
   for (auto &field : fields_in_order_) {
@@ -739,7 +2032,7 @@ void MessageGenerator::GenerateROSToProto(std::ostream &os, bool decl, int level
       os << "  }\n";
       continue;
     }
-    os << "  if (" << field->member_name << ".IsPresent()) {\n";
+    os << "  if (presence_.IsPresent(" << field->presence_bit << ")) {\n";
     os << "    if (absl::Status status = " << field->member_name
        << ".WriteProto(buffer); !status.ok()) return status;\n";
     os << "  }\n";
@@ -750,9 +2043,32 @@ void MessageGenerator::GenerateROSToProto(std::ostream &os, bool decl, int level
 
 }
 
+// Whether a fixed layout message has a fixed size array field, itself or in
+// a nested message, whose size must be checked before it is written.
+static bool ContainsFixedArray(const google::protobuf::Descriptor *desc,
+                               int depth = 0) {
+  if (depth > 32) {
+    return false;
+  }
+  for (int i = 0; i < desc->field_count(); i++) {
+    const google::protobuf::FieldDescriptor *field = desc->field(i);
+    if (field->is_repeated() && ROSFixedSize(field) > 0) {
+      return true;
+    }
+    if (field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+        FindWellKnownType(field->message_type()) == nullptr &&
+        ContainsFixedArray(field->message_type(), depth + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void MessageGenerator::GenerateProtoToROS(std::ostream &os, bool decl, int level) {
   if (decl) {
     os << "  absl::Status ParseProto(::sato::ProtoBuffer &buffer) override;\n";
+    os << "  absl::Status ParseProtoField(uint32_t tag, ::sato::ProtoBuffer &buffer) override;\n";
+    os << "  bool HasProtoField(int field_number) const override;\n";
     os << "  absl::Status WriteROS(::sato::ROSBuffer &buffer, uint64_t timestamp = 0) const override;\n";
     return;
   }
@@ -770,51 +2086,87 @@ void MessageGenerator::GenerateProtoToROS(std::ostream &os, bool decl, int level
     if (!tag.ok()) {
       return tag.status();
     }
-    uint32_t field_number = *tag >> ::sato::ProtoBuffer::kFieldIdShift;
-    switch (field_number) {
+)XXX";
+  // Qualified call so that this is not a virtual call.
+  os << "    if (absl::Status status = " << MessageName(message_)
+     << "::ParseProtoField(*tag, buffer); !status.ok()) {\n";
+  os << R"XXX(      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+)XXX";
+
+  os << "absl::Status " << MessageName(message_)
+     << "::ParseProtoField(uint32_t tag, ::sato::ProtoBuffer &buffer) {\n";
+  os << R"XXX(  uint32_t field_number = tag >> ::sato::ProtoBuffer::kFieldIdShift;
+  if (ABSL_PREDICT_FALSE(!IsProjected(field_number))) {
+    return buffer.SkipTag(tag);
+  }
+  switch (field_number) {
 )XXX";
   for (auto &field : fields_) {
-    os << "    case " << field->field->number() << ":\n";
-    os << "      if (absl::Status status = " << field->member_name
-       << ".ParseProto(buffer); !status.ok()) return status;\n";
-    os << "      break;\n";
+    os << "  case " << field->field->number() << ":\n";
+    os << "    presence_.Set(" << field->presence_bit << ");\n";
+    os << "    return " << field->member_name << ".ParseProto(buffer);\n";
   }
   for (auto &[oneof, u] : unions_) {
     for (size_t i = 0; i < u->members.size(); i++) {
       auto &field = u->members[i];
-      os << "    case " << field->field->number() << ":\n";
-      os << "      if (absl::Status status = " << u->member_name
-         << ".ParseProto<" << i << ">(buffer); !status.ok()) return status;\n";
-      os << "      break;\n";
+      os << "  case " << field->field->number() << ":\n";
+      os << "    return " << u->member_name << ".ParseProto<" << i
+         << ">(buffer);\n";
     }
   }
-  os << R"XXX(
-    default:
-      if (absl::Status status = buffer.SkipTag(*tag); !status.ok()) {
-        return status;
-      }
-    }
+  os << R"XXX(  default:
+    return buffer.SkipTag(tag);
   }
-  return absl::OkStatus();
 }
-  
+
 )XXX";
 
+  os << "bool " << MessageName(message_)
+     << "::HasProtoField(int field_number) const {\n";
+  os << "  switch (field_number) {\n";
+  for (auto &field : fields_) {
+    os << "  case " << field->field->number() << ":\n";
+  }
+  for (auto &[oneof, u] : unions_) {
+    for (auto &field : u->members) {
+      os << "  case " << field->field->number() << ":\n";
+    }
+  }
+  if (!fields_.empty() || !unions_.empty()) {
+    os << "    return true;\n";
+  }
+  os << "  default:\n";
+  os << "    return false;\n";
+  os << "  }\n";
+  os << "}\n\n";
+
   os << "absl::Status " << MessageName(message_)
      << "::WriteROS(::sato::ROSBuffer &buffer, uint64_t timestamp) const {\n";
+  if (fixed_ros_size_.has_value()) {
+    // Compact and CDR buffers take the general path.
+    os << "  if (ABSL_PREDICT_TRUE(buffer.HasFixedLayout())) {\n";
+    if (ContainsFixedArray(message_)) {
+      os << "    if (absl::Status status = CheckROSFixed(); !status.ok()) "
+            "return status;\n";
+    }
+    os << "    if (absl::Status status = buffer.HasSpaceFor(kFixedROSSize); "
+          "!status.ok()) return status;\n";
+    os << "    WriteROSFixed(buffer.Addr(), timestamp);\n";
+    os << "    buffer.Addr() += kFixedROSSize;\n";
+    os << "    return absl::OkStatus();\n";
+    os << "  }\n";
+  }
   if (level == 0) {
-    // Write the header.  This is defined as the ROS message:
-    // uint32 seq   - offset 0 size 4
-    // time stamp - offset 4 size 8
-    // string frame_id - offset 12 size 4 + string length (empty)
-    // Total size is 16.
-    os << "  if (absl::Status status = Write(buffer, uint32_t(0)); !status.ok()) return status;\n";
-    // ROS time is two 32 bit numbers: seconds and nanoseconds.
-    os << "  if (absl::Status status = Write(buffer, uint32_t(timestamp / 1000000000)); !status.ok()) return status;\n";
-    os << "  if (absl::Status status = Write(buffer, uint32_t(timestamp % 1000000000)); !status.ok()) return status;\n";
-    os << "  if (absl::Status status = Write(buffer, uint32_t(0)); !status.ok()) return status;\n";
+    // Write the header (std_msgs/Header, or the ROS 2 one in CDR).
+    os << "  if (absl::Status status = ::sato::WriteROSHeader(buffer, "
+       << ROSHeaderArgs() << "); !status.ok()) return status;\n";
   }
-  for (auto &field : fields_in_order_) {
+  for (auto &field : ros_fields_) {
     os << "  if (absl::Status status = " << field->member_name
        << ".WriteROS(buffer); !status.ok()) return status;\n";
   }
@@ -822,6 +2174,637 @@ void MessageGenerator::GenerateProtoToROS(std::ostream &os, bool decl, int level
   os << "}\n\n";
 }
 
+// For messages with a fixed ROS layout, generate straight-line code to
+// write and parse the message at a known address.  The caller does the
+// bounds check for the whole message.
+void MessageGenerator::GenerateFixedROS(std::ostream &os, bool decl,
+                                        int level) {
+  if (!fixed_ros_size_.has_value()) {
+    return;
+  }
+  if (decl) {
+    os << "  static constexpr size_t kFixedROSSize = " << *fixed_ros_size_
+       << ";\n";
+    os << "  void WriteROSFixed(char *addr, uint64_t timestamp = 0) const;\n";
+    os << "  void ParseROSFixed(const char *addr);\n";
+    os << "  static bool HasFixedROSHeaders(const char *addr);\n";
+    // Inline so that it's free for messages without fixed size arrays.
+    os << "  absl::Status CheckROSFixed() const {\n";
+    for (auto &field : fields_in_order_) {
+      const google::protobuf::FieldDescriptor *f = field->field;
+      bool is_message =
+          f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+          FindWellKnownType(f->message_type()) == nullptr;
+      if (f->is_repeated() ||
+          (is_message && ContainsFixedArray(f->message_type()))) {
+        os << "    if (absl::Status status = " << field->member_name
+           << ".CheckROSFixed(); !status.ok()) return status;\n";
+      }
+    }
+    os << "    return absl::OkStatus();\n";
+    os << "  }\n";
+    return;
+  }
+  size_t header_size = level == 0 ? 16 : 0;
+
+  // A ROS publisher can send a std_msgs/Header with a frame_id, which moves
+  // everything after it, so the layout is only fixed if all the headers in it
+  // (this message's and those of fields of top level message types) have an
+  // empty frame_id.  They are checked in order, so each offset is valid if
+  // the checks before it passed.
+  os << "bool " << MessageName(message_)
+     << "::HasFixedROSHeaders(const char *addr) {\n";
+  std::vector<std::string> checks;
+  if (level == 0) {
+    checks.push_back("::sato::ROSFrameIdIsEmpty(addr)");
+  }
+  size_t header_offset = header_size;
+  for (auto &field : fields_in_order_) {
+    const google::protobuf::FieldDescriptor *f = field->field;
+    if (f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+        FindWellKnownType(f->message_type()) == nullptr) {
+      checks.push_back(absl::StrFormat("%s::HasFixedROSHeaders(addr + %d)",
+                                       MessageName(f->message_type(), true),
+                                       header_offset));
+    }
+    header_offset += *FixedFieldROSSize(f, 0);
+  }
+  if (checks.empty()) {
+    os << "  (void)addr;\n";
+    os << "  return true;\n";
+  } else {
+    os << "  return " << absl::StrJoin(checks, " &&\n         ") << ";\n";
+  }
+  os << "}\n\n";
+
+  os << "void " << MessageName(message_)
+     << "::WriteROSFixed(char *addr, uint64_t timestamp) const {\n";
+  if (level == 0) {
+    // Same header as WriteROS.
+    os << "  const uint32_t header[4] = {0, uint32_t(timestamp / 1000000000), "
+          "uint32_t(timestamp % 1000000000), 0};\n";
+    os << "  memcpy(addr, header, sizeof(header));\n";
+  } else {
+    os << "  (void)timestamp;\n";
+  }
+  size_t offset = header_size;
+  for (auto &field : fields_in_order_) {
+    os << "  " << field->member_name << ".WriteROSFixed(addr + " << offset
+       << ");\n";
+    offset += *FixedFieldROSSize(field->field, 0);
+  }
+  os << "}\n\n";
+
+  os << "void " << MessageName(message_)
+     << "::ParseROSFixed(const char *addr) {\n";
+  os << "  SetPopulated(true);\n";
+  offset = header_size;
+  for (auto &field : fields_in_order_) {
+    os << "  " << field->member_name << ".ParseROSFixed(addr + " << offset
+       << ");\n";
+    os << "  if (" << field->member_name << ".HasValue()) presence_.Set("
+       << field->presence_bit << ");\n";
+    offset += *FixedFieldROSSize(field->field, 0);
+  }
+  os << "}\n\n";
+}
+
+// Datatype of a record field, as in sensor_msgs/PointField.
+static std::string
+ROSRecordDatatype(const google::protobuf::FieldDescriptor *field) {
+  switch (field->type()) {
+  case google::protobuf::FieldDescriptor::TYPE_INT32:
+  case google::protobuf::FieldDescriptor::TYPE_SINT32:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
+  case google::protobuf::FieldDescriptor::TYPE_ENUM:
+    return "kInt32";
+  case google::protobuf::FieldDescriptor::TYPE_UINT32:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED32:
+    return "kUint32";
+  case google::protobuf::FieldDescriptor::TYPE_INT64:
+  case google::protobuf::FieldDescriptor::TYPE_SINT64:
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
+    return "kInt64";
+  case google::protobuf::FieldDescriptor::TYPE_UINT64:
+  case google::protobuf::FieldDescriptor::TYPE_FIXED64:
+    return "kUint64";
+  case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+    return "kFloat64";
+  case google::protobuf::FieldDescriptor::TYPE_FLOAT:
+    return "kFloat32";
+  default:
+    return "kUint8";
+  }
+}
+
+// Messages made only of scalar fields can be the records of a blob field
+// (BlobVectorField).  A record is the ROS layout of the message without a
+// header.  The protobuf functions convert a record directly, without a
+// message.
+void MessageGenerator::GenerateROSRecord(std::ostream &os, bool decl) {
+  if (!IsROSRecord(message_)) {
+    return;
+  }
+  std::vector<size_t> offsets;
+  size_t size = 0;
+  for (auto &field : fields_in_order_) {
+    offsets.push_back(size);
+    size += *FixedFieldROSSize(field->field, 0);
+  }
+  if (decl) {
+    os << "  static constexpr size_t kROSRecordSize = " << size << ";\n";
+    os << "  static constexpr ::sato::ROSRecordField kROSRecordFields[] = {\n";
+    for (size_t i = 0; i < fields_in_order_.size(); i++) {
+      const google::protobuf::FieldDescriptor *f = fields_in_order_[i]->field;
+      os << "      {\"" << f->name() << "\", " << offsets[i]
+         << ", ::sato::ROSRecordField::" << ROSRecordDatatype(f) << "},\n";
+    }
+    os << "  };\n";
+    os << "  void WriteROSRecord(char *addr) const;\n";
+    os << "  void ParseROSRecord(const char *addr);\n";
+    os << "  static size_t ProtoRecordSize(const char *record);\n";
+    os << "  static absl::Status WriteProtoRecord(::sato::ProtoBuffer &buffer, "
+          "const char *record);\n";
+    os << "  static absl::Status ParseProtoRecord(::sato::ProtoBuffer &buffer, "
+          "char *record);\n";
+    return;
+  }
+  std::string self = MessageName(message_);
+
+  os << "void " << self << "::WriteROSRecord(char *addr) const {\n";
+  for (size_t i = 0; i < fields_in_order_.size(); i++) {
+    os << "  " << fields_in_order_[i]->member_name << ".WriteROSFixed(addr + "
+       << offsets[i] << ");\n";
+  }
+  os << "}\n\n";
+
+  os << "void " << self << "::ParseROSRecord(const char *addr) {\n";
+  os << "  SetPopulated(true);\n";
+  for (size_t i = 0; i < fields_in_order_.size(); i++) {
+    auto &field = fields_in_order_[i];
+    os << "  " << field->member_name << ".ParseROSFixed(addr + " << offsets[i]
+       << ");\n";
+    os << "  if (" << field->member_name << ".HasValue()) presence_.Set("
+       << field->presence_bit << ");\n";
+  }
+  os << "}\n\n";
+
+  os << "size_t " << self << "::ProtoRecordSize(const char *record) {\n";
+  os << "  size_t size = 0;\n";
+  for (size_t i = 0; i < fields_in_order_.size(); i++) {
+    const google::protobuf::FieldDescriptor *f = fields_in_order_[i]->field;
+    os << "  size += ::sato::RecordValueProtoSize<" << f->number() << ", "
+       << FieldMapCodec(f) << ">(record + " << offsets[i] << ");\n";
+  }
+  os << "  return size;\n";
+  os << "}\n\n";
+
+  os << "absl::Status " << self
+     << "::WriteProtoRecord(::sato::ProtoBuffer &buffer, const char *record) "
+        "{\n";
+  for (size_t i = 0; i < fields_in_order_.size(); i++) {
+    const google::protobuf::FieldDescriptor *f = fields_in_order_[i]->field;
+    os << "  if (absl::Status status = ::sato::WriteRecordValue<"
+       << f->number() << ", " << FieldMapCodec(f) << ">(buffer, record + "
+       << offsets[i] << "); !status.ok()) return status;\n";
+  }
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+
+  os << "absl::Status " << self
+     << "::ParseProtoRecord(::sato::ProtoBuffer &buffer, char *record) {\n";
+  os << R"XXX(  while (!buffer.Eof()) {
+    absl::StatusOr<uint32_t> tag = buffer.DeserializeVarint<uint32_t, false>();
+    if (!tag.ok()) {
+      return tag.status();
+    }
+    absl::Status status;
+    switch (*tag >> ::sato::ProtoBuffer::kFieldIdShift) {
+)XXX";
+  for (size_t i = 0; i < fields_in_order_.size(); i++) {
+    const google::protobuf::FieldDescriptor *f = fields_in_order_[i]->field;
+    os << "    case " << f->number() << ":\n";
+    os << "      status = ::sato::ParseRecordValue<" << FieldMapCodec(f)
+       << ">(buffer, record + " << offsets[i] << ");\n";
+    os << "      break;\n";
+  }
+  os << R"XXX(    default:
+      status = buffer.SkipTag(*tag);
+      break;
+    }
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+)XXX";
+}
+
+// True for a message that can be a compile time constant: a fixed ROS
+// layout made only of singular scalar fields and other such messages.
+static bool IsROSConstant(const google::protobuf::Descriptor *desc,
+                          int depth = 0) {
+  if (depth > 32 || !FixedROSSize(desc).has_value()) {
+    return false;
+  }
+  for (int i = 0; i < desc->field_count(); i++) {
+    const google::protobuf::FieldDescriptor *field = desc->field(i);
+    if (field->is_repeated()) {
+      return false;
+    }
+    if (field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+        (FindWellKnownType(field->message_type()) != nullptr ||
+         !IsROSConstant(field->message_type(), depth + 1))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// C++ type of a scalar field in a Constant and, for protobuf, whether it is
+// a fixed size or zigzag encoded type.
+struct ConstantScalar {
+  const char *type;
+  bool fixed;
+  bool zigzag;
+};
+
+static ConstantScalar
+ConstantScalarType(const google::protobuf::FieldDescriptor *field) {
+  switch (field->type()) {
+  case google::protobuf::FieldDescriptor::TYPE_INT32:
+  case google::protobuf::FieldDescriptor::TYPE_ENUM:
+    return {"int32_t", false, false};
+  case google::protobuf::FieldDescriptor::TYPE_SINT32:
+    return {"int32_t", false, true};
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED32:
+    return {"int32_t", true, false};
+  case google::protobuf::FieldDescriptor::TYPE_UINT32:
+    return {"uint32_t", false, false};
+  case google::protobuf::FieldDescriptor::TYPE_FIXED32:
+    return {"uint32_t", true, false};
+  case google::protobuf::FieldDescriptor::TYPE_INT64:
+    return {"int64_t", false, false};
+  case google::protobuf::FieldDescriptor::TYPE_SINT64:
+    return {"int64_t", false, true};
+  case google::protobuf::FieldDescriptor::TYPE_SFIXED64:
+    return {"int64_t", true, false};
+  case google::protobuf::FieldDescriptor::TYPE_UINT64:
+    return {"uint64_t", false, false};
+  case google::protobuf::FieldDescriptor::TYPE_FIXED64:
+    return {"uint64_t", true, false};
+  case google::protobuf::FieldDescriptor::TYPE_FLOAT:
+    return {"float", true, false};
+  case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+    return {"double", true, false};
+  case google::protobuf::FieldDescriptor::TYPE_BOOL:
+    return {"bool", false, false};
+  default:
+    std::cerr << "Unsupported constant field type: " << field->full_name()
+              << "\n";
+    exit(1);
+  }
+}
+
+// A literal type holding a constant value of the message, with constexpr
+// serialization to ROS and protobuf (see sato/runtime/constant.h).  All
+// inline in the class.
+void MessageGenerator::GenerateConstant(std::ostream &os) {
+  if (!IsROSConstant(message_)) {
+    return;
+  }
+  os << "  class Constant {\n";
+  os << "   public:\n";
+  for (auto &field : fields_in_order_) {
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string name = AccessorName(f->name());
+    if (f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+      std::string type = MessageName(f->message_type(), true) + "::Constant";
+      os << "    constexpr const " << type << " &" << name << "() const { return "
+         << field->member_name << "; }\n";
+      os << "    constexpr Constant &set_" << f->name() << "(const " << type
+         << " &v) { " << field->member_name << " = v; return *this; }\n";
+    } else {
+      const char *type = ConstantScalarType(f).type;
+      os << "    constexpr " << type << " " << name << "() const { return "
+         << field->member_name << "; }\n";
+      os << "    constexpr Constant &set_" << f->name() << "(" << type
+         << " v) { " << field->member_name << " = v; return *this; }\n";
+    }
+  }
+  os << "\n";
+
+  // ROS, as WriteROSFixed.
+  os << "    template <typename Buffer>\n";
+  os << "    constexpr void WriteROS(Buffer &buffer, uint64_t timestamp = 0) "
+        "const {\n";
+  if (message_->containing_type() == nullptr) {
+    os << "      buffer.Write(uint32_t(0));\n";
+    os << "      buffer.Write(uint32_t(timestamp / 1000000000));\n";
+    os << "      buffer.Write(uint32_t(timestamp % 1000000000));\n";
+    os << "      buffer.Write(uint32_t(0));\n";
+  } else {
+    os << "      (void)timestamp;\n";
+  }
+  for (auto &field : fields_in_order_) {
+    const google::protobuf::FieldDescriptor *f = field->field;
+    if (f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+      os << "      " << field->member_name << ".WriteROS(buffer);\n";
+    } else if (f->type() == google::protobuf::FieldDescriptor::TYPE_BOOL) {
+      os << "      buffer.Write(uint8_t(" << field->member_name << "));\n";
+    } else {
+      os << "      buffer.Write(" << field->member_name << ");\n";
+    }
+  }
+  os << "    }\n\n";
+
+  // Protobuf, without zero values or empty messages.
+  os << "    constexpr size_t ProtoSize() const {\n";
+  os << "      size_t size = 0;\n";
+  for (auto &field : fields_in_order_) {
+    const google::protobuf::FieldDescriptor *f = field->field;
+    if (f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+      os << "      if (size_t n = " << field->member_name
+         << ".ProtoSize(); n > 0) size += "
+            "::sato::ProtoBuffer::LengthDelimitedSize<"
+         << f->number() << ">(n);\n";
+      continue;
+    }
+    ConstantScalar scalar = ConstantScalarType(f);
+    os << "      if (" << field->member_name << " != 0) size += ";
+    if (scalar.fixed) {
+      os << "::sato::ConstantFixedFieldSize<" << f->number() << ", "
+         << scalar.type << ">();\n";
+    } else {
+      os << "::sato::ConstantVarintFieldSize<" << f->number() << ", "
+         << scalar.type << ", " << (scalar.zigzag ? "true" : "false") << ">("
+         << field->member_name << ");\n";
+    }
+  }
+  os << "      return size;\n";
+  os << "    }\n\n";
+
+  os << "    template <typename Buffer>\n";
+  os << "    constexpr void WriteProto(Buffer &buffer) const {\n";
+  for (auto &field : fields_in_order_) {
+    const google::protobuf::FieldDescriptor *f = field->field;
+    if (f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+      os << "      if (size_t n = " << field->member_name
+         << ".ProtoSize(); n > 0) {\n";
+      os << "        buffer.template WriteLengthDelimitedHeader<" << f->number()
+         << ">(n);\n";
+      os << "        " << field->member_name << ".WriteProto(buffer);\n";
+      os << "      }\n";
+      continue;
+    }
+    ConstantScalar scalar = ConstantScalarType(f);
+    os << "      if (" << field->member_name << " != 0) ";
+    if (scalar.fixed) {
+      os << "buffer.template WriteFixedField<" << f->number() << ", "
+         << scalar.type << ">(" << field->member_name << ");\n";
+    } else {
+      os << "buffer.template WriteVarintField<" << f->number() << ", "
+         << scalar.type << ", " << (scalar.zigzag ? "true" : "false") << ">("
+         << field->member_name << ");\n";
+    }
+  }
+  os << "    }\n\n";
+
+  os << "   private:\n";
+  for (auto &field : fields_in_order_) {
+    const google::protobuf::FieldDescriptor *f = field->field;
+    if (f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) {
+      os << "    " << MessageName(f->message_type(), true) << "::Constant "
+         << field->member_name << ";\n";
+    } else {
+      os << "    " << ConstantScalarType(f).type << " " << field->member_name
+         << " = {};\n";
+    }
+  }
+  os << "  };\n";
+
+  os << "  static constexpr std::array<char, kFixedROSSize> ConstantROS(const "
+        "Constant &c, uint64_t timestamp = 0) {\n";
+  os << "    return ::sato::SerializeConstantROS<kFixedROSSize>(c, "
+        "timestamp);\n";
+  os << "  }\n";
+  os << "  static constexpr size_t ConstantProtoSize(const Constant &c) { "
+        "return c.ProtoSize(); }\n";
+  os << "  template <size_t N>\n";
+  os << "  static constexpr std::array<char, N> ConstantProto(const Constant "
+        "&c) {\n";
+  os << "    return ::sato::SerializeConstantProto<N>(c);\n";
+  os << "  }\n";
+}
+
+// Whether a message's ROS form has a std_msgs/Header, whose frame_id makes
+// its size variable, either its own or in a nested message.
+static bool ContainsROSHeader(const google::protobuf::Descriptor *desc,
+                              int depth = 0) {
+  if (desc->containing_type() == nullptr) {
+    return true;
+  }
+  if (depth > 32) {
+    return false;
+  }
+  for (int i = 0; i < desc->field_count(); i++) {
+    const google::protobuf::FieldDescriptor *field = desc->field(i);
+    if (field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+        FindWellKnownType(field->message_type()) == nullptr &&
+        ContainsROSHeader(field->message_type(), depth + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Work out where the fields of the message are in ROS format, relative to
+// the end of the header of a top level message.  The offsets are constant up
+// to and including the first variable length field.  The rest are found by
+// the view's Create function and held in its offsets.
+std::vector<ROSViewItem> MessageGenerator::ROSViewLayout(int &num_slots) {
+  std::vector<ROSViewItem> items;
+  for (auto &field : ros_fields_) {
+    if (!field->IsUnion()) {
+      std::optional<size_t> size = FixedFieldROSSize(field->field, 0);
+      if (field->field->type() ==
+              google::protobuf::FieldDescriptor::TYPE_MESSAGE &&
+          FindWellKnownType(field->field->message_type()) == nullptr &&
+          ContainsROSHeader(field->field->message_type())) {
+        size = std::nullopt;
+      }
+      items.push_back({field.get(),
+                       "::sato::" + field->member_type + "::SkipROS(buffer)",
+                       size});
+      continue;
+    }
+    auto u = std::static_pointer_cast<UnionInfo>(field);
+    items.push_back({u.get(), "buffer.Skip(4)", 4});
+    for (auto &member : u->members) {
+      items.push_back({member.get(),
+                       "::sato::" + member->member_type + "::SkipROS(buffer)",
+                       std::nullopt});
+    }
+  }
+  std::optional<size_t> offset = 0;
+  num_slots = 0;
+  for (auto &item : items) {
+    if (offset.has_value()) {
+      item.offset = offset;
+    } else {
+      item.slot = num_slots++;
+    }
+    if (offset.has_value() && item.size.has_value()) {
+      *offset += *item.size;
+    } else {
+      offset = std::nullopt;
+    }
+  }
+  return items;
+}
+
+// Generate a read-only view over a message in a ROS buffer.  The getters
+// are inline in the class and Create is in the source.
+void MessageGenerator::GenerateROSView(std::ostream &os, bool decl) {
+  std::string view = MessageName(message_) + "ROSView";
+  int num_slots = 0;
+  std::vector<ROSViewItem> items = ROSViewLayout(num_slots);
+
+  if (!decl) {
+    os << "absl::StatusOr<" << view << "> " << view
+       << "::Create(const char *data, size_t size) {\n";
+    os << "  " << view << " view;\n";
+    os << "  ::sato::ROSBuffer buffer(const_cast<char *>(data), size);\n";
+    if (message_->containing_type() == nullptr) {
+      os << "  if (absl::Status status = ::sato::SkipROSHeader(buffer); "
+            "!status.ok()) return status;\n";
+    }
+    os << "  view.data_ = buffer.Addr();\n";
+    os << "  view.header_size_ = uint32_t(view.data_ - data);\n";
+    // Skip the fixed size prefix in one go.
+    auto first_var = std::find_if(items.begin(), items.end(),
+                                  [](const ROSViewItem &item) {
+                                    return !item.size.has_value();
+                                  });
+    size_t prefix = 0;
+    if (first_var != items.end()) {
+      prefix = *first_var->offset;
+    } else if (!items.empty()) {
+      prefix = *items.back().offset + *items.back().size;
+    }
+    if (prefix > 0) {
+      os << "  if (absl::Status status = buffer.Skip(" << prefix
+         << "); !status.ok()) return status;\n";
+    }
+    for (auto it = first_var; it != items.end(); ++it) {
+      if (it->slot >= 0) {
+        os << "  view.offsets_[" << it->slot
+           << "] = uint32_t(buffer.Addr() - view.data_);\n";
+      }
+      os << "  if (absl::Status status = " << it->skip
+         << "; !status.ok()) return status;\n";
+    }
+    os << "  view.size_ = size_t(buffer.Addr() - view.data_);\n";
+    os << "  return view;\n";
+    os << "}\n\n";
+    return;
+  }
+
+  os << "// Read-only view of a " << MessageName(message_)
+     << " in a ROS buffer.  The buffer must outlive the view.\n";
+  os << "class " << view << " {\n";
+  os << " public:\n";
+  os << "  static absl::StatusOr<" << view
+     << "> Create(const char *data, size_t size);\n\n";
+  os << "  // Number of bytes of the buffer occupied by the message.\n";
+  os << "  size_t SerializedSize() const { return header_size_ + size_; "
+        "}\n\n";
+
+  for (auto &item : items) {
+    const FieldInfo *field = item.field;
+    std::string addr = item.offset.has_value()
+                           ? "data_ + " + std::to_string(*item.offset)
+                           : "data_ + offsets_[" + std::to_string(item.slot) +
+                                 "]";
+    if (field->IsUnion()) {
+      auto u = static_cast<const UnionInfo *>(field);
+      os << "  int32_t " << u->oneof->name()
+         << "_case() const { return ::sato::ROSViewValue<int32_t>(" << addr
+         << "); }\n";
+      continue;
+    }
+    const google::protobuf::FieldDescriptor *f = field->field;
+    std::string name = AccessorName(f->name());
+    bool is_message =
+        f->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE;
+    bool is_string =
+        f->type() == google::protobuf::FieldDescriptor::TYPE_STRING ||
+        f->type() == google::protobuf::FieldDescriptor::TYPE_BYTES;
+    // No getters for maps and Any.
+    if (f->is_map() || IsAny(f)) {
+      continue;
+    }
+    std::string msg_view =
+        is_message ? MessageName(f->message_type(), true) + "ROSView" : "";
+    if (f->containing_oneof() != nullptr) {
+      if (is_message) {
+        os << "  std::optional<" << msg_view << "> " << name
+           << "() const { return ::sato::ROSViewOptionalMessage<" << msg_view
+           << ">(" << addr << ", data_ + size_); }\n";
+      } else if (is_string) {
+        os << "  std::string_view " << name
+           << "() const { return ::sato::ROSViewString(" << addr << "); }\n";
+      } else {
+        os << "  " << field->c_type << " " << name
+           << "() const { return ::sato::ROSViewValue<" << field->c_type
+           << ">(" << addr << "); }\n";
+      }
+    } else if (f->is_repeated()) {
+      if (IsROSBlob(f)) {
+        os << "  absl::Span<const char> " << name
+           << "() const { return ::sato::ROSViewBlob(" << addr << "); }\n";
+      } else if (is_message) {
+        os << "  std::vector<" << msg_view << "> " << name
+           << "() const { return ::sato::ROSViewMessages<" << msg_view << ">("
+           << addr << ", data_ + size_); }\n";
+      } else if (is_string) {
+        os << "  std::vector<std::string_view> " << name
+           << "() const { return ::sato::ROSViewStrings(" << addr << "); }\n";
+      } else if (uint32_t size = ROSFixedSize(f); size > 0) {
+        os << "  ::sato::ROSArrayView<" << field->c_type << "> " << name
+           << "() const { return ::sato::ROSViewFixedArray<" << field->c_type
+           << ", " << size << ">(" << addr << "); }\n";
+      } else {
+        os << "  ::sato::ROSArrayView<" << field->c_type << "> " << name
+           << "() const { return ::sato::ROSViewArray<" << field->c_type
+           << ">(" << addr << "); }\n";
+      }
+    } else if (is_message) {
+      os << "  " << msg_view << " " << name
+         << "() const { return ::sato::ROSViewMessage<" << msg_view << ">("
+         << addr << ", data_ + size_); }\n";
+    } else if (is_string) {
+      os << "  std::string_view " << name
+         << "() const { return ::sato::ROSViewString(" << addr << "); }\n";
+    } else {
+      os << "  " << field->c_type << " " << name
+         << "() const { return ::sato::ROSViewValue<" << field->c_type << ">("
+         << addr << "); }\n";
+    }
+  }
+
+  os << "\n private:\n";
+  os << "  const char *data_ = nullptr;\n";
+  os << "  size_t size_ = 0;\n";
+  os << "  uint32_t header_size_ = 0;\n";
+  if (num_slots > 0) {
+    os << "  uint32_t offsets_[" << num_slots << "] = {};\n";
+  }
+  os << "};\n\n";
+}
+
 void MessageGenerator::GenerateMultiplexer(std::ostream &os) {
   os << "static std::unique_ptr<::sato::Message> " << MessageName(message_) << "CreateMessage() {\n";
   os << "  return std::make_unique<" << MessageName(message_) << ">();\n";
@@ -884,6 +2867,10 @@ void MessageGenerator::GenerateMultiplexer(std::ostream &os) {
      << "SerializedProtoSize,\n";
   os << "  .serialized_ros_size = " << MessageName(message_)
      << "SerializedROSSize,\n";
+  os << "  .ros_datatype = " << MessageName(message_) << "::ROSDataType(),\n";
+  os << "  .ros_md5sum = " << MessageName(message_) << "::ROSMd5Sum(),\n";
+  os << "  .ros_definition = " << MessageName(message_)
+     << "::ROSDefinition(),\n";
 
   os << "};\n\n";
 
@@ -11,6 +11,7 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <vector>
 #include "zip.h"
 
@@ -43,6 +44,7 @@ struct FieldInfo {
   std::string c_type;
   std::string ros_type;
   std::string ros_member_name;
+  int presence_bit = -1; // Bit in the message's PresenceBits.
 };
 
 struct UnionInfo : public FieldInfo {
@@ -55,6 +57,25 @@ struct UnionInfo : public FieldInfo {
   std::vector<std::shared_ptr<FieldInfo>> members;
 };
 
+// A field in the ROS layout of a message, for generating the ROS view.  A
+// oneof is a discriminator followed by the members.
+struct ROSViewItem {
+  const FieldInfo *field;
+  std::string skip;             // Expression to skip the field.
+  std::optional<size_t> size;   // Size if fixed.
+  std::optional<size_t> offset; // Offset if constant.
+  int slot = -1;                // Index into the view's offsets otherwise.
+};
+
+// A ROS1 message type for the connection metadata: its definition (the
+// contents of the .msg file), MD5 sum and the types it uses.
+struct ROSTypeInfo {
+  std::string datatype;
+  std::string text;
+  std::string md5;
+  std::vector<const ROSTypeInfo *> depends;
+};
+
 class MessageGenerator {
 public:
   MessageGenerator(const google::protobuf::Descriptor *message,
@@ -82,6 +103,7 @@ public:
   void GenerateFieldDeclarations(std::ostream &os);
 
   void GenerateEnums(std::ostream &os);
+  void GenerateStruct(std::ostream &os, bool decl);
 
 private:
   void CompileFields();
@@ -89,12 +111,27 @@ private:
 
   void GenerateDefaultConstructor(std::ostream &os, bool decl);
   void GenerateConstructors(std::ostream &os, bool decl);
-  void GenerateFieldInitializers(std::ostream &os, const char *sep = ": ");
+  void GenerateIsPresent(std::ostream &os);
+  void GenerateAccessors(std::ostream &os);
+  void GenerateProtoObject(std::ostream &os, bool decl);
   void GenerateSizeFunctions(std::ostream &os);
 
   void GenerateSerializedSize(std::ostream &os, bool decl, int level);
   void GenerateROSToProto(std::ostream &os, bool decl, int level);
   void GenerateProtoToROS(std::ostream &os, bool decl, int level);
+  void GenerateFixedROS(std::ostream &os, bool decl, int level);
+  void GenerateROSRecord(std::ostream &os, bool decl);
+  void GenerateConstant(std::ostream &os);
+  void GenerateROSView(std::ostream &os, bool decl);
+  std::vector<ROSViewItem> ROSViewLayout(int &num_slots);
+  std::string ROSMessageText(std::string *md5_text,
+                             std::vector<const ROSTypeInfo *> *depends);
+  const ROSTypeInfo &ROSType(const google::protobuf::Descriptor *desc);
+  std::string ROSFullDefinition(const ROSTypeInfo &type);
+  void GenerateROSMetadata(std::ostream &os);
+  std::string ROSHeaderFrameId();
+  std::string ROSHeaderArgs();
+  void GenerateROSHeaderParse(std::ostream &os);
 
   bool IsAny(const google::protobuf::Descriptor *desc);
   bool IsAny(const google::protobuf::FieldDescriptor *field);
@@ -114,6 +151,11 @@ private:
   std::string
   FieldRepeatedCType(const google::protobuf::FieldDescriptor *field);
   std::string FieldUnionCType(const google::protobuf::FieldDescriptor *field);
+  std::string FieldMapCodec(const google::protobuf::FieldDescriptor *field);
+  std::string FieldMapCType(const google::protobuf::FieldDescriptor *field);
+  std::string StructName(const google::protobuf::Descriptor *desc);
+  std::string StructCodec(const google::protobuf::FieldDescriptor *field);
+  std::string StructCType(const google::protobuf::FieldDescriptor *field);
   uint32_t FieldBinarySize(const google::protobuf::FieldDescriptor *field);
   void GenerateFieldNumbers(std::ostream &os);
 
@@ -126,6 +168,12 @@ private:
            std::shared_ptr<UnionInfo>>
       unions_;
   std::vector<std::shared_ptr<FieldInfo>> fields_in_order_;
+  // The fields in ROS format.  This is fields_in_order_ without the field
+  // bound to the std_msgs/Header with (sato.ros_header).
+  std::vector<std::shared_ptr<FieldInfo>> ros_fields_;
+  std::shared_ptr<FieldInfo> header_field_;
+  // Size of the ROS serialization if it doesn't depend on the contents.
+  std::optional<size_t> fixed_ros_size_;
   std::string added_namespace_;
   std::string package_name_;
 };
@@ -27,7 +27,7 @@ namespace sato {
 // Hand-coded message class that represents a google.protobuf.Any message.
 class AnyMessage : public Message {
 public:
-  AnyMessage() : type_url_(1) {}
+  AnyMessage() = default;
 
   static std::string Name() { return "Any"; }
   static std::string FullName() { return "google.protobuf.Any"; }
@@ -36,13 +36,13 @@ public:
 
   size_t SerializedProtoSize() const {
     size_t size = 0;
-    if (type_url_.IsPresent()) {
+    if (type_url_.HasValue()) {
       size += type_url_.SerializedProtoSize();
     }
     if (value_ != nullptr) {
       // This is the serialized proto message encoded in a string.
       size +=
-          ProtoBuffer::LengthDelimitedSize(2, value_->SerializedProtoSize());
+          ProtoBuffer::LengthDelimitedSize<2>(value_->SerializedProtoSize());
     }
 
     return size;
@@ -58,7 +58,7 @@ public:
   }
 
   absl::Status WriteProto(sato::ProtoBuffer &buffer) const {
-    if (type_url_.IsPresent()) {
+    if (type_url_.HasValue()) {
       if (absl::Status status = type_url_.WriteProto(buffer); !status.ok()) {
         return status;
       }
@@ -72,8 +72,8 @@ public:
           return status;
         }
         std::string_view value_string(value_buffer.data(), value_buffer.size());
-        if (absl::Status status = buffer.SerializeLengthDelimited(
-                2, value_string.data(), value_string.size());
+        if (absl::Status status = buffer.SerializeLengthDelimited<2>(
+                value_string.data(), value_string.size());
             !status.ok()) {
           return status;
         }
@@ -89,6 +89,7 @@ public:
       return status;
     }
     sato::ROSBuffer value_buffer;
+    value_buffer.SetCDR(buffer.IsCDR());
     if (value_ != nullptr) {
       if (absl::Status status = value_->WriteROS(value_buffer); !status.ok()) {
         return status;
@@ -109,41 +110,54 @@ public:
       if (!tag.ok()) {
         return tag.status();
       }
-      uint32_t field_number = *tag >> sato::ProtoBuffer::kFieldIdShift;
-      switch (field_number) {
-      case 1:
-        if (absl::Status status = type_url_.ParseProto(buffer); !status.ok()) {
-          return status;
-        }
-        break;
-      case 2: {
-        std::string type = MessageTypeName();
-        value_ = MultiplexerCreateMessage(type);
-        if (value_ == nullptr) {
-          return absl::InternalError(
-              absl::StrFormat("Unknown message type: %s", type));
-        }
-        if (absl::Status status = value_->ParseProto(buffer); !status.ok()) {
-          return status;
-        }
-        break;
-      }
-      default:
-        if (absl::Status status = buffer.SkipTag(*tag); !status.ok()) {
-          return status;
-        }
+      if (absl::Status status = ParseProtoField(*tag, buffer); !status.ok()) {
+        return status;
       }
     }
     return absl::OkStatus();
   }
 
+  absl::Status ParseProtoField(uint32_t tag, sato::ProtoBuffer &buffer) {
+    uint32_t field_number = tag >> sato::ProtoBuffer::kFieldIdShift;
+    switch (field_number) {
+    case 1:
+      return type_url_.ParseProto(buffer);
+    case 2: {
+      std::string type = MessageTypeName();
+      value_ = MultiplexerCreateMessage(type);
+      if (value_ == nullptr) {
+        return absl::InternalError(
+            absl::StrFormat("Unknown message type: %s", type));
+      }
+      // The value is a length delimited serialized message.
+      absl::StatusOr<absl::Span<char>> value =
+          buffer.DeserializeLengthDelimited();
+      if (!value.ok()) {
+        return value.status();
+      }
+      sato::ProtoBuffer value_buffer(*value);
+      return value_->ParseProto(value_buffer);
+    }
+    default:
+      return buffer.SkipTag(tag);
+    }
+  }
+
+  // The type url and the value are both strings.
+  static absl::Status SkipROS(sato::ROSBuffer &buffer) {
+    if (absl::Status status = StringField<1>::SkipROS(buffer); !status.ok()) {
+      return status;
+    }
+    return StringField<2>::SkipROS(buffer);
+  }
+
   absl::Status ParseROS(sato::ROSBuffer &buffer) {
     if (absl::Status status = type_url_.ParseROS(buffer); !status.ok()) {
       return status;
     }
-    if (!type_url_.IsPresent()) {
+    if (!type_url_.HasValue()) {
       // Message type is empty.  We still have the empty value field to parse.
-      return buffer.Skip(4);
+      return StringField<2>::SkipROS(buffer);
     }
     std::string type = MessageTypeName();
 
@@ -152,6 +166,20 @@ public:
       return absl::InternalError(
           absl::StrFormat("Unknown message type: %s", type));
     }
+    if (ABSL_PREDICT_FALSE(buffer.IsCDR())) {
+      // The value is a CDR message of its own, with its own alignment.
+      std::string_view value;
+      if (absl::Status status = Read(buffer, value); !status.ok()) {
+        return status;
+      }
+      if (value.empty()) {
+        return absl::OkStatus();
+      }
+      sato::ROSBuffer value_buffer(const_cast<char *>(value.data()),
+                                   value.size());
+      value_buffer.SetCDR(true);
+      return value_->ParseROS(value_buffer);
+    }
     uint32_t value_size = 0;
     if (absl::Status status = Read(buffer, value_size); !status.ok()) {
       return status;
@@ -165,6 +193,36 @@ public:
     return absl::OkStatus();
   }
 
+  // Conversion from and to a google::protobuf::Any object.  The value is
+  // held as serialized bytes in the object, so it is parsed.
+  template <typename Proto> absl::Status FromProtoObject(const Proto &pb) {
+    type_url_.Set(pb.type_url());
+    if (!type_url_.HasValue()) {
+      return absl::OkStatus();
+    }
+    std::string type = MessageTypeName();
+    value_ = MultiplexerCreateMessage(type);
+    if (value_ == nullptr) {
+      return absl::InternalError(
+          absl::StrFormat("Unknown message type: %s", type));
+    }
+    sato::ProtoBuffer value_buffer(std::string_view(pb.value()));
+    return value_->ParseProto(value_buffer);
+  }
+
+  template <typename Proto> absl::Status ToProtoObject(Proto *pb) const {
+    pb->set_type_url(std::string(type_url_.Value()));
+    if (value_ != nullptr) {
+      sato::ProtoBuffer value_buffer;
+      if (absl::Status status = value_->WriteProto(value_buffer);
+          !status.ok()) {
+        return status;
+      }
+      pb->set_value(value_buffer.AsString());
+    }
+    return absl::OkStatus();
+  }
+
   std::string MessageTypeName() const {
     std::string type = std::string(type_url_.Value());
     size_t pos = type.find('/');
@@ -173,17 +231,15 @@ public:
     }
     return type;
   }
-  bool IsPresent() const { return type_url_.IsPresent(); }
+  bool IsPresent() const { return type_url_.HasValue(); }
 
 private:
-  sato::StringField type_url_;
+  sato::StringField<1> type_url_;
   std::unique_ptr<sato::Message> value_;
 };
 
-class AnyField : public MessageField<AnyMessage> {
-public:
-  AnyField(int number) : MessageField(number) {}
-  bool IsPresent() const { return msg_.IsPresent(); }
-};
+// An Any field is present if it has a type.
+template <int FieldNumber>
+using AnyField = MessageField<FieldNumber, AnyMessage>;
 
 } // namespace sato
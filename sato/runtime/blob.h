@@ -0,0 +1,199 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Blob fields, generated for repeated message fields with
+// (sato.ros_blob) = true.
+//
+// The element messages are made only of scalar fields, like the points of a
+// point cloud.  Rather than a ROS array of messages, the field is a uint8[]
+// of packed records, in the spirit of sensor_msgs/PointCloud2.  A record is
+// the ROS layout of the message without a header, and its layout is
+// described by the message's kROSRecordFields.
+//
+// The records are held in ROS layout, so writing and parsing ROS is a
+// single copy of the whole array.  Protobuf elements are decoded straight
+// into a record by the message's generated ParseProtoRecord without
+// creating a message for each element.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/types/span.h"
+#include "sato/runtime/fields.h"
+#include "sato/runtime/protobuf.h"
+#include "sato/runtime/ros.h"
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+namespace sato {
+
+// A field of a record.  The datatypes are those of sensor_msgs/PointField,
+// with two more for 64 bit integers.
+struct ROSRecordField {
+  static constexpr uint8_t kInt8 = 1;
+  static constexpr uint8_t kUint8 = 2;
+  static constexpr uint8_t kInt16 = 3;
+  static constexpr uint8_t kUint16 = 4;
+  static constexpr uint8_t kInt32 = 5;
+  static constexpr uint8_t kUint32 = 6;
+  static constexpr uint8_t kFloat32 = 7;
+  static constexpr uint8_t kFloat64 = 8;
+  static constexpr uint8_t kInt64 = 9;
+  static constexpr uint8_t kUint64 = 10;
+
+  const char *name;
+  uint32_t offset;
+  uint8_t datatype;
+};
+
+// Record values are encoded by the same codecs as map entries.  As in a
+// message, zero values are not written to protobuf.
+template <typename Codec>
+inline absl::Status ParseRecordValue(ProtoBuffer &buffer, char *addr) {
+  typename Codec::Type v;
+  if (absl::Status status = Codec::ParseProto(buffer, v); !status.ok()) {
+    return status;
+  }
+  memcpy(addr, &v, sizeof(v));
+  return absl::OkStatus();
+}
+
+template <int Number, typename Codec>
+inline size_t RecordValueProtoSize(const char *addr) {
+  typename Codec::Type v;
+  memcpy(&v, addr, sizeof(v));
+  return v == 0 ? 0 : Codec::template ProtoSize<Number>(v);
+}
+
+template <int Number, typename Codec>
+inline absl::Status WriteRecordValue(ProtoBuffer &buffer, const char *addr) {
+  typename Codec::Type v;
+  memcpy(&v, addr, sizeof(v));
+  if (v == 0) {
+    return absl::OkStatus();
+  }
+  return Codec::template WriteProto<Number>(buffer, v);
+}
+
+template <int FieldNumber, typename T>
+class BlobVectorField : public Field<FieldNumber> {
+public:
+  size_t SerializedProtoSize() const {
+    size_t length = 0;
+    for (size_t i = 0; i < size(); i++) {
+      length += ProtoBuffer::LengthDelimitedSize<FieldNumber>(
+          T::ProtoRecordSize(Record(i)));
+    }
+    return length;
+  }
+
+  size_t SerializedROSSize() const { return 4 + records_.size(); }
+
+  absl::Status WriteProto(ProtoBuffer &buffer) const {
+    for (size_t i = 0; i < size(); i++) {
+      const char *record = Record(i);
+      if (absl::Status status =
+              buffer.SerializeLengthDelimitedHeader<FieldNumber>(
+                  T::ProtoRecordSize(record));
+          !status.ok()) {
+        return status;
+      }
+      if (absl::Status status = T::WriteProtoRecord(buffer, record);
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteROS(ROSBuffer &buffer) const {
+    return WriteByteArray(buffer,
+                          std::string_view(records_.data(), records_.size()));
+  }
+
+  absl::Status ParseProto(ProtoBuffer &buffer) {
+    if (records_.empty()) {
+      // First one, count the rest so that we only allocate once.
+      records_.reserve(buffer.CountFields(kTag) * T::kROSRecordSize);
+    }
+    absl::StatusOr<absl::Span<char>> s = buffer.DeserializeLengthDelimited();
+    if (!s.ok()) {
+      return s.status();
+    }
+    // Fields that are not in the element are zero.
+    size_t offset = records_.size();
+    records_.resize(offset + T::kROSRecordSize);
+    ProtoBuffer sub_buffer(*s);
+    return T::ParseProtoRecord(sub_buffer, records_.data() + offset);
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) {
+    std::string_view records;
+    if (absl::Status status = ReadByteArray(buffer, records); !status.ok()) {
+      return status;
+    }
+    if (records.size() % T::kROSRecordSize != 0) {
+      return absl::InternalError(
+          absl::StrFormat("Blob of %d bytes is not a whole number of %d byte "
+                          "records",
+                          records.size(), T::kROSRecordSize));
+    }
+    records_.insert(records_.end(), records.begin(), records.end());
+    return absl::OkStatus();
+  }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    std::string_view records;
+    return ReadByteArray(buffer, records);
+  }
+
+  bool HasValue() const { return !records_.empty(); }
+
+  size_t size() const { return records_.size() / T::kROSRecordSize; }
+  void Reserve(size_t n) { records_.reserve(n * T::kROSRecordSize); }
+
+  // The elements are decoded from and encoded to the records.
+  T Get(size_t i) const {
+    T msg;
+    msg.ParseROSRecord(Record(i));
+    return msg;
+  }
+  void Add(const T &msg) {
+    size_t offset = records_.size();
+    records_.resize(offset + T::kROSRecordSize);
+    msg.WriteROSRecord(records_.data() + offset);
+  }
+  template <typename Proto> absl::Status AddFromProtoObject(const Proto &pb) {
+    T msg;
+    if (absl::Status status = msg.FromProtoObject(pb); !status.ok()) {
+      return status;
+    }
+    Add(msg);
+    return absl::OkStatus();
+  }
+
+  // Direct access to the records, laid out as in T::kROSRecordFields.
+  const char *Record(size_t i) const {
+    return records_.data() + i * T::kROSRecordSize;
+  }
+  char *MutableRecord(size_t i) {
+    return records_.data() + i * T::kROSRecordSize;
+  }
+  absl::Span<const char> Records() const {
+    return absl::Span<const char>(records_.data(), records_.size());
+  }
+
+private:
+  static constexpr uint32_t kTag =
+      (FieldNumber << ProtoBuffer::kFieldIdShift) |
+      uint32_t(WireType::kLengthDelimited);
+
+  std::vector<char> records_;
+};
+
+} // namespace sato
@@ -0,0 +1,128 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Compile time serialization of constant messages.
+//
+// A generated message whose ROS layout is fixed and made only of scalars
+// and other such messages has a literal Constant type with constexpr
+// setters.  A Constant is serialized by constexpr functions, so a message
+// that never changes, like a static transform or a calibration, is encoded
+// by the compiler:
+//
+//   constexpr Vector3::Constant kUp = Vector3::Constant().set_z(1);
+//   constexpr auto kUpROS = Vector3::ConstantROS(kUp);
+//   constexpr auto kUpProto =
+//       Vector3::ConstantProto<Vector3::ConstantProtoSize(kUp)>(kUp);
+//
+// The ROS form is the fixed layout written by WriteROSFixed, with the
+// timestamp given.  The protobuf form omits zero values, as the message
+// does.
+
+#include "absl/status/status.h"
+#include "sato/runtime/protobuf.h"
+#include "sato/runtime/ros.h"
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+namespace sato {
+
+// Fixed size buffer for constexpr serialization.  Writing past the end is
+// an error at compile time.
+template <size_t N> class ConstantBuffer {
+public:
+  // Little endian, as both ROS and the protobuf fixed types are.
+  template <typename T> constexpr void Write(T v) {
+    using Bits = std::conditional_t<
+        sizeof(T) == 1, uint8_t,
+        std::conditional_t<sizeof(T) == 2, uint16_t,
+                           std::conditional_t<sizeof(T) == 4, uint32_t,
+                                              uint64_t>>>;
+    Bits bits = __builtin_bit_cast(Bits, v);
+    for (size_t i = 0; i < sizeof(T); i++) {
+      data_[pos_++] = char(uint8_t(bits >> (i * 8)));
+    }
+  }
+
+  constexpr void WriteVarint(uint64_t v) {
+    while (v >= 0x80) {
+      data_[pos_++] = char((v & 0x7f) | 0x80);
+      v >>= 7;
+    }
+    data_[pos_++] = char(v);
+  }
+
+  constexpr void WriteTag(const EncodedTag &tag) {
+    for (size_t i = 0; i < tag.size; i++) {
+      data_[pos_++] = tag.bytes[i];
+    }
+  }
+
+  template <int Number, typename T, bool Signed>
+  constexpr void WriteVarintField(T v) {
+    WriteTag(ProtoBuffer::kTag<Number, WireType::kVarint>);
+    WriteVarint(ProtoBuffer::VarintValue<T, Signed>(v));
+  }
+
+  template <int Number, typename T> constexpr void WriteFixedField(T v) {
+    WriteTag(ProtoBuffer::kTag<Number, ProtoBuffer::FixedWireType<T>()>);
+    Write(v);
+  }
+
+  template <int Number>
+  constexpr void WriteLengthDelimitedHeader(size_t length) {
+    WriteTag(ProtoBuffer::kTag<Number, WireType::kLengthDelimited>);
+    WriteVarint(length);
+  }
+
+  constexpr size_t Size() const { return pos_; }
+  constexpr const std::array<char, N> &Array() const { return data_; }
+
+private:
+  std::array<char, N> data_ = {};
+  size_t pos_ = 0;
+};
+
+template <int Number, typename T, bool Signed>
+constexpr size_t ConstantVarintFieldSize(T v) {
+  return ProtoBuffer::TagSize<Number, WireType::kVarint>() +
+         ProtoBuffer::VarintSize<T, Signed>(v);
+}
+
+template <int Number, typename T> constexpr size_t ConstantFixedFieldSize() {
+  return ProtoBuffer::TagSize<Number, ProtoBuffer::FixedWireType<T>()>() +
+         sizeof(T);
+}
+
+template <size_t N, typename Constant>
+constexpr std::array<char, N> SerializeConstantROS(const Constant &c,
+                                                   uint64_t timestamp) {
+  ConstantBuffer<N> buffer;
+  c.WriteROS(buffer, timestamp);
+  return buffer.Array();
+}
+
+template <size_t N, typename Constant>
+constexpr std::array<char, N> SerializeConstantProto(const Constant &c) {
+  ConstantBuffer<N> buffer;
+  c.WriteProto(buffer);
+  return buffer.Array();
+}
+
+// Write a constant's ROS serialization.  Compact and CDR buffers have a
+// different layout so the message must be written normally.
+template <size_t N>
+inline absl::Status WriteROSConstant(ROSBuffer &buffer,
+                                     const std::array<char, N> &data) {
+  if (!buffer.HasFixedLayout()) {
+    return absl::InvalidArgumentError(
+        "A constant message can only be written to a fixed layout ROS buffer");
+  }
+  return buffer.WriteBytes(data.data(), data.size());
+}
+
+} // namespace sato
@@ -11,6 +11,7 @@
 #include "absl/status/statusor.h"
 #include "sato/runtime/protobuf.h"
 #include "sato/runtime/ros.h"
+#include <array>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string>
@@ -23,45 +24,57 @@ template <typename T> constexpr size_t AlignedOffset(size_t offset) {
   return (offset + sizeof(T) - 1) & ~(sizeof(T) - 1);
 }
 
-class Field {
+// Base for all fields.  The field number is a template parameter and the
+// presence of a field is held in its message's PresenceBits, so a field
+// holds nothing but its value.
+template <int FieldNumber> class Field {
 public:
-  Field() = default;
-  Field(int number) : number_(number) {}
-  virtual ~Field() = default;
-
-  int Number() const { return number_; }
-  bool IsPresent() const { return present_; }
+  static constexpr int kNumber = FieldNumber;
+  static constexpr int Number() { return FieldNumber; }
+};
 
-  void SetNumber(int number) { number_ = number; }
+// Presence of the fields of a message, one bit per field.
+template <size_t N> class PresenceBits {
+public:
+  bool IsPresent(size_t bit) const {
+    return (words_[bit / 64] & (uint64_t(1) << (bit % 64))) != 0;
+  }
+  void Set(size_t bit) { words_[bit / 64] |= uint64_t(1) << (bit % 64); }
+  void Clear(size_t bit) { words_[bit / 64] &= ~(uint64_t(1) << (bit % 64)); }
+
+  bool Any() const {
+    for (uint64_t word : words_) {
+      if (word != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
 
-protected:
-  int number_ = 0;
-  bool present_ = false;
+private:
+  std::array<uint64_t, (N + 63) / 64> words_ = {};
 };
 
 #define DEFINE_PRIMITIVE_FIELD(cname, type)                                    \
-  template <bool FixedSize = false, bool Signed = false>                       \
-  class cname##Field : public Field {                                          \
+  template <int FieldNumber, bool FixedSize = false, bool Signed = false>      \
+  class cname##Field : public Field<FieldNumber> {                             \
   public:                                                                      \
-    cname##Field() = default;                                                  \
-    explicit cname##Field(int number) : Field(number) {}                       \
-                                                                               \
     size_t SerializedProtoSize() const {                                       \
       if constexpr (FixedSize) {                                               \
-        return ProtoBuffer::TagSize(Number(),                                  \
-                                    ProtoBuffer::FixedWireType<type>()) +      \
+        return ProtoBuffer::TagSize<FieldNumber,                               \
+                                    ProtoBuffer::FixedWireType<type>()>() +    \
                sizeof(type);                                                   \
       } else {                                                                 \
-        return ProtoBuffer::TagSize(Number(), WireType::kVarint) +             \
+        return ProtoBuffer::TagSize<FieldNumber, WireType::kVarint>() +        \
                ProtoBuffer::VarintSize<type, Signed>(value_);                  \
       }                                                                        \
     }                                                                          \
                                                                                \
     absl::Status WriteProto(ProtoBuffer &buffer) const {                       \
       if constexpr (FixedSize) {                                               \
-        return buffer.SerializeFixed<type>(Number(), value_);                  \
+        return buffer.SerializeFixed<FieldNumber, type>(value_);               \
       } else {                                                                 \
-        return buffer.SerializeVarint<type, Signed>(Number(), value_);         \
+        return buffer.SerializeVarint<FieldNumber, type, Signed>(value_);      \
       }                                                                        \
     }                                                                          \
     absl::Status WriteROS(ROSBuffer &buffer) const { return Write(buffer, value_); } \
@@ -77,17 +90,21 @@ protected:
         return v.status();                                                     \
       }                                                                        \
       value_ = *v;                                                             \
-      present_ = true;                                                         \
-      return absl::OkStatus();                                                 \
-    }                                                                          \
-    absl::Status ParseROS(ROSBuffer &buffer) {                                 \
-      if (absl::Status status = Read(buffer, value_); !status.ok()) {          \
-        return status;                                                         \
-      }                                                                        \
-      present_ = value_ != 0;                                                  \
       return absl::OkStatus();                                                 \
     }                                                                          \
+    absl::Status ParseROS(ROSBuffer &buffer) { return Read(buffer, value_); }  \
+    /* ROS has no presence so a field is present if it's not zero. */          \
+    bool HasValue() const { return value_ != 0; }                              \
     size_t SerializedROSSize() const { return sizeof(type); }                  \
+    static absl::Status SkipROS(ROSBuffer &buffer) {                           \
+      return SkipValues<type>(buffer);                                         \
+    }                                                                          \
+    /* Used by messages with a fixed ROS layout. */                            \
+    void WriteROSFixed(char *addr) const { memcpy(addr, &value_, sizeof(type)); } \
+    void ParseROSFixed(const char *addr) { memcpy(&value_, addr, sizeof(type)); } \
+                                                                               \
+    type Value() const { return value_; }                                      \
+    void Set(type v) { value_ = v; }                                           \
                                                                                \
   private:                                                                     \
     type value_ = {};                                                          \
@@ -104,21 +121,17 @@ DEFINE_PRIMITIVE_FIELD(Bool, bool)
 #undef DEFINE_PRIMITIVE_FIELD
 
 // String field with an offset inline in the message.
-class StringField : public Field {
+template <int FieldNumber> class StringField : public Field<FieldNumber> {
 public:
-  StringField() = default;
-  explicit StringField(int number) : Field(number) {}
-
   size_t SerializedProtoSize() const {
     size_t s = value_.size();
-    return ProtoBuffer::LengthDelimitedSize(Number(), s);
+    return ProtoBuffer::LengthDelimitedSize<FieldNumber>(s);
   }
   size_t SerializedROSSize() const { return 4 + value_.size(); }
 
   absl::Status WriteProto(ProtoBuffer &buffer) const {
     size_t s = value_.size();
-    return buffer.ProtoBuffer::SerializeLengthDelimited(Number(), value_.data(),
-                                                        s);
+    return buffer.SerializeLengthDelimited<FieldNumber>(value_.data(), s);
   }
   absl::Status WriteROS(ROSBuffer &buffer) const { return Write(buffer, value_); }
 
@@ -128,32 +141,53 @@ public:
       return s.status();
     }
     value_ = *s;
-    present_ = true;
     return absl::OkStatus();
   }
 
-  absl::Status ParseROS(ROSBuffer &buffer) { 
-    if (absl::Status status = Read(buffer, value_); !status.ok()) {
+  absl::Status ParseROS(ROSBuffer &buffer) { return Read(buffer, value_); }
+
+  bool HasValue() const { return !value_.empty(); }
+
+  std::string_view Value() const { return value_; }
+  // The string is not copied so it must outlive the message.
+  void Set(std::string_view v) { value_ = v; }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    uint32_t size = 0;
+    if (absl::Status status = Read(buffer, size); !status.ok()) {
       return status;
     }
-    present_ = value_.size() > 0;
-    return absl::OkStatus();
+    return buffer.Skip(size);
   }
 
-  std::string_view Value() const { return value_; }
-
 private:
   std::string_view value_ = {}; // No copy made for this.
 };
 
-template <typename MessageType> class MessageField : public Field {
+// A bytes field with (sato.ros_type) = "uint8[]".  In ROS 1 a uint8[] is
+// the same as a string, but in CDR there is no trailing NUL.
+template <int FieldNumber> class BytesField : public StringField<FieldNumber> {
 public:
-  MessageField() = default;
-  explicit MessageField(int number) : Field(number) {}
+  absl::Status WriteROS(ROSBuffer &buffer) const {
+    return WriteByteArray(buffer, this->Value());
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) {
+    std::string_view v;
+    if (absl::Status status = ReadByteArray(buffer, v); !status.ok()) {
+      return status;
+    }
+    this->Set(v);
+    return absl::OkStatus();
+  }
+};
 
+template <int FieldNumber, typename MessageType>
+class MessageField : public Field<FieldNumber> {
+public:
   size_t SerializedProtoSize() const {
-    return ProtoBuffer::LengthDelimitedSize(Number(),
-                                            msg_.SerializedProtoSize());
+    return ProtoBuffer::LengthDelimitedSize<FieldNumber>(
+        msg_.SerializedProtoSize());
   }
 
   size_t SerializedROSSize() const { return msg_.SerializedROSSize(); }
@@ -161,7 +195,7 @@ public:
   absl::Status WriteProto(ProtoBuffer &buffer) const {
     size_t size = msg_.SerializedProtoSize();
     if (absl::Status status =
-            buffer.SerializeLengthDelimitedHeader(Number(), size);
+            buffer.SerializeLengthDelimitedHeader<FieldNumber>(size);
         !status.ok()) {
       return status;
     }
@@ -180,14 +214,23 @@ public:
     return msg_.ParseProto(sub_buffer);
   }
 
-  absl::Status ParseROS(ROSBuffer &buffer) { 
-    if (absl::Status status = msg_.ParseROS(buffer); !status.ok()) {
-      return status;
-    }
-    present_ = true;
-    return absl::OkStatus();
+  absl::Status ParseROS(ROSBuffer &buffer) { return msg_.ParseROS(buffer); }
+
+  // Only for messages with a fixed ROS layout.
+  void WriteROSFixed(char *addr) const { msg_.WriteROSFixed(addr); }
+  void ParseROSFixed(const char *addr) { msg_.ParseROSFixed(addr); }
+  absl::Status CheckROSFixed() const { return msg_.CheckROSFixed(); }
+
+  // A nested message is present if any of its fields are.
+  bool HasValue() const { return msg_.IsPresent(); }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    return MessageType::SkipROS(buffer);
   }
 
+  const MessageType &Get() const { return msg_; }
+  MessageType *Mutable() { return &msg_; }
+
 protected:
   MessageType msg_;
 };
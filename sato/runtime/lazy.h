@@ -0,0 +1,225 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Lazy message fields, generated for message fields with [lazy = true].
+//
+// When parsed from protobuf, a lazy field only records the bytes of the
+// nested message.  They are decoded on first access or when the field is
+// written to ROS.  If the message is written back to protobuf without being
+// decoded, the bytes are copied through verbatim, so passing a large nested
+// message through is almost free.  Like strings, the bytes are not copied so
+// the protobuf buffer must outlive the message.
+//
+// If the bytes fail to decode they stay pending, so they are still copied
+// through to protobuf, and the error is returned by every later Decode and
+// WriteROS.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sato/runtime/fields.h"
+#include "sato/runtime/protobuf.h"
+#include "sato/runtime/ros.h"
+#include "sato/runtime/vectors.h"
+#include <vector>
+
+namespace sato {
+
+template <int FieldNumber, typename MessageType>
+class LazyMessageField : public Field<FieldNumber> {
+public:
+  size_t SerializedProtoSize() const {
+    if (pending_) {
+      return ProtoBuffer::LengthDelimitedSize<FieldNumber>(bytes_.size());
+    }
+    return ProtoBuffer::LengthDelimitedSize<FieldNumber>(
+        msg_.SerializedProtoSize());
+  }
+
+  size_t SerializedROSSize() const {
+    (void)Decode();
+    return msg_.SerializedROSSize();
+  }
+
+  absl::Status WriteProto(ProtoBuffer &buffer) const {
+    if (pending_) {
+      return buffer.SerializeLengthDelimited<FieldNumber>(bytes_.data(),
+                                                         bytes_.size());
+    }
+    if (absl::Status status = buffer.SerializeLengthDelimitedHeader<FieldNumber>(
+            msg_.SerializedProtoSize());
+        !status.ok()) {
+      return status;
+    }
+    return msg_.WriteProto(buffer);
+  }
+
+  absl::Status WriteROS(ROSBuffer &buffer) const {
+    if (absl::Status status = Decode(); !status.ok()) {
+      return status;
+    }
+    return msg_.WriteROS(buffer);
+  }
+
+  absl::Status ParseProto(ProtoBuffer &buffer) {
+    absl::StatusOr<absl::Span<char>> s = buffer.DeserializeLengthDelimited();
+    if (!s.ok()) {
+      return s.status();
+    }
+    if (pending_ || msg_.IsPopulated()) {
+      // Repeated occurrence, same as a MessageField.
+      if (absl::Status status = Decode(); !status.ok()) {
+        return status;
+      }
+      ProtoBuffer sub_buffer(*s);
+      return msg_.ParseProto(sub_buffer);
+    }
+    bytes_ = *s;
+    pending_ = true;
+    return absl::OkStatus();
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) { return msg_.ParseROS(buffer); }
+
+  bool HasValue() const {
+    return pending_ ? !bytes_.empty() : msg_.IsPresent();
+  }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    return MessageType::SkipROS(buffer);
+  }
+
+  // True if the nested message has not been decoded yet.
+  bool IsPending() const { return pending_; }
+
+  // Decode the nested message if it is still pending.
+  absl::Status Decode() const {
+    if (!pending_ || !decode_status_.ok()) {
+      return decode_status_;
+    }
+    ProtoBuffer sub_buffer(bytes_);
+    decode_status_ = msg_.ParseProto(sub_buffer);
+    pending_ = !decode_status_.ok();
+    return decode_status_;
+  }
+
+  // Access the nested message, decoding it if necessary.
+  const MessageType &Get() const {
+    (void)Decode();
+    return msg_;
+  }
+
+  MessageType *Mutable() {
+    (void)Decode();
+    return &msg_;
+  }
+
+private:
+  mutable MessageType msg_;
+  absl::Span<char> bytes_;
+  mutable bool pending_ = false;
+  mutable absl::Status decode_status_;
+};
+
+template <int FieldNumber, typename T>
+class LazyMessageVectorField : public Field<FieldNumber> {
+public:
+  size_t SerializedProtoSize() const {
+    if (pending_.empty()) {
+      return msgs_.SerializedProtoSize();
+    }
+    size_t length = 0;
+    for (absl::Span<char> bytes : pending_) {
+      length += ProtoBuffer::LengthDelimitedSize<FieldNumber>(bytes.size());
+    }
+    return length;
+  }
+
+  size_t SerializedROSSize() const {
+    (void)Decode();
+    return msgs_.SerializedROSSize();
+  }
+
+  absl::Status WriteProto(ProtoBuffer &buffer) const {
+    if (pending_.empty()) {
+      return msgs_.WriteProto(buffer);
+    }
+    for (absl::Span<char> bytes : pending_) {
+      if (absl::Status status = buffer.SerializeLengthDelimited<FieldNumber>(
+              bytes.data(), bytes.size());
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteROS(ROSBuffer &buffer) const {
+    if (absl::Status status = Decode(); !status.ok()) {
+      return status;
+    }
+    return msgs_.WriteROS(buffer);
+  }
+
+  absl::Status ParseProto(ProtoBuffer &buffer) {
+    if (pending_.empty()) {
+      pending_.reserve(buffer.CountFields(kTag));
+    }
+    absl::StatusOr<absl::Span<char>> s = buffer.DeserializeLengthDelimited();
+    if (!s.ok()) {
+      return s.status();
+    }
+    pending_.push_back(*s);
+    return absl::OkStatus();
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) { return msgs_.ParseROS(buffer); }
+
+  bool HasValue() const { return !pending_.empty() || msgs_.HasValue(); }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    return MessageVectorField<FieldNumber, T>::SkipROS(buffer);
+  }
+
+  bool IsPending() const { return !pending_.empty(); }
+
+  // Decode all the pending elements.
+  absl::Status Decode() const {
+    if (pending_.empty() || !decode_status_.ok()) {
+      return decode_status_;
+    }
+    msgs_.Reserve(pending_.size());
+    for (absl::Span<char> bytes : pending_) {
+      if (decode_status_ = msgs_.ParseProtoElement(bytes);
+          !decode_status_.ok()) {
+        return decode_status_;
+      }
+    }
+    pending_.clear();
+    return absl::OkStatus();
+  }
+
+  const MessageVectorField<FieldNumber, T> &Get() const {
+    (void)Decode();
+    return msgs_;
+  }
+
+  MessageVectorField<FieldNumber, T> *Mutable() {
+    (void)Decode();
+    return &msgs_;
+  }
+
+private:
+  static constexpr uint32_t kTag =
+      (FieldNumber << ProtoBuffer::kFieldIdShift) |
+      uint32_t(WireType::kLengthDelimited);
+
+  mutable MessageVectorField<FieldNumber, T> msgs_;
+  mutable std::vector<absl::Span<char>> pending_;
+  mutable absl::Status decode_status_;
+};
+
+} // namespace sato
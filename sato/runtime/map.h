@@ -0,0 +1,327 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Map fields.
+//
+// A protobuf map<K, V> is a repeated field of entry messages, each with the
+// key as field 1 and the value as field 2.  Rather than parsing each entry
+// as a nested message, a MapField decodes the entries directly into
+// parallel arrays of keys and values.  In ROS format the map is an array of
+// entries (key followed by value), which matches the generated .msg file
+// for the entry message.
+//
+// The keys and values are encoded by codec structs that know how to handle
+// a single value of a type in both formats.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sato/runtime/fields.h"
+#include "sato/runtime/protobuf.h"
+#include "sato/runtime/ros.h"
+#include "sato/runtime/vectors.h"
+#include <algorithm>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+namespace sato {
+
+template <typename T, bool FixedSize = false, bool Signed = false>
+struct PrimitiveCodec {
+  using Type = T;
+  static constexpr bool kPackable = true;
+  static constexpr bool kFixedSize = FixedSize;
+  static constexpr bool kSigned = Signed;
+
+  template <int Number> static size_t ProtoSize(T v) {
+    if constexpr (FixedSize) {
+      return ProtoBuffer::TagSize<Number, ProtoBuffer::FixedWireType<T>()>() +
+             sizeof(T);
+    } else {
+      return ProtoBuffer::TagSize<Number, WireType::kVarint>() +
+             ProtoBuffer::VarintSize<T, Signed>(v);
+    }
+  }
+
+  template <int Number> static absl::Status WriteProto(ProtoBuffer &buffer, T v) {
+    if constexpr (FixedSize) {
+      return buffer.SerializeFixed<Number, T>(v);
+    } else {
+      return buffer.SerializeVarint<Number, T, Signed>(v);
+    }
+  }
+
+  static absl::Status ParseProto(ProtoBuffer &buffer, T &v) {
+    absl::StatusOr<T> value;
+    if constexpr (FixedSize) {
+      value = buffer.DeserializeFixed<T>();
+    } else {
+      value = buffer.DeserializeVarint<T, Signed>();
+    }
+    if (!value.ok()) {
+      return value.status();
+    }
+    v = *value;
+    return absl::OkStatus();
+  }
+
+  static size_t ROSSize(T) { return sizeof(T); }
+  static absl::Status WriteROS(ROSBuffer &buffer, T v) {
+    return Write(buffer, v);
+  }
+  static absl::Status ParseROS(ROSBuffer &buffer, T &v) {
+    return Read(buffer, v);
+  }
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    return SkipValues<T>(buffer);
+  }
+};
+
+// Strings and bytes.  No copy is made.
+struct StringCodec {
+  using Type = std::string_view;
+
+  template <int Number> static size_t ProtoSize(std::string_view v) {
+    return ProtoBuffer::LengthDelimitedSize<Number>(v.size());
+  }
+
+  template <int Number>
+  static absl::Status WriteProto(ProtoBuffer &buffer, std::string_view v) {
+    return buffer.SerializeLengthDelimited<Number>(v.data(), v.size());
+  }
+
+  static absl::Status ParseProto(ProtoBuffer &buffer, std::string_view &v) {
+    absl::StatusOr<std::string_view> value = buffer.DeserializeString();
+    if (!value.ok()) {
+      return value.status();
+    }
+    v = *value;
+    return absl::OkStatus();
+  }
+
+  static size_t ROSSize(std::string_view v) { return 4 + v.size(); }
+  static absl::Status WriteROS(ROSBuffer &buffer, std::string_view v) {
+    return Write(buffer, v);
+  }
+  static absl::Status ParseROS(ROSBuffer &buffer, std::string_view &v) {
+    return Read(buffer, v);
+  }
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    uint32_t size = 0;
+    if (absl::Status status = Read(buffer, size); !status.ok()) {
+      return status;
+    }
+    return buffer.Skip(size);
+  }
+};
+
+// Message values.
+template <typename MessageType> struct MessageCodec {
+  using Type = MessageType;
+
+  template <int Number> static size_t ProtoSize(const MessageType &v) {
+    return ProtoBuffer::LengthDelimitedSize<Number>(v.SerializedProtoSize());
+  }
+
+  template <int Number>
+  static absl::Status WriteProto(ProtoBuffer &buffer, const MessageType &v) {
+    if (absl::Status status = buffer.SerializeLengthDelimitedHeader<Number>(
+            v.SerializedProtoSize());
+        !status.ok()) {
+      return status;
+    }
+    return v.WriteProto(buffer);
+  }
+
+  static absl::Status ParseProto(ProtoBuffer &buffer, MessageType &v) {
+    absl::StatusOr<absl::Span<char>> s = buffer.DeserializeLengthDelimited();
+    if (!s.ok()) {
+      return s.status();
+    }
+    ProtoBuffer sub_buffer(*s);
+    return v.ParseProto(sub_buffer);
+  }
+
+  static size_t ROSSize(const MessageType &v) { return v.SerializedROSSize(); }
+  static absl::Status WriteROS(ROSBuffer &buffer, const MessageType &v) {
+    return v.WriteROS(buffer);
+  }
+  static absl::Status ParseROS(ROSBuffer &buffer, MessageType &v) {
+    return v.ParseROS(buffer);
+  }
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    return MessageType::SkipROS(buffer);
+  }
+};
+
+template <int FieldNumber, typename KeyCodec, typename ValueCodec>
+class MapField : public Field<FieldNumber> {
+public:
+  using Key = typename KeyCodec::Type;
+  using Value = typename ValueCodec::Type;
+
+  size_t size() const { return keys_.size(); }
+  const Key &GetKey(size_t i) const { return keys_[i]; }
+  const Value &GetValue(size_t i) const { return values_[i]; }
+
+  // Add an entry with a default value and return the value.
+  Value *Add(Key key) {
+    keys_.push_back(key);
+    return &values_.emplace_back();
+  }
+
+  size_t SerializedProtoSize() const {
+    size_t length = 0;
+    for (size_t i = 0; i < keys_.size(); i++) {
+      length += ProtoBuffer::LengthDelimitedSize<FieldNumber>(EntrySize(i));
+    }
+    return length;
+  }
+
+  size_t SerializedROSSize() const {
+    size_t length = 4;
+    for (size_t i = 0; i < keys_.size(); i++) {
+      length += KeyCodec::ROSSize(keys_[i]) + ValueCodec::ROSSize(values_[i]);
+    }
+    return length;
+  }
+
+  // Both the key and value are always written, as protobuf does.
+  absl::Status WriteProto(ProtoBuffer &buffer) const {
+    for (size_t i = 0; i < keys_.size(); i++) {
+      if (absl::Status status =
+              buffer.SerializeLengthDelimitedHeader<FieldNumber>(EntrySize(i));
+          !status.ok()) {
+        return status;
+      }
+      if (absl::Status status =
+              KeyCodec::template WriteProto<1>(buffer, keys_[i]);
+          !status.ok()) {
+        return status;
+      }
+      if (absl::Status status =
+              ValueCodec::template WriteProto<2>(buffer, values_[i]);
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteROS(ROSBuffer &buffer) const {
+    if (absl::Status status = Write(buffer, static_cast<uint32_t>(keys_.size()));
+        !status.ok()) {
+      return status;
+    }
+    for (size_t i = 0; i < keys_.size(); i++) {
+      if (absl::Status status = KeyCodec::WriteROS(buffer, keys_[i]);
+          !status.ok()) {
+        return status;
+      }
+      if (absl::Status status = ValueCodec::WriteROS(buffer, values_[i]);
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  // Parse one entry.  Missing keys or values are the default.  Duplicate
+  // keys are kept in the arrays; when written back to protobuf the last one
+  // wins, as it does in protobuf.
+  absl::Status ParseProto(ProtoBuffer &buffer) {
+    if (keys_.empty()) {
+      size_t n = buffer.CountFields(kTag);
+      keys_.reserve(n);
+      values_.reserve(n);
+    }
+    absl::StatusOr<absl::Span<char>> entry = buffer.DeserializeLengthDelimited();
+    if (!entry.ok()) {
+      return entry.status();
+    }
+    Key &key = keys_.emplace_back();
+    Value &value = values_.emplace_back();
+    ProtoBuffer entry_buffer(*entry);
+    while (!entry_buffer.Eof()) {
+      absl::StatusOr<uint32_t> tag = entry_buffer.DeserializeTag();
+      if (!tag.ok()) {
+        return tag.status();
+      }
+      absl::Status status;
+      switch (*tag >> ProtoBuffer::kFieldIdShift) {
+      case 1:
+        status = KeyCodec::ParseProto(entry_buffer, key);
+        break;
+      case 2:
+        status = ValueCodec::ParseProto(entry_buffer, value);
+        break;
+      default:
+        status = entry_buffer.SkipTag(*tag);
+        break;
+      }
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) {
+    uint32_t num_entries = 0;
+    if (absl::Status status = Read(buffer, num_entries); !status.ok()) {
+      return status;
+    }
+    size_t reserve = std::min(size_t(num_entries), kMaxROSReserve);
+    keys_.reserve(keys_.size() + reserve);
+    values_.reserve(values_.size() + reserve);
+    for (uint32_t i = 0; i < num_entries; i++) {
+      if (absl::Status status =
+              KeyCodec::ParseROS(buffer, keys_.emplace_back());
+          !status.ok()) {
+        return status;
+      }
+      if (absl::Status status =
+              ValueCodec::ParseROS(buffer, values_.emplace_back());
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  bool HasValue() const { return !keys_.empty(); }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    uint32_t num_entries = 0;
+    if (absl::Status status = Read(buffer, num_entries); !status.ok()) {
+      return status;
+    }
+    for (uint32_t i = 0; i < num_entries; i++) {
+      if (absl::Status status = KeyCodec::SkipROS(buffer); !status.ok()) {
+        return status;
+      }
+      if (absl::Status status = ValueCodec::SkipROS(buffer); !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+private:
+  static constexpr uint32_t kTag =
+      (FieldNumber << ProtoBuffer::kFieldIdShift) |
+      uint32_t(WireType::kLengthDelimited);
+
+  size_t EntrySize(size_t i) const {
+    return KeyCodec::template ProtoSize<1>(keys_[i]) +
+           ValueCodec::template ProtoSize<2>(values_[i]);
+  }
+
+  std::vector<Key> keys_;
+  std::vector<Value> values_;
+};
+
+} // namespace sato
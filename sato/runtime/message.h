@@ -8,14 +8,64 @@
 #include "absl/status/statusor.h"
 #include "sato/runtime/protobuf.h"
 #include "sato/runtime/ros.h"
+#include <algorithm>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+#include <vector>
 namespace sato {
 
+// The set of fields of a message to convert, by field number.  Other fields
+// are skipped when parsing protobuf, so they have default values in ROS, and
+// are omitted when writing protobuf.  The ROS layout doesn't change so the
+// message definition is the same.  A projection applies to the fields of the
+// message it is set on, not to nested messages.
+class Projection {
+public:
+  Projection(std::initializer_list<int> field_numbers)
+      : fields_(field_numbers) {
+    std::sort(fields_.begin(), fields_.end());
+  }
+  explicit Projection(std::vector<int> field_numbers)
+      : fields_(std::move(field_numbers)) {
+    std::sort(fields_.begin(), fields_.end());
+  }
+
+  bool Contains(int field_number) const {
+    return std::binary_search(fields_.begin(), fields_.end(), field_number);
+  }
+
+private:
+  std::vector<int> fields_;
+};
+
+// Generated messages whose ROS layout is completely fixed (only scalar fields
+// and other fixed messages) have a constexpr kFixedROSSize and
+// WriteROSFixed/ParseROSFixed functions that read and write the whole
+// message with straight-line code after a single bounds check.  The size
+// assumes each std_msgs/Header has an empty frame_id, as sato writes them;
+// HasFixedROSHeaders checks that before the fixed layout is used to parse.
+template <typename T, typename = void>
+struct HasFixedROSSize : std::false_type {};
+
+template <typename T>
+struct HasFixedROSSize<T, std::void_t<decltype(T::kFixedROSSize)>>
+    : std::true_type {};
+
 class Message {
 public:
   virtual ~Message() = default;
   bool IsPopulated() const { return populated_; }
   void SetPopulated(bool populated) { populated_ = populated; }
 
+  // Convert only the fields in the projection.  The projection is not owned
+  // and must outlive the parse.  nullptr (the default) converts all fields.
+  void SetProjection(const Projection *projection) { projection_ = projection; }
+  const Projection *GetProjection() const { return projection_; }
+  bool IsProjected(int field_number) const {
+    return projection_ == nullptr || projection_->Contains(field_number);
+  }
+
   virtual std::string GetName() const = 0;
   virtual std::string GetFullName() const = 0;
 
@@ -24,6 +74,12 @@ public:
   virtual absl::Status WriteProto(ProtoBuffer &buffer) const = 0;
   virtual absl::Status WriteROS(ROSBuffer &buffer, uint64_t timestamp = 0) const = 0;
   virtual absl::Status ParseProto(ProtoBuffer &buffer) = 0;
+  // Parse a single field whose tag has already been read from the buffer.
+  // The buffer is positioned at the start of the field's value.
+  virtual absl::Status ParseProtoField(uint32_t tag, ProtoBuffer &buffer) = 0;
+  // Is the field number one that ParseProtoField parses?  A message that
+  // doesn't say must be given every field.
+  virtual bool HasProtoField(int field_number) const { return true; }
   virtual absl::Status ParseROS(ROSBuffer &buffer) = 0;
 
   absl::Status ProtoToROS(ProtoBuffer &proto_buffer, ROSBuffer &ros_buffer, uint64_t timestamp = 0) {
@@ -33,7 +89,7 @@ public:
     if (absl::Status status = WriteROS(ros_buffer, timestamp); !status.ok()) {
       return status;
     }
-    return absl::OkStatus();
+    return ros_buffer.Flush();
   }
   absl::Status ROSToProto(ROSBuffer &ros_buffer, ProtoBuffer &proto_buffer) {
     if (absl::Status status = ParseROS(ros_buffer); !status.ok()) {
@@ -42,10 +98,106 @@ public:
     if (absl::Status status = WriteProto(proto_buffer); !status.ok()) {
       return status;
     }
-    return absl::OkStatus();
+    return proto_buffer.Flush();
   }
 
 private:
   bool populated_ = false;
+  const Projection *projection_ = nullptr;
 };
+
+// Compile-time access to a generated message type.  The calls are qualified
+// with the concrete type so they don't go through the vtable and nested
+// calls can be inlined.  The virtual interface in Message is for
+// type-erased use (the multiplexer).
+template <typename T> struct MessageTraits {
+  static_assert(std::is_base_of_v<Message, T>,
+                "MessageTraits requires a generated message type");
+
+  static constexpr bool kHasFixedROSSize = HasFixedROSSize<T>::value;
+
+  static std::string FullName() { return T::FullName(); }
+
+  static size_t SerializedProtoSize(const T &msg) {
+    return msg.T::SerializedProtoSize();
+  }
+  static size_t SerializedROSSize(const T &msg) {
+    return msg.T::SerializedROSSize();
+  }
+  static absl::Status ParseProto(T &msg, ProtoBuffer &buffer) {
+    return msg.T::ParseProto(buffer);
+  }
+  static absl::Status ParseROS(T &msg, ROSBuffer &buffer) {
+    return msg.T::ParseROS(buffer);
+  }
+  static absl::Status WriteProto(const T &msg, ProtoBuffer &buffer) {
+    return msg.T::WriteProto(buffer);
+  }
+  static absl::Status WriteROS(const T &msg, ROSBuffer &buffer,
+                               uint64_t timestamp = 0) {
+    return msg.T::WriteROS(buffer, timestamp);
+  }
+};
+
+// Convert a message whose type is known at compile time from protobuf to
+// ROS.
+template <typename T>
+absl::Status Convert(ProtoBuffer &proto_buffer, ROSBuffer &ros_buffer,
+                     uint64_t timestamp = 0) {
+  T msg;
+  if (absl::Status status = MessageTraits<T>::ParseProto(msg, proto_buffer);
+      !status.ok()) {
+    return status;
+  }
+  if (absl::Status status =
+          MessageTraits<T>::WriteROS(msg, ros_buffer, timestamp);
+      !status.ok()) {
+    return status;
+  }
+  return ros_buffer.Flush();
+}
+
+// Write a libprotobuf message object directly to ROS, without serializing
+// it to protobuf first.
+template <typename T, typename Proto>
+absl::Status ProtoObjectToROS(const Proto &pb, ROSBuffer &ros_buffer,
+                              uint64_t timestamp = 0) {
+  T msg;
+  if (absl::Status status = msg.FromProtoObject(pb); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status =
+          MessageTraits<T>::WriteROS(msg, ros_buffer, timestamp);
+      !status.ok()) {
+    return status;
+  }
+  return ros_buffer.Flush();
+}
+
+// Fill in a libprotobuf message object directly from ROS.
+template <typename T, typename Proto>
+absl::Status ROSToProtoObject(ROSBuffer &ros_buffer, Proto *pb) {
+  T msg;
+  if (absl::Status status = MessageTraits<T>::ParseROS(msg, ros_buffer);
+      !status.ok()) {
+    return status;
+  }
+  return msg.ToProtoObject(pb);
+}
+
+// Convert a message whose type is known at compile time from ROS to
+// protobuf.
+template <typename T>
+absl::Status Convert(ROSBuffer &ros_buffer, ProtoBuffer &proto_buffer) {
+  T msg;
+  if (absl::Status status = MessageTraits<T>::ParseROS(msg, ros_buffer);
+      !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = MessageTraits<T>::WriteProto(msg, proto_buffer);
+      !status.ok()) {
+    return status;
+  }
+  return proto_buffer.Flush();
+}
 }
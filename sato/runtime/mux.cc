@@ -25,7 +25,10 @@ void MultiplexerRegisterMessage(const std::string &name, const MultiplexerInfo &
     sato_multiplexers =
         std::make_unique<absl::flat_hash_map<std::string, MultiplexerInfo>>();
   }
-  (*sato_multiplexers)[name] = info;
+  MultiplexerInfo &registered = (*sato_multiplexers)[name];
+  registered = info;
+  registered.proto_size_estimate = std::make_shared<SizeEstimate>();
+  registered.ros_size_estimate = std::make_shared<SizeEstimate>();
 }
 
 std::unique_ptr<Message> MultiplexerCreateMessage(const std::string &message_type) {
@@ -57,7 +60,12 @@ absl::Status MultiplexerWriteProto(const std::string &message_type, const Messag
   if (!multiplexer_info.ok()) {
     return multiplexer_info.status();
   }
-  return (*multiplexer_info)->write_proto(msg, buffer);
+  size_t start = buffer.TotalSize();
+  absl::Status status = (*multiplexer_info)->write_proto(msg, buffer);
+  if (status.ok()) {
+    (*multiplexer_info)->proto_size_estimate->Record(buffer.TotalSize() - start);
+  }
+  return status;
 }
 
 absl::Status MultiplexerWriteROS(const std::string &message_type, const Message &msg, ROSBuffer &buffer) {
@@ -65,7 +73,12 @@ absl::Status MultiplexerWriteROS(const std::string &message_type, const Message
   if (!multiplexer_info.ok()) {
     return multiplexer_info.status();
   }
-  return (*multiplexer_info)->write_ros(msg, buffer);
+  size_t start = buffer.TotalSize();
+  absl::Status status = (*multiplexer_info)->write_ros(msg, buffer);
+  if (status.ok()) {
+    (*multiplexer_info)->ros_size_estimate->Record(buffer.TotalSize() - start);
+  }
+  return status;
 }
 
 absl::StatusOr<size_t> MultiplexerSerializedProtoSize(const std::string &message_type, const Message &msg) {
@@ -83,4 +96,44 @@ absl::StatusOr<size_t> MultiplexerSerializedROSSize(const std::string &message_t
   }
   return (*multiplexer_info)->serialized_ros_size(msg);
 }
+
+absl::StatusOr<size_t> MultiplexerEstimatedProtoSize(const std::string &message_type) {
+  absl::StatusOr<MultiplexerInfo *> multiplexer_info = GetMultiplexerInfo(message_type);
+  if (!multiplexer_info.ok()) {
+    return multiplexer_info.status();
+  }
+  return (*multiplexer_info)->proto_size_estimate->Get();
+}
+
+absl::StatusOr<size_t> MultiplexerEstimatedROSSize(const std::string &message_type) {
+  absl::StatusOr<MultiplexerInfo *> multiplexer_info = GetMultiplexerInfo(message_type);
+  if (!multiplexer_info.ok()) {
+    return multiplexer_info.status();
+  }
+  return (*multiplexer_info)->ros_size_estimate->Get();
+}
+
+absl::StatusOr<std::string_view> MultiplexerROSDataType(const std::string &message_type) {
+  absl::StatusOr<MultiplexerInfo *> multiplexer_info = GetMultiplexerInfo(message_type);
+  if (!multiplexer_info.ok()) {
+    return multiplexer_info.status();
+  }
+  return (*multiplexer_info)->ros_datatype;
+}
+
+absl::StatusOr<std::string_view> MultiplexerROSMd5Sum(const std::string &message_type) {
+  absl::StatusOr<MultiplexerInfo *> multiplexer_info = GetMultiplexerInfo(message_type);
+  if (!multiplexer_info.ok()) {
+    return multiplexer_info.status();
+  }
+  return (*multiplexer_info)->ros_md5sum;
+}
+
+absl::StatusOr<std::string_view> MultiplexerROSDefinition(const std::string &message_type) {
+  absl::StatusOr<MultiplexerInfo *> multiplexer_info = GetMultiplexerInfo(message_type);
+  if (!multiplexer_info.ok()) {
+    return multiplexer_info.status();
+  }
+  return (*multiplexer_info)->ros_definition;
+}
 } // namespace sato
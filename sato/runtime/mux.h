@@ -8,9 +8,35 @@
 #include "sato/runtime/message.h"
 #include "sato/runtime/protobuf.h"
 #include "sato/runtime/ros.h"
+#include <atomic>
+#include <memory>
+#include <string_view>
 
 namespace sato {
 
+// Running estimate of the serialized size of a message type.  This is used
+// to size output buffers so that they don't need to grow.  The estimate
+// jumps up to a bigger size immediately and decays slowly when messages get
+// smaller.
+class SizeEstimate {
+public:
+  // Messages of a type can be written from many threads at once, so the
+  // update is a compare and swap.
+  void Record(size_t size) {
+    size_t estimate = estimate_.load(std::memory_order_relaxed);
+    size_t next;
+    do {
+      next = size >= estimate ? size : estimate - (estimate - size) / 16;
+    } while (!estimate_.compare_exchange_weak(estimate, next,
+                                              std::memory_order_relaxed));
+  }
+
+  size_t Get() const { return estimate_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<size_t> estimate_{0};
+};
+
 struct MultiplexerInfo {
   std::unique_ptr<Message> (*create_message)();
   absl::Status (*parse_proto)(Message &msg, ProtoBuffer &buffer);
@@ -19,6 +45,15 @@ struct MultiplexerInfo {
   absl::Status (*write_ros)(const Message &msg, ROSBuffer &buffer);
   size_t (*serialized_proto_size)(const Message &msg);
   size_t (*serialized_ros_size)(const Message &msg);
+
+  // ROS1 connection metadata, generated as constants.
+  std::string_view ros_datatype;
+  std::string_view ros_md5sum;
+  std::string_view ros_definition;
+
+  // Output size estimates, allocated when the message is registered.
+  std::shared_ptr<SizeEstimate> proto_size_estimate;
+  std::shared_ptr<SizeEstimate> ros_size_estimate;
 };
 
 extern std::unique_ptr<absl::flat_hash_map<std::string, MultiplexerInfo>>
@@ -36,4 +71,16 @@ absl::Status MultiplexerWriteROS(const std::string &message_type, const Message
 absl::StatusOr<size_t> MultiplexerSerializedProtoSize(const std::string &message_type, const Message &msg);
 absl::StatusOr<size_t> MultiplexerSerializedROSSize(const std::string &message_type, const Message &msg);
 
+// Estimated output sizes for a message type, based on the sizes written by
+// MultiplexerWriteProto and MultiplexerWriteROS.  These are zero until a
+// message of the type has been written.
+absl::StatusOr<size_t> MultiplexerEstimatedProtoSize(const std::string &message_type);
+absl::StatusOr<size_t> MultiplexerEstimatedROSSize(const std::string &message_type);
+
+// The ROS1 datatype, MD5 sum and full message definition for the connection
+// header of a message type.
+absl::StatusOr<std::string_view> MultiplexerROSDataType(const std::string &message_type);
+absl::StatusOr<std::string_view> MultiplexerROSMd5Sum(const std::string &message_type);
+absl::StatusOr<std::string_view> MultiplexerROSDefinition(const std::string &message_type);
+
 } // namespace sato
@@ -0,0 +1,123 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#include "sato/runtime/pool.h"
+#include <new>
+
+namespace sato {
+
+// Per-thread cache of free blocks.  When the thread exits the blocks go
+// back to the global free lists (or the system if they are full).
+struct BufferPool::ThreadCache {
+  ~ThreadCache() {
+    BufferPool &pool = BufferPool::Default();
+    for (int c = 0; c < kNumClasses; c++) {
+      for (int i = 0; i < counts[c]; i++) {
+        if (!pool.GlobalPush(c, blocks[c][i])) {
+          ::operator delete(blocks[c][i]);
+        }
+      }
+    }
+  }
+
+  void *blocks[kNumClasses][kThreadCacheSize];
+  int counts[kNumClasses] = {};
+};
+
+BufferPool &BufferPool::Default() {
+  // Never destroyed so that it outlives the thread caches.
+  static BufferPool *pool = new BufferPool();
+  return *pool;
+}
+
+BufferPool::ThreadCache &BufferPool::Cache() {
+  thread_local ThreadCache cache;
+  return cache;
+}
+
+int BufferPool::SizeClass(size_t n) {
+  int c = 0;
+  size_t size = size_t(1) << kMinClassShift;
+  while (size < n) {
+    size <<= 1;
+    c++;
+  }
+  return c;
+}
+
+void *BufferPool::GlobalPop(int size_class) {
+  for (auto &slot : global_[size_class]) {
+    if (slot.load(std::memory_order_relaxed) == nullptr) {
+      continue;
+    }
+    void *block = slot.exchange(nullptr, std::memory_order_acquire);
+    if (block != nullptr) {
+      return block;
+    }
+  }
+  return nullptr;
+}
+
+bool BufferPool::GlobalPush(int size_class, void *block) {
+  for (auto &slot : global_[size_class]) {
+    void *expected = nullptr;
+    if (slot.load(std::memory_order_relaxed) == nullptr &&
+        slot.compare_exchange_strong(expected, block,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void *BufferPool::SystemAllocate(size_t size) {
+  system_allocations_.fetch_add(1, std::memory_order_relaxed);
+  return ::operator new(size);
+}
+
+void *BufferPool::do_allocate(size_t bytes, size_t alignment) {
+  if (bytes > (size_t(1) << kMaxClassShift) ||
+      alignment > alignof(std::max_align_t)) {
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  int c = SizeClass(bytes);
+  ThreadCache &cache = Cache();
+  if (cache.counts[c] == 0) {
+    // Refill half the cache from the global free list.
+    while (cache.counts[c] < kThreadCacheSize / 2) {
+      void *block = GlobalPop(c);
+      if (block == nullptr) {
+        break;
+      }
+      cache.blocks[c][cache.counts[c]++] = block;
+    }
+    if (cache.counts[c] == 0) {
+      return SystemAllocate(size_t(1) << (c + kMinClassShift));
+    }
+  }
+  return cache.blocks[c][--cache.counts[c]];
+}
+
+void BufferPool::do_deallocate(void *p, size_t bytes, size_t alignment) {
+  if (bytes > (size_t(1) << kMaxClassShift) ||
+      alignment > alignof(std::max_align_t)) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    return;
+  }
+  int c = SizeClass(bytes);
+  ThreadCache &cache = Cache();
+  if (cache.counts[c] == kThreadCacheSize) {
+    // Spill half the cache to the global free list.
+    while (cache.counts[c] > kThreadCacheSize / 2) {
+      void *block = cache.blocks[c][--cache.counts[c]];
+      if (!GlobalPush(c, block)) {
+        ::operator delete(block);
+      }
+    }
+  }
+  cache.blocks[c][cache.counts[c]++] = p;
+}
+
+} // namespace sato
@@ -0,0 +1,99 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Pool of buffer memory for ROSBuffers and ProtoBuffers.
+//
+// The pool is a std::pmr::memory_resource so it can be passed to the
+// resource constructors of the buffers.  Memory is handed out in power of
+// two size classes.  Each thread keeps a small cache of free blocks for each
+// size class and refills from (or spills to) a lock free global free list
+// when the cache is empty (or full).  Blocks only go back to the system when
+// both are full.
+//
+// The conversion functions don't allocate from a pool themselves.  A caller
+// that allocates its output buffers from a pool, sized by the multiplexer's
+// per-type estimates (MultiplexerEstimatedROSSize and
+// MultiplexerEstimatedProtoSize), avoids mallocs and reallocs for a steady
+// stream of conversions.
+
+#include "sato/runtime/protobuf.h"
+#include "sato/runtime/ros.h"
+#include <atomic>
+#include <memory_resource>
+#include <stddef.h>
+
+namespace sato {
+
+class BufferPool : public std::pmr::memory_resource {
+public:
+  // Smallest size class is 64 bytes and the largest is 64MB.  Bigger
+  // requests go directly to the system.
+  static constexpr int kMinClassShift = 6;
+  static constexpr int kMaxClassShift = 26;
+  static constexpr int kNumClasses = kMaxClassShift - kMinClassShift + 1;
+
+  // Number of free blocks per size class in each thread's cache and in the
+  // global free list.
+  static constexpr int kThreadCacheSize = 8;
+  static constexpr int kGlobalSlots = 64;
+
+  // The process-wide pool.
+  static BufferPool &Default();
+
+  // Size of the size class that holds a block of n bytes.
+  static size_t ClassSize(size_t n) {
+    size_t size = size_t(1) << kMinClassShift;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  // Number of blocks that have been allocated from the system.  Once the
+  // pool is warmed up this stops increasing.
+  size_t SystemAllocations() const {
+    return system_allocations_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct ThreadCache;
+
+  BufferPool() = default;
+
+  static int SizeClass(size_t n);
+  static ThreadCache &Cache();
+
+  void *GlobalPop(int size_class);
+  bool GlobalPush(int size_class, void *block);
+  void *SystemAllocate(size_t size);
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+
+  // Global free lists.  Each slot holds a free block or nullptr.  Blocks are
+  // taken with an atomic exchange and returned with a compare and swap, so
+  // there is no ABA problem.
+  std::atomic<void *> global_[kNumClasses][kGlobalSlots] = {};
+  std::atomic<size_t> system_allocations_{0};
+};
+
+// Make buffers that draw from the default pool.  The initial size is
+// typically an estimate from MultiplexerEstimatedROSSize or
+// MultiplexerEstimatedProtoSize.
+inline ROSBuffer PooledROSBuffer(size_t initial_size) {
+  return ROSBuffer(BufferPool::ClassSize(initial_size), &BufferPool::Default());
+}
+
+inline ProtoBuffer PooledProtoBuffer(size_t initial_size) {
+  return ProtoBuffer(BufferPool::ClassSize(initial_size),
+                     &BufferPool::Default());
+}
+
+} // namespace sato
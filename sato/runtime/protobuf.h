@@ -6,12 +6,18 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/types/span.h"
+#include "sato/runtime/sink.h"
 #include <cstddef>
 #include <stdint.h>
 #include <string.h>
 #include <string>
+#include <algorithm>
+#include <memory_resource>
 #include <string_view>
+#include <type_traits>
 
 namespace sato {
 
@@ -24,11 +30,31 @@ enum class WireType {
   kFixed32 = 5,
 };
 
+// A tag (field number and wire type) encoded as a varint.  This is computed
+// at compile time for fields whose number is a template parameter so that
+// writing the tag is just a copy of 1 to 5 constant bytes.
+struct EncodedTag {
+  char bytes[5];
+  size_t size;
+};
+
+constexpr EncodedTag EncodeTag(int field_number, WireType wire_type) {
+  EncodedTag tag = {};
+  uint32_t value = (uint32_t(field_number) << 3) | uint32_t(wire_type);
+  while (value >= 0x80) {
+    tag.bytes[tag.size++] = char((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  tag.bytes[tag.size++] = char(value);
+  return tag;
+}
+
 class ProtoBuffer {
 public:
   static constexpr int kFieldIdShift = 3;
   static constexpr int kWireTypeMask = (1 << kFieldIdShift) - 1;
   static constexpr int kFieldIdMask = ~kWireTypeMask;
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
 
   // Dynamic buffer with own memory allocation.
   ProtoBuffer(size_t initial_size = 16) : owned_(true), size_(initial_size) {
@@ -53,6 +79,34 @@ public:
       : owned_(false), start_(const_cast<char*>(addr)), size_(size), addr_(const_cast<char*>(addr)),
         end_(addr_ + size) {}
 
+  // Streaming buffer that holds at most chunk_size bytes (unless a single
+  // item is bigger) and flushes to the sink when full.  Call Flush() when
+  // the message has been written.
+  ProtoBuffer(OutputSink *sink, size_t chunk_size = kDefaultChunkSize)
+      : ProtoBuffer(chunk_size) {
+    sink_ = sink;
+  }
+
+  // Dynamic buffer whose memory comes from a memory resource (for example
+  // a shared memory or huge page arena, or a sato::BufferPool).  A null
+  // resource means malloc.  The size is rounded up to 16 so that the buffer
+  // can grow by doubling.
+  ProtoBuffer(size_t initial_size, std::pmr::memory_resource *resource)
+      : owned_(true), size_(std::max(initial_size, size_t(16))),
+        resource_(resource) {
+    if (resource_ != nullptr) {
+      start_ = reinterpret_cast<char *>(
+          resource_->allocate(size_, alignof(std::max_align_t)));
+    } else {
+      start_ = reinterpret_cast<char *>(malloc(size_));
+      if (start_ == nullptr) {
+        abort();
+      }
+    }
+    addr_ = start_;
+    end_ = start_ + size_;
+  }
+
   ProtoBuffer(absl::Span<char> v) {
     size_ = v.size();
     start_ = v.data();
@@ -69,14 +123,34 @@ public:
 
   ~ProtoBuffer() {
     if (owned_) {
-      free(start_);
+      Deallocate(start_, size_);
     }
   }
 
+  ProtoBuffer(const ProtoBuffer &) = delete;
+  ProtoBuffer &operator=(const ProtoBuffer &) = delete;
+
   size_t Size() const { return addr_ - start_; }
 
   size_t size() const { return Size(); }
 
+  // Total number of bytes written, including those flushed to the sink.
+  size_t TotalSize() const { return flushed_ + Size(); }
+
+  // Write the contents of the buffer to the sink, if there is one.
+  absl::Status Flush() {
+    if (sink_ == nullptr || addr_ == start_) {
+      return absl::OkStatus();
+    }
+    if (absl::Status status = sink_->Write(start_, addr_ - start_);
+        !status.ok()) {
+      return status;
+    }
+    flushed_ += addr_ - start_;
+    addr_ = start_;
+    return absl::OkStatus();
+  }
+
   template <typename T> T *Data() { return reinterpret_cast<T *>(start_); }
 
   char *data() { return Data<char>(); }
@@ -94,12 +168,24 @@ public:
     end_ = start_;
   }
 
-  template <typename T> static T ZigZag(T value) {
-    return (value << 1) ^ (value >> 31);
+  template <typename T> static constexpr std::make_unsigned_t<T> ZigZag(T value) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<U>(static_cast<U>(value) << 1) ^
+           static_cast<U>(value >> (sizeof(T) * 8 - 1));
   }
-  template <typename T> static T ZagZig(T value) {
-    const uint64_t mask = (1LL << (sizeof(T) * 8 - 1)) - 1LL;
-    return ((value >> 1) & static_cast<T>(mask)) ^ -(value & 1);
+  template <typename T> static T ZagZig(std::make_unsigned_t<T> value) {
+    return static_cast<T>((value >> 1) ^ (~(value & 1) + 1));
+  }
+
+  // The value of a varint on the wire.  Negative values of non-zigzag
+  // types are sign extended to 64 bits, as protobuf does.
+  template <typename T, bool Signed>
+  static constexpr uint64_t VarintValue(T value) {
+    if constexpr (Signed) {
+      return ZigZag(value);
+    } else {
+      return static_cast<uint64_t>(value);
+    }
   }
 
   template <typename T> static constexpr WireType FixedWireType() {
@@ -111,15 +197,20 @@ public:
     abort();
   }
 
+  template <int FieldNumber, WireType Type>
+  static constexpr EncodedTag kTag = EncodeTag(FieldNumber, Type);
+
   // Size functions.
   static size_t TagSize(int field_number, WireType wire_type) {
     return VarintSize<int32_t, false>(MakeTag(field_number, wire_type));
   }
 
-  template <typename T, bool Signed> static size_t VarintSize(T value) {
-    if (Signed) {
-      value = ZigZag(value);
-    }
+  template <int FieldNumber, WireType Type> static constexpr size_t TagSize() {
+    return kTag<FieldNumber, Type>.size;
+  }
+
+  template <typename T, bool Signed> static constexpr size_t VarintSize(T v) {
+    uint64_t value = VarintValue<T, Signed>(v);
     size_t size = 0;
     for (;;) {
       if ((value & ~0x7f) == 0) {
@@ -136,28 +227,25 @@ public:
            VarintSize<int32_t, false>(length) + length;
   }
 
+  template <int FieldNumber>
+  inline static constexpr size_t LengthDelimitedSize(size_t length) {
+    return TagSize<FieldNumber, WireType::kLengthDelimited>() +
+           VarintSize<int32_t, false>(length) + length;
+  }
+
   inline static size_t StringSize(int field_number, std::string_view str) {
     return LengthDelimitedSize(field_number, str.size());
   }
 
   // Serialization functions.
 
-  template <typename T, bool Signed> absl::Status SerializeRawVarint(T value) {
-    if (Signed) {
-      value = ZigZag(value);
-    }
-    if (auto status = HasSpaceFor(VarintSize<T, false>(value)); !status.ok()) {
+  template <typename T, bool Signed> absl::Status SerializeRawVarint(T v) {
+    uint64_t value = VarintValue<T, Signed>(v);
+    if (auto status = HasSpaceFor(VarintSize<uint64_t, false>(value));
+        !status.ok()) {
       return status;
     }
-    for (;;) {
-      if ((value & ~0x7f) == 0) {
-        *addr_++ = static_cast<char>(value);
-        break;
-      } else {
-        *addr_++ = static_cast<char>((value & 0xfF) | 0x80);
-        value >>= 7;
-      }
-    }
+    WriteRawVarint(value);
     return absl::OkStatus();
   }
 
@@ -199,12 +287,7 @@ public:
         !status.ok()) {
       return status;
     }
-    if (auto status = HasSpaceFor(length); !status.ok()) {
-      return status;
-    }
-    memcpy(addr_, data, length);
-    addr_ += length;
-    return absl::OkStatus();
+    return SerializeRaw(data, length);
   }
 
   absl::Status SerializeLengthDelimitedHeader(int field_number, size_t length) {
@@ -215,7 +298,68 @@ public:
     return SerializeRawVarint<int32_t, false>(length);
   }
 
+  // Serialization functions for a field number known at compile time.  The
+  // tag is pre-encoded and the space for the tag and value is checked once.
+  template <int FieldNumber, typename T, bool Signed>
+  absl::Status SerializeVarint(T v) {
+    constexpr EncodedTag tag = kTag<FieldNumber, WireType::kVarint>;
+    uint64_t value = VarintValue<T, Signed>(v);
+    if (auto status = HasSpaceFor(tag.size + VarintSize<uint64_t, false>(value));
+        !status.ok()) {
+      return status;
+    }
+    memcpy(addr_, tag.bytes, tag.size);
+    addr_ += tag.size;
+    WriteRawVarint(value);
+    return absl::OkStatus();
+  }
+
+  template <int FieldNumber, typename T> absl::Status SerializeFixed(T value) {
+    constexpr EncodedTag tag = kTag<FieldNumber, FixedWireType<T>()>;
+    if (auto status = HasSpaceFor(tag.size + sizeof(T)); !status.ok()) {
+      return status;
+    }
+    memcpy(addr_, tag.bytes, tag.size);
+    memcpy(addr_ + tag.size, &value, sizeof(T));
+    addr_ += tag.size + sizeof(T);
+    return absl::OkStatus();
+  }
+
+  template <int FieldNumber>
+  absl::Status SerializeLengthDelimitedHeader(size_t length) {
+    constexpr EncodedTag tag = kTag<FieldNumber, WireType::kLengthDelimited>;
+    uint32_t len = static_cast<uint32_t>(length);
+    if (auto status = HasSpaceFor(tag.size + VarintSize<uint32_t, false>(len));
+        !status.ok()) {
+      return status;
+    }
+    memcpy(addr_, tag.bytes, tag.size);
+    addr_ += tag.size;
+    WriteRawVarint(len);
+    return absl::OkStatus();
+  }
+
+  template <int FieldNumber>
+  absl::Status SerializeLengthDelimited(const void *data, size_t length) {
+    if (absl::Status status = SerializeLengthDelimitedHeader<FieldNumber>(length);
+        !status.ok()) {
+      return status;
+    }
+    return SerializeRaw(data, length);
+  }
+
   absl::Status SerializeRaw(const void *data, size_t length) {
+    if (length == 0) {
+      return absl::OkStatus();
+    }
+    if (sink_ != nullptr && length > size_) {
+      // Too big for the chunk, send it straight to the sink.
+      if (absl::Status status = Flush(); !status.ok()) {
+        return status;
+      }
+      flushed_ += length;
+      return sink_->Write(reinterpret_cast<const char *>(data), length);
+    }
     if (auto status = HasSpaceFor(length); !status.ok()) {
       return status;
     }
@@ -281,17 +425,44 @@ public:
     return absl::OkStatus();
   }
 
+  // Count the fields with the given tag from the current position, which is
+  // at the value of a field with that tag, to the end of the buffer.  This
+  // only skips over the fields so it's a cheap way to find how much space a
+  // repeated field needs.  The position is not changed.
+  size_t CountFields(uint32_t tag) {
+    char *start = addr_;
+    size_t count = 1;
+    if (SkipTag(tag).ok()) {
+      while (!Eof()) {
+        absl::StatusOr<uint32_t> next = DeserializeTag();
+        if (!next.ok() || !SkipTag(*next).ok()) {
+          break;
+        }
+        if (*next == tag) {
+          count++;
+        }
+      }
+    }
+    addr_ = start;
+    return count;
+  }
+
   // Tag has already been read.
   template <typename T, bool Signed> absl::StatusOr<T> DeserializeVarint() {
-    uint32_t value = 0;
-    for (size_t shift = 0; shift < sizeof(T) * 8; shift += 7) {
+    // Up to 10 bytes as negative values are sign extended to 64 bits.
+    uint64_t value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
       if (absl::Status status = Check(1); !status.ok()) {
         return status;
       }
-      uint32_t byte = *addr_++;
-      value |= (byte & 0x7f) << int(shift);
+      uint64_t byte = uint8_t(*addr_++);
+      value |= (byte & 0x7f) << shift;
       if ((byte & 0x80) == 0) {
-        return Signed ? ZagZig(value) : value;
+        if constexpr (Signed) {
+          return ZagZig<T>(static_cast<std::make_unsigned_t<T>>(value));
+        } else {
+          return static_cast<T>(value);
+        }
       }
     }
     return absl::InternalError("Varint too long");
@@ -343,36 +514,81 @@ public:
   }
 
 private:
+  // Write a varint.  The caller has checked the space.
+  template <typename T> void WriteRawVarint(T value) {
+    for (;;) {
+      if ((value & ~0x7f) == 0) {
+        *addr_++ = static_cast<char>(value);
+        break;
+      } else {
+        *addr_++ = static_cast<char>((value & 0xfF) | 0x80);
+        value >>= 7;
+      }
+    }
+  }
+
   size_t static MakeTag(int field_number, WireType wire_type) {
     return static_cast<size_t>((field_number << kFieldIdShift) |
                                int(wire_type));
   }
 
   absl::Status HasSpaceFor(size_t n) {
-    char *next = addr_ + n;
-    // Off-by-one complexity here.  The end is one past the end of the buffer.
-    if (next > end_) {
-      if (owned_) {
-        // Expand the buffer.
-        size_t new_size = size_ * 2;
-
-        char *new_start = reinterpret_cast<char *>(realloc(start_, new_size));
-        if (new_start == nullptr) {
-          abort();
-        }
-        size_t curr_length = addr_ - start_;
-        start_ = new_start;
-        addr_ = start_ + curr_length;
-        end_ = start_ + new_size;
-        size_ = new_size;
+    // Off-by-one complexity here.  The end is one past the end of the
+    // buffer.
+    if (ABSL_PREDICT_TRUE(addr_ + n <= end_)) {
+      return absl::OkStatus();
+    }
+    return Expand(n);
+  }
+
+  // Slow path for HasSpaceFor: flush to the sink or grow the storage.
+  // Kept out of line so that the fast path is just the end check.
+  ABSL_ATTRIBUTE_NOINLINE absl::Status Expand(size_t n) {
+    if (sink_ != nullptr) {
+      if (absl::Status status = Flush(); !status.ok()) {
+        return status;
+      }
+      if (addr_ + n <= end_) {
         return absl::OkStatus();
       }
+    }
+    size_t curr_length = addr_ - start_;
+    if (!owned_) {
       return absl::InternalError(absl::StrFormat(
-          "No space in buffer: length: %d, need: %d", size_, next - start_));
+          "No space in buffer: length: %d, need: %d", size_, curr_length + n));
     }
+    // Expand the buffer.
+    size_t new_size = size_ * 2;
+    while (new_size < curr_length + n) {
+      new_size *= 2;
+    }
+    char *new_start;
+    if (resource_ != nullptr) {
+      new_start = reinterpret_cast<char *>(
+          resource_->allocate(new_size, alignof(std::max_align_t)));
+      memcpy(new_start, start_, curr_length);
+      resource_->deallocate(start_, size_, alignof(std::max_align_t));
+    } else {
+      new_start = reinterpret_cast<char *>(realloc(start_, new_size));
+      if (new_start == nullptr) {
+        abort();
+      }
+    }
+    start_ = new_start;
+    addr_ = start_ + curr_length;
+    end_ = start_ + new_size;
+    size_ = new_size;
     return absl::OkStatus();
   }
 
+  void Deallocate(char *p, size_t size) {
+    if (resource_ != nullptr) {
+      resource_->deallocate(p, size, alignof(std::max_align_t));
+    } else {
+      free(p);
+    }
+  }
+
   absl::Status Check(size_t n) {
     char *next = addr_ + n;
     if (next <= end_) {
@@ -386,6 +602,9 @@ private:
   size_t size_ = 0;
   char *addr_ = nullptr;
   char *end_ = nullptr;
+  OutputSink *sink_ = nullptr; // Where to flush to when full.
+  std::pmr::memory_resource *resource_ = nullptr; // Null means malloc.
+  size_t flushed_ = 0;         // Number of bytes flushed to the sink.
 };
 
 } // namespace sato
@@ -7,14 +7,20 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/types/span.h"
+#include "sato/runtime/sink.h"
 #include "toolbelt/hexdump.h"
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <sstream>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string>
+#include <memory>
+#include <memory_resource>
 #include <string_view>
 #include <vector>
 
@@ -22,8 +28,24 @@ namespace sato {
 
 // Provides a statically sized or dynamic ROSBuffer used for serialization
 // of messages.
+//
+// In compact mode runs of zero bytes are encoded as a zero byte followed by
+// the length of the run (1 to 255).  Messages with lots of default values
+// shrink a lot, but a lone zero byte takes two bytes so the worst case
+// size is twice the normal size.  Both ends must agree on the mode, and
+// Flush() must be called after writing to emit any trailing zeroes.
+//
+// In CDR mode the buffer holds ROS 2 serialized messages (little endian
+// XCDR1) instead of ROS 1.  Values are aligned to their size relative to the
+// start of the message body, strings have a trailing NUL that is included
+// in their length and the message starts with a 4 byte encapsulation header.
+// CDR can't be combined with compact mode; reading or writing the CDR
+// header of a compact buffer is an error.  SerializedROSSize() is the ROS 1
+// size so it doesn't include the CDR padding.
 class ROSBuffer {
 public:
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
   // Dynamic ROSBuffer with own memory allocation.
   ROSBuffer(size_t initial_size = 16) : owned_(true), size_(initial_size) {
     if (initial_size < 16) {
@@ -43,16 +65,178 @@ public:
       : owned_(false), start_(addr), size_(size), addr_(addr),
         end_(addr + size) {}
 
+  // Streaming ROSBuffer that holds at most chunk_size bytes (unless a single
+  // item is bigger) and flushes to the sink when full.  Call Flush() when
+  // the message has been written.
+  ROSBuffer(OutputSink *sink, size_t chunk_size = kDefaultChunkSize)
+      : ROSBuffer(chunk_size) {
+    sink_ = sink;
+  }
+
+  // Dynamic ROSBuffer whose memory comes from a memory resource (for example
+  // a shared memory or huge page arena, or a sato::BufferPool).  A null
+  // resource means malloc.  The size is rounded up to 16 so that the buffer
+  // can grow by doubling.
+  ROSBuffer(size_t initial_size, std::pmr::memory_resource *resource)
+      : owned_(true), size_(std::max(initial_size, size_t(16))),
+        resource_(resource) {
+    if (resource_ != nullptr) {
+      start_ = reinterpret_cast<char *>(
+          resource_->allocate(size_, alignof(std::max_align_t)));
+    } else {
+      start_ = reinterpret_cast<char *>(malloc(size_));
+      if (start_ == nullptr) {
+        abort();
+      }
+    }
+    addr_ = start_;
+    end_ = start_ + size_;
+  }
+
   ~ROSBuffer() {
     if (owned_) {
-      free(start_);
+      Deallocate(start_, size_);
     }
   }
 
+  ROSBuffer(const ROSBuffer &) = delete;
+  ROSBuffer &operator=(const ROSBuffer &) = delete;
+
   size_t Size() const { return addr_ - start_; }
 
   size_t size() const { return Size(); }
 
+  void SetCompact(bool compact) { compact_ = compact; }
+  bool IsCompact() const { return compact_; }
+
+  void SetCDR(bool cdr) { cdr_ = cdr; }
+  bool IsCDR() const { return cdr_; }
+
+  // Messages with a fixed ROS layout can be copied directly only in plain
+  // ROS 1 buffers.
+  bool HasFixedLayout() const { return !compact_ && !cdr_; }
+
+  // Write the CDR encapsulation header if it hasn't been written yet.  The
+  // body of the message starts after it.
+  absl::Status WriteCDRHeader() {
+    if (cdr_started_) {
+      return absl::OkStatus();
+    }
+    if (ABSL_PREDICT_FALSE(compact_)) {
+      return CompactCDRError();
+    }
+    static constexpr char kHeader[4] = {0, 1, 0, 0}; // CDR_LE, no options.
+    if (absl::Status status = WriteBytes(kHeader, sizeof(kHeader));
+        !status.ok()) {
+      return status;
+    }
+    cdr_started_ = true;
+    cdr_origin_ = TotalSize();
+    return absl::OkStatus();
+  }
+
+  // Read and check the CDR encapsulation header if it hasn't been read yet.
+  absl::Status ReadCDRHeader() const {
+    if (cdr_started_) {
+      return absl::OkStatus();
+    }
+    if (ABSL_PREDICT_FALSE(compact_)) {
+      return CompactCDRError();
+    }
+    char header[4];
+    if (absl::Status status = ReadBytes(header, sizeof(header));
+        !status.ok()) {
+      return status;
+    }
+    if (header[0] != 0 || header[1] != 1) {
+      return absl::UnimplementedError(absl::StrFormat(
+          "Unsupported CDR encapsulation 0x%02x%02x, only CDR_LE is "
+          "supported",
+          header[0], header[1]));
+    }
+    cdr_started_ = true;
+    cdr_origin_ = Size();
+    return absl::OkStatus();
+  }
+
+  // Write the zero padding needed to align the next CDR value to n bytes.
+  absl::Status Align(size_t n) {
+    static constexpr char kPadding[8] = {};
+    size_t padding = Padding(n);
+    if (padding == 0) {
+      return absl::OkStatus();
+    }
+    return WriteBytes(kPadding, padding);
+  }
+
+  // Move past the padding before a CDR value aligned to n bytes.
+  absl::Status AlignRead(size_t n) const {
+    size_t padding = Padding(n);
+    if (absl::Status status = Check(padding); !status.ok()) {
+      return status;
+    }
+    addr_ += padding;
+    return absl::OkStatus();
+  }
+
+  // Total number of bytes written, including those flushed to the sink.
+  size_t TotalSize() const { return flushed_ + Size(); }
+
+  // Write any pending zeroes (in compact mode) and the contents of the
+  // ROSBuffer to the sink, if there is one.
+  absl::Status Flush() {
+    if (num_zeroes_ > 0) {
+      if (absl::Status status = WriteZeroRun(); !status.ok()) {
+        return status;
+      }
+    }
+    return FlushToSink();
+  }
+
+  // Write a block of bytes.  If there is a sink and the block is bigger
+  // than the chunk it is written directly to the sink.
+  absl::Status WriteBytes(const void *data, size_t length) {
+    if (ABSL_PREDICT_FALSE(compact_)) {
+      return WriteCompact(reinterpret_cast<const char *>(data), length);
+    }
+    if (sink_ != nullptr && length > size_) {
+      if (absl::Status status = FlushToSink(); !status.ok()) {
+        return status;
+      }
+      flushed_ += length;
+      return sink_->Write(reinterpret_cast<const char *>(data), length);
+    }
+    if (length == 0) {
+      return absl::OkStatus();
+    }
+    if (absl::Status status = HasSpaceFor(length); !status.ok()) {
+      return status;
+    }
+    memcpy(addr_, data, length);
+    addr_ += length;
+    return absl::OkStatus();
+  }
+
+  // Read a block of bytes.
+  absl::Status ReadBytes(void *data, size_t length) const {
+    if (ABSL_PREDICT_FALSE(compact_)) {
+      return ReadCompact(reinterpret_cast<char *>(data), length);
+    }
+    if (absl::Status status = Check(length); !status.ok()) {
+      return status;
+    }
+    memcpy(data, addr_, length);
+    addr_ += length;
+    return absl::OkStatus();
+  }
+
+  // Memory for data that is decoded from a compact buffer and needs to
+  // outlive the read (strings).
+  char *AllocateDecoded(size_t n) const {
+    decoded_.push_back(std::make_unique<char[]>(n));
+    return decoded_.back().get();
+  }
+
   template <typename T> T *Data() { return reinterpret_cast<T *>(start_); }
 
   char *data() { return Data<char>(); }
@@ -66,12 +250,18 @@ public:
   void Clear() {
     addr_ = start_;
     end_ = start_;
+    num_zeroes_ = 0;
+    cdr_started_ = false;
   }
 
-  void Rewind() { addr_ = start_; }
+  void Rewind() {
+    addr_ = start_;
+    num_zeroes_ = 0;
+    cdr_started_ = false;
+  }
 
   absl::Status CheckAtEnd() const {
-    if (addr_ != end_) {
+    if (addr_ != end_ || num_zeroes_ != 0) {
       return absl::InternalError(absl::StrFormat(
           "Extra data in ROSBuffer: start: %p, addr: %p, end_ %p", start_,
           addr_, end_));
@@ -82,29 +272,12 @@ public:
   char *&Addr() const { return addr_; }
 
   absl::Status HasSpaceFor(size_t n) {
-    char *next = addr_ + n;
     // Off-by-one complexity here.  The end is one past the end of the
     // ROSBuffer.
-    if (next > end_) {
-      if (owned_) {
-        // Expand the ROSBuffer.
-        size_t new_size = size_ * 2;
-
-        char *new_start = reinterpret_cast<char *>(realloc(start_, new_size));
-        if (new_start == nullptr) {
-          abort();
-        }
-        size_t curr_length = addr_ - start_;
-        start_ = new_start;
-        addr_ = start_ + curr_length;
-        end_ = start_ + new_size;
-        size_ = new_size;
-        return absl::OkStatus();
-      }
-      return absl::InternalError(absl::StrFormat(
-          "No space in ROSBuffer: length: %d, need: %d", size_, next - start_));
+    if (ABSL_PREDICT_TRUE(addr_ + n <= end_)) {
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
+    return Expand(n);
   }
 
   absl::Status Check(size_t n) const {
@@ -119,6 +292,9 @@ public:
   }
 
   absl::Status Skip(size_t n) {
+    if (compact_) {
+      return ReadCompact(nullptr, n);
+    }
     char *next = addr_ + n;
     if (next <= end_) {
       addr_ = next;
@@ -131,12 +307,184 @@ public:
   }
 
 private:
+  // Bytes of padding to align the current CDR offset to n (a power of 2).
+  size_t Padding(size_t n) const {
+    return (cdr_origin_ - TotalSize()) & (n - 1);
+  }
+
+  // Padding is worked out from TotalSize(), which in compact mode is the
+  // compressed size, so CDR can't be used in compact mode.
+  static absl::Status CompactCDRError() {
+    return absl::InvalidArgumentError(
+        "A ROSBuffer can't be in both compact and CDR mode");
+  }
+
+  // Write the contents of the ROSBuffer to the sink, if there is one.
+  absl::Status FlushToSink() {
+    if (sink_ == nullptr || addr_ == start_) {
+      return absl::OkStatus();
+    }
+    if (absl::Status status = sink_->Write(start_, addr_ - start_);
+        !status.ok()) {
+      return status;
+    }
+    flushed_ += addr_ - start_;
+    addr_ = start_;
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteZeroRun() {
+    if (absl::Status status = HasSpaceFor(2); !status.ok()) {
+      return status;
+    }
+    addr_[0] = 0;
+    addr_[1] = char(num_zeroes_);
+    addr_ += 2;
+    num_zeroes_ = 0;
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteCompact(const char *data, size_t length) {
+    const char *end = data + length;
+    while (data < end) {
+      if (*data == 0) {
+        data++;
+        if (++num_zeroes_ == 255) {
+          if (absl::Status status = WriteZeroRun(); !status.ok()) {
+            return status;
+          }
+        }
+        continue;
+      }
+      if (num_zeroes_ > 0) {
+        if (absl::Status status = WriteZeroRun(); !status.ok()) {
+          return status;
+        }
+      }
+      // Copy the run of non-zero bytes.
+      const char *zero =
+          reinterpret_cast<const char *>(memchr(data, 0, end - data));
+      size_t n = (zero == nullptr ? end : zero) - data;
+      if (sink_ != nullptr) {
+        // Stay within the chunk.
+        n = std::min(n, size_);
+      }
+      if (absl::Status status = HasSpaceFor(n); !status.ok()) {
+        return status;
+      }
+      memcpy(addr_, data, n);
+      addr_ += n;
+      data += n;
+    }
+    return absl::OkStatus();
+  }
+
+  // Decode length bytes into data.  If data is nullptr the bytes are
+  // skipped.
+  absl::Status ReadCompact(char *data, size_t length) const {
+    while (length > 0) {
+      if (num_zeroes_ > 0) {
+        size_t n = std::min(length, num_zeroes_);
+        if (data != nullptr) {
+          memset(data, 0, n);
+          data += n;
+        }
+        num_zeroes_ -= n;
+        length -= n;
+        continue;
+      }
+      if (addr_ >= end_) {
+        return absl::InternalError(absl::StrFormat(
+            "ROSBuffer overrun in compact mode when reading %d bytes", length));
+      }
+      if (*addr_ == 0) {
+        if (addr_ + 2 > end_ || addr_[1] == 0) {
+          return absl::InternalError("Invalid zero run in compact ROSBuffer");
+        }
+        num_zeroes_ = uint8_t(addr_[1]);
+        addr_ += 2;
+        continue;
+      }
+      const char *limit = addr_ + std::min(length, size_t(end_ - addr_));
+      const char *zero =
+          reinterpret_cast<const char *>(memchr(addr_, 0, limit - addr_));
+      size_t n = (zero == nullptr ? limit : zero) - addr_;
+      if (data != nullptr) {
+        memcpy(data, addr_, n);
+        data += n;
+      }
+      addr_ += n;
+      length -= n;
+    }
+    return absl::OkStatus();
+  }
+
+  // Slow path for HasSpaceFor: flush to the sink or grow the storage.
+  // Kept out of line so that the fast path is just the end check.
+  ABSL_ATTRIBUTE_NOINLINE absl::Status Expand(size_t n) {
+    if (sink_ != nullptr) {
+      if (absl::Status status = FlushToSink(); !status.ok()) {
+        return status;
+      }
+      if (addr_ + n <= end_) {
+        return absl::OkStatus();
+      }
+    }
+    size_t curr_length = addr_ - start_;
+    if (!owned_) {
+      return absl::InternalError(absl::StrFormat(
+          "No space in ROSBuffer: length: %d, need: %d", size_, curr_length + n));
+    }
+    // Expand the ROSBuffer.
+    size_t new_size = size_ * 2;
+    while (new_size < curr_length + n) {
+      new_size *= 2;
+    }
+    char *new_start;
+    if (resource_ != nullptr) {
+      new_start = reinterpret_cast<char *>(
+          resource_->allocate(new_size, alignof(std::max_align_t)));
+      memcpy(new_start, start_, curr_length);
+      resource_->deallocate(start_, size_, alignof(std::max_align_t));
+    } else {
+      new_start = reinterpret_cast<char *>(realloc(start_, new_size));
+      if (new_start == nullptr) {
+        abort();
+      }
+    }
+    start_ = new_start;
+    addr_ = start_ + curr_length;
+    end_ = start_ + new_size;
+    size_ = new_size;
+    return absl::OkStatus();
+  }
+
+  void Deallocate(char *p, size_t size) {
+    if (resource_ != nullptr) {
+      resource_->deallocate(p, size, alignof(std::max_align_t));
+    } else {
+      free(p);
+    }
+  }
+
   bool owned_ = false;           // Memory is owned by this ROSBuffer.
   char *start_ = nullptr;        // Start of memory.
   size_t size_ = 0;              // Size of memory.
   mutable char *addr_ = nullptr; // Current read/write address.
   char *end_ = nullptr;          // End of ROSBuffer.
-  mutable int num_zeroes_ = 0; // Number of zero bytes to write in compact mode.
+  bool compact_ = false;         // Zero runs are compressed.
+  bool cdr_ = false;             // ROS 2 CDR rather than ROS 1.
+  // The encapsulation header has been written or read and CDR offsets are
+  // relative to cdr_origin_.
+  mutable bool cdr_started_ = false;
+  mutable size_t cdr_origin_ = 0;
+  // Number of zero bytes to write (or still to read) in compact mode.
+  mutable size_t num_zeroes_ = 0;
+  // Decoded strings read from a compact buffer.
+  mutable std::vector<std::unique_ptr<char[]>> decoded_;
+  OutputSink *sink_ = nullptr;  // Where to flush to when full.
+  std::pmr::memory_resource *resource_ = nullptr; // Null means malloc.
+  size_t flushed_ = 0;          // Number of bytes flushed to the sink.
 };
 
 // Alignment is not guaranteed for any copies so to comply with
@@ -145,6 +493,14 @@ private:
 // It won't make any difference anyway since the biggest performance
 // issue with serialization is large data sets, like camera images.
 template <typename T> inline absl::Status Write(ROSBuffer &b, const T &v) {
+  if (ABSL_PREDICT_FALSE(b.IsCompact())) {
+    return b.WriteBytes(&v, sizeof(T));
+  }
+  if (ABSL_PREDICT_FALSE(b.IsCDR())) {
+    if (absl::Status status = b.Align(alignof(T)); !status.ok()) {
+      return status;
+    }
+  }
   if (absl::Status status = b.HasSpaceFor(sizeof(T)); !status.ok()) {
     return status;
   }
@@ -154,6 +510,14 @@ template <typename T> inline absl::Status Write(ROSBuffer &b, const T &v) {
 }
 
 template <typename T> inline absl::Status Read(const ROSBuffer &b, T &v) {
+  if (ABSL_PREDICT_FALSE(b.IsCompact())) {
+    return b.ReadBytes(&v, sizeof(T));
+  }
+  if (ABSL_PREDICT_FALSE(b.IsCDR())) {
+    if (absl::Status status = b.AlignRead(alignof(T)); !status.ok()) {
+      return status;
+    }
+  }
   if (absl::Status status = b.Check(sizeof(T)); !status.ok()) {
     return status;
   }
@@ -163,18 +527,57 @@ template <typename T> inline absl::Status Read(const ROSBuffer &b, T &v) {
 }
 
 template <> inline absl::Status Write(ROSBuffer &b, const std::string_view &v) {
-  if (absl::Status status = b.HasSpaceFor(4 + v.size()); !status.ok()) {
-    return status;
+  if (ABSL_PREDICT_FALSE(b.IsCDR())) {
+    // The length includes the trailing NUL.
+    if (absl::Status status = Write(b, static_cast<uint32_t>(v.size() + 1));
+        !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = b.WriteBytes(v.data(), v.size());
+        !status.ok()) {
+      return status;
+    }
+    return b.WriteBytes("", 1);
   }
-
   uint32_t size = static_cast<uint32_t>(v.size());
-  memcpy(b.Addr(), &size, sizeof(size));
-  memcpy(b.Addr() + 4, v.data(), v.size());
-  b.Addr() += 4 + v.size();
-  return absl::OkStatus();
+  if (absl::Status status = Write(b, size); !status.ok()) {
+    return status;
+  }
+  return b.WriteBytes(v.data(), v.size());
 }
 
 template <> inline absl::Status Read(const ROSBuffer &b, std::string_view &v) {
+  if (ABSL_PREDICT_FALSE(b.IsCompact())) {
+    // The string is not contiguous in the buffer so decode it into memory
+    // owned by the buffer.
+    uint32_t size = 0;
+    if (absl::Status status = b.ReadBytes(&size, sizeof(size)); !status.ok()) {
+      return status;
+    }
+    if (size == 0) {
+      v = std::string_view();
+      return absl::OkStatus();
+    }
+    char *s = b.AllocateDecoded(size);
+    if (absl::Status status = b.ReadBytes(s, size); !status.ok()) {
+      return status;
+    }
+    v = std::string_view(s, size);
+    return absl::OkStatus();
+  }
+  if (ABSL_PREDICT_FALSE(b.IsCDR())) {
+    uint32_t size = 0;
+    if (absl::Status status = Read(b, size); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = b.Check(size); !status.ok()) {
+      return status;
+    }
+    // Leave out the trailing NUL.
+    v = std::string_view(b.Addr(), size == 0 ? 0 : size - 1);
+    b.Addr() += size;
+    return absl::OkStatus();
+  }
   if (absl::Status status = b.Check(4); !status.ok()) {
     return status;
   }
@@ -190,12 +593,10 @@ template <> inline absl::Status Read(const ROSBuffer &b, std::string_view &v) {
 
 template <typename T>
 inline absl::Status Write(ROSBuffer &b, const std::vector<T> &vec) {
-  if (absl::Status status = b.HasSpaceFor(4); !status.ok()) {
+  uint32_t size = static_cast<uint32_t>(vec.size());
+  if (absl::Status status = Write(b, size); !status.ok()) {
     return status;
   }
-  uint32_t size = static_cast<uint32_t>(vec.size());
-  memcpy(b.Addr(), &size, sizeof(size));
-  b.Addr() += 4;
   for (auto &v : vec) {
     if (absl::Status status = Write(b, v); !status.ok()) {
       return status;
@@ -206,12 +607,10 @@ inline absl::Status Write(ROSBuffer &b, const std::vector<T> &vec) {
 
 template <typename T>
 inline absl::Status Read(const ROSBuffer &b, std::vector<T> &vec) {
-  if (absl::Status status = b.Check(4); !status.ok()) {
+  uint32_t size = 0;
+  if (absl::Status status = Read(b, size); !status.ok()) {
     return status;
   }
-  uint32_t size = 0;
-  memcpy(&size, b.Addr(), sizeof(size));
-  b.Addr() += 4;
   vec.resize(size);
   for (uint32_t i = 0; i < size; i++) {
     if (absl::Status status = Read(b, vec[i]); !status.ok()) {
@@ -233,12 +632,7 @@ inline absl::Status Write(ROSBuffer &b, const std::array<T, N> &vec) {
 
 template <size_t N>
 inline absl::Status Write(ROSBuffer &b, const std::array<uint8_t, N> &vec) {
-  if (absl::Status status = b.HasSpaceFor(N); !status.ok()) {
-    return status;
-  }
-  memcpy(b.Addr(), vec.data(), N);
-  b.Addr() += N;
-  return absl::OkStatus();
+  return b.WriteBytes(vec.data(), N);
 }
 
 template <typename T, size_t N>
@@ -253,14 +647,145 @@ inline absl::Status Read(const ROSBuffer &b, std::array<T, N> &vec) {
 
 template <size_t N>
 inline absl::Status Read(const ROSBuffer &b, std::array<uint8_t, N> &vec) {
-  if (absl::Status status = b.Check(N); !status.ok()) {
+  return b.ReadBytes(vec.data(), N);
+}
+
+// A uint8[] is a count followed by the bytes.  Outside of CDR that's the
+// same as a string.
+inline absl::Status WriteByteArray(ROSBuffer &b, std::string_view v) {
+  if (ABSL_PREDICT_TRUE(!b.IsCDR())) {
+    return Write(b, v);
+  }
+  if (absl::Status status = Write(b, static_cast<uint32_t>(v.size()));
+      !status.ok()) {
+    return status;
+  }
+  return b.WriteBytes(v.data(), v.size());
+}
+
+inline absl::Status ReadByteArray(const ROSBuffer &b, std::string_view &v) {
+  if (ABSL_PREDICT_TRUE(!b.IsCDR())) {
+    return Read(b, v);
+  }
+  uint32_t size = 0;
+  if (absl::Status status = Read(b, size); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = b.Check(size); !status.ok()) {
     return status;
   }
-  memcpy(vec.data(), b.Addr(), N);
-  b.Addr() += N;
+  v = std::string_view(b.Addr(), size);
+  b.Addr() += size;
   return absl::OkStatus();
 }
 
+// Skip n values of type T.  In CDR there is no padding if there are no
+// values.
+template <typename T>
+inline absl::Status SkipValues(ROSBuffer &b, size_t n = 1) {
+  if (ABSL_PREDICT_FALSE(b.IsCDR()) && n > 0) {
+    if (absl::Status status = b.AlignRead(alignof(T)); !status.ok()) {
+      return status;
+    }
+  }
+  return b.Skip(n * sizeof(T));
+}
+
+// The std_msgs/Header at the start of top level messages.  Unless the
+// message has a field bound to it with (sato.ros_header) only the timestamp
+// is filled in.  In ROS 1 it is:
+// uint32 seq   - offset 0 size 4
+// time stamp - offset 4 size 8
+// string frame_id - offset 12 size 4 + string length
+// for a total of 16 bytes with an empty frame_id.  In ROS 2 there is no seq
+// and the stamp is a builtin_interfaces/Time (int32 sec, uint32 nanosec).
+// The CDR encapsulation header comes before the first one.
+inline absl::Status WriteROSHeader(ROSBuffer &b, uint64_t timestamp,
+                                   std::string_view frame_id = {},
+                                   uint32_t seq = 0) {
+  if (ABSL_PREDICT_FALSE(b.IsCDR())) {
+    if (absl::Status status = b.WriteCDRHeader(); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = Write(b, int32_t(timestamp / 1000000000));
+        !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = Write(b, uint32_t(timestamp % 1000000000));
+        !status.ok()) {
+      return status;
+    }
+    return Write(b, frame_id);
+  }
+  if (absl::Status status = Write(b, seq); !status.ok()) {
+    return status;
+  }
+  // ROS time is two 32 bit numbers: seconds and nanoseconds.
+  if (absl::Status status = Write(b, uint32_t(timestamp / 1000000000));
+      !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = Write(b, uint32_t(timestamp % 1000000000));
+      !status.ok()) {
+    return status;
+  }
+  return Write(b, frame_id);
+}
+
+// Read the header into a field bound with (sato.ros_header).  The frame_id
+// is not copied.
+inline absl::Status ReadROSHeader(ROSBuffer &b, uint64_t &timestamp,
+                                  std::string_view &frame_id, uint32_t &seq) {
+  seq = 0;
+  if (ABSL_PREDICT_FALSE(b.IsCDR())) {
+    if (absl::Status status = b.ReadCDRHeader(); !status.ok()) {
+      return status;
+    }
+  } else if (absl::Status status = Read(b, seq); !status.ok()) {
+    return status;
+  }
+  uint32_t sec = 0;
+  uint32_t nsec = 0;
+  if (absl::Status status = Read(b, sec); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = Read(b, nsec); !status.ok()) {
+    return status;
+  }
+  timestamp = uint64_t(sec) * 1000000000 + nsec;
+  return Read(b, frame_id);
+}
+
+// True if the ROS1 std_msgs/Header at addr has an empty frame_id, so it is
+// 16 bytes long.  The caller checks that the 16 bytes are there.
+inline bool ROSFrameIdIsEmpty(const char *header) {
+  uint32_t frame_id_size;
+  memcpy(&frame_id_size, header + 12, sizeof(frame_id_size));
+  return frame_id_size == 0;
+}
+
+inline absl::Status SkipROSHeader(ROSBuffer &b) {
+  if (ABSL_PREDICT_FALSE(b.IsCDR())) {
+    if (absl::Status status = b.ReadCDRHeader(); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = SkipValues<uint32_t>(b, 2); !status.ok()) {
+      return status;
+    }
+    std::string_view frame_id;
+    return Read(b, frame_id);
+  }
+  // The frame_id is usually empty, but not if the message came from ROS.
+  if (absl::Status status = b.Skip(12); !status.ok()) {
+    return status;
+  }
+  uint32_t size = 0;
+  if (absl::Status status = Read(b, size); !status.ok()) {
+    return status;
+  }
+  return b.Skip(size);
+}
+
 #if 0
 template <> inline absl::Status Write(ROSBuffer &b, const Time &t) {
   if (absl::Status status = Write(b, t.secs); !status.ok()) {
@@ -0,0 +1,252 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Support for plain C++ ROS structs.
+//
+// With the ros_structs option the generator also emits a plain struct for
+// each message in a nested "ros" namespace, laid out like the ROS message
+// (std::string for strings, std::vector for arrays, oneof messages as 0 or
+// 1 element arrays).  The structs are converted straight from and to
+// protobuf wire format so in-process consumers don't need to go through
+// serialized ROS at all.  Unlike the sato messages, the structs own their
+// data.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sato/runtime/map.h"
+#include "sato/runtime/protobuf.h"
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace sato {
+
+// std_msgs/Header for top level messages (the ros_header member).  It's not
+// in the protobuf message so it's left for the application to fill in.
+struct ROSHeader {
+  uint32_t seq = 0;
+  uint32_t stamp_sec = 0;
+  uint32_t stamp_nsec = 0;
+  std::string frame_id;
+};
+
+// Strings and bytes that are copied into a std::string.
+struct OwnedStringCodec {
+  using Type = std::string;
+
+  template <int Number> static size_t ProtoSize(const std::string &v) {
+    return ProtoBuffer::LengthDelimitedSize<Number>(v.size());
+  }
+
+  template <int Number>
+  static absl::Status WriteProto(ProtoBuffer &buffer, const std::string &v) {
+    return buffer.SerializeLengthDelimited<Number>(v.data(), v.size());
+  }
+
+  static absl::Status ParseProto(ProtoBuffer &buffer, std::string &v) {
+    absl::StatusOr<std::string_view> value = buffer.DeserializeString();
+    if (!value.ok()) {
+      return value.status();
+    }
+    v.assign(value->data(), value->size());
+    return absl::OkStatus();
+  }
+};
+
+template <typename Codec, typename = void>
+struct IsPackable : std::false_type {};
+
+template <typename Codec>
+struct IsPackable<Codec, std::void_t<decltype(Codec::kPackable)>>
+    : std::true_type {};
+
+// A repeated field held in a std::vector.  Primitive values are packed if
+// Packed is true.  Both packed and unpacked values are accepted when
+// parsing, as protobuf does.
+template <int Number, typename Codec, bool Packed> struct RepeatedCodec {
+  using Type = typename Codec::Type;
+  static constexpr bool kPacked = Packed && IsPackable<Codec>::value;
+
+  static size_t ProtoSize(const std::vector<Type> &v) {
+    if (v.empty()) {
+      return 0;
+    }
+    if constexpr (kPacked) {
+      return ProtoBuffer::LengthDelimitedSize<Number>(PackedSize(v));
+    } else {
+      size_t size = 0;
+      for (const Type &e : v) {
+        size += Codec::template ProtoSize<Number>(e);
+      }
+      return size;
+    }
+  }
+
+  static absl::Status WriteProto(ProtoBuffer &buffer,
+                                 const std::vector<Type> &v) {
+    if (v.empty()) {
+      return absl::OkStatus();
+    }
+    if constexpr (kPacked) {
+      if constexpr (Codec::kFixedSize) {
+        return buffer.SerializeLengthDelimited<Number>(
+            reinterpret_cast<const char *>(v.data()), v.size() * sizeof(Type));
+      } else {
+        if (absl::Status status =
+                buffer.SerializeLengthDelimitedHeader<Number>(PackedSize(v));
+            !status.ok()) {
+          return status;
+        }
+        for (Type e : v) {
+          if (absl::Status status =
+                  buffer.SerializeRawVarint<Type, Codec::kSigned>(e);
+              !status.ok()) {
+            return status;
+          }
+        }
+        return absl::OkStatus();
+      }
+    } else {
+      for (const Type &e : v) {
+        if (absl::Status status = Codec::template WriteProto<Number>(buffer, e);
+            !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
+    }
+  }
+
+  // Parse one occurrence of the field, whose tag has been read.
+  static absl::Status ParseProto(ProtoBuffer &buffer, uint32_t tag,
+                                 std::vector<Type> &v) {
+    if constexpr (IsPackable<Codec>::value) {
+      if (WireType(tag & 7) == WireType::kLengthDelimited) {
+        absl::StatusOr<absl::Span<char>> data =
+            buffer.DeserializeLengthDelimited();
+        if (!data.ok()) {
+          return data.status();
+        }
+        ProtoBuffer sub_buffer(*data);
+        while (!sub_buffer.Eof()) {
+          if (absl::Status status =
+                  Codec::ParseProto(sub_buffer, v.emplace_back());
+              !status.ok()) {
+            return status;
+          }
+        }
+        return absl::OkStatus();
+      }
+    }
+    return Codec::ParseProto(buffer, v.emplace_back());
+  }
+
+private:
+  static size_t PackedSize(const std::vector<Type> &v) {
+    if constexpr (Codec::kFixedSize) {
+      return v.size() * sizeof(Type);
+    } else {
+      size_t size = 0;
+      for (Type e : v) {
+        size += ProtoBuffer::VarintSize<Type, Codec::kSigned>(e);
+      }
+      return size;
+    }
+  }
+};
+
+// A google.protobuf.Any.  The value is kept as serialized protobuf.
+struct AnyStruct {
+  std::string type_url;
+  std::string value;
+
+  size_t SerializedProtoSize() const {
+    size_t size = 0;
+    if (!type_url.empty()) {
+      size += OwnedStringCodec::ProtoSize<1>(type_url);
+    }
+    if (!value.empty()) {
+      size += OwnedStringCodec::ProtoSize<2>(value);
+    }
+    return size;
+  }
+
+  absl::Status WriteProto(ProtoBuffer &buffer) const {
+    if (!type_url.empty()) {
+      if (absl::Status status =
+              OwnedStringCodec::WriteProto<1>(buffer, type_url);
+          !status.ok()) {
+        return status;
+      }
+    }
+    if (!value.empty()) {
+      return OwnedStringCodec::WriteProto<2>(buffer, value);
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status ParseProto(ProtoBuffer &buffer) {
+    while (!buffer.Eof()) {
+      absl::StatusOr<uint32_t> tag = buffer.DeserializeTag();
+      if (!tag.ok()) {
+        return tag.status();
+      }
+      absl::Status status;
+      switch (*tag >> ProtoBuffer::kFieldIdShift) {
+      case 1:
+        status = OwnedStringCodec::ParseProto(buffer, type_url);
+        break;
+      case 2:
+        status = OwnedStringCodec::ParseProto(buffer, value);
+        break;
+      default:
+        status = buffer.SkipTag(*tag);
+        break;
+      }
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+};
+
+// google.protobuf.StringValue and BytesValue.  The other well-known types
+// hold no strings so the structs use the sato messages for them.
+struct StringValueStruct {
+  std::string value;
+
+  size_t SerializedProtoSize() const {
+    return value.empty() ? 0 : OwnedStringCodec::ProtoSize<1>(value);
+  }
+
+  absl::Status WriteProto(ProtoBuffer &buffer) const {
+    if (value.empty()) {
+      return absl::OkStatus();
+    }
+    return OwnedStringCodec::WriteProto<1>(buffer, value);
+  }
+
+  absl::Status ParseProto(ProtoBuffer &buffer) {
+    while (!buffer.Eof()) {
+      absl::StatusOr<uint32_t> tag = buffer.DeserializeTag();
+      if (!tag.ok()) {
+        return tag.status();
+      }
+      absl::Status status = (*tag >> ProtoBuffer::kFieldIdShift) == 1
+                                ? OwnedStringCodec::ParseProto(buffer, value)
+                                : buffer.SkipTag(*tag);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+};
+
+} // namespace sato
@@ -6,10 +6,19 @@
 #include <iostream>
 
 // #include "sato/runtime/any.h"
+#include "sato/runtime/blob.h"
+#include "sato/runtime/constant.h"
 #include "sato/runtime/fields.h"
+#include "sato/runtime/lazy.h"
+#include "sato/runtime/map.h"
 #include "sato/runtime/mux.h"
+#include "sato/runtime/pool.h"
+#include "sato/runtime/ros_struct.h"
 #include "sato/runtime/any.h"
+#include "sato/runtime/stream.h"
 #include "sato/runtime/union.h"
 #include "sato/runtime/vectors.h"
+#include "sato/runtime/view.h"
+#include "sato/runtime/well_known.h"
 #include "toolbelt/hexdump.h"
 
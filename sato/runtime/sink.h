@@ -0,0 +1,81 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Output sinks for streaming serialization.
+//
+// A ROSBuffer or ProtoBuffer that is constructed with a sink holds only a
+// bounded chunk of memory.  When the chunk fills up it is flushed to the
+// sink and reused, so a message of any size can be serialized to a file,
+// pipe or socket in constant memory.  Large payloads (strings and bytes
+// bigger than the chunk) are passed straight through to the sink without
+// being copied into the chunk.
+//
+// Both the ROS and protobuf formats only need to know the size of
+// something before it is written (string lengths, array counts and the
+// precomputed SerializedProtoSize for nested messages), so nothing ever
+// needs to be patched after it has been flushed.
+
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include <errno.h>
+#include <functional>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace sato {
+
+class OutputSink {
+public:
+  virtual ~OutputSink() = default;
+
+  // Write all of the data to the sink.
+  virtual absl::Status Write(const char *data, size_t length) = 0;
+};
+
+// Sink that writes to a file descriptor (file, pipe or socket).  The
+// file descriptor is not owned by the sink.
+class FileDescriptorSink : public OutputSink {
+public:
+  explicit FileDescriptorSink(int fd) : fd_(fd) {}
+
+  absl::Status Write(const char *data, size_t length) override {
+    while (length > 0) {
+      ssize_t n = ::write(fd_, data, length);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return absl::InternalError(absl::StrFormat(
+            "Failed to write to fd %d: %s", fd_, strerror(errno)));
+      }
+      data += n;
+      length -= size_t(n);
+    }
+    return absl::OkStatus();
+  }
+
+private:
+  int fd_;
+};
+
+// Sink that calls a function for each chunk.  This can be used to write
+// into a ring buffer or to hand the chunks to a transport.
+class CallbackSink : public OutputSink {
+public:
+  using Callback = std::function<absl::Status(const char *data, size_t length)>;
+
+  explicit CallbackSink(Callback callback) : callback_(std::move(callback)) {}
+
+  absl::Status Write(const char *data, size_t length) override {
+    return callback_(data, length);
+  }
+
+private:
+  Callback callback_;
+};
+
+} // namespace sato
@@ -0,0 +1,305 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Resumable (push) parser for serialized protobuf messages.
+//
+// The serialized message is fed to the parser in chunks as it arrives from
+// the network or disk.  The parser is a state machine that can suspend at
+// any byte boundary, including in the middle of a tag, a varint or a length
+// delimited field.  As soon as a top level field is complete it is handed to
+// the message's ParseProtoField function, so the conversion work is
+// interleaved with the I/O rather than being done after all the data has
+// arrived.
+//
+// Fields that are split across chunks are reassembled in memory owned by the
+// parser.  Since the sato fields refer to the data without copying it (string
+// fields are std::string_views), all completed fields are copied into blocks
+// owned by the parser and the parser must outlive any use of the message.
+// Fields that are not projected or that the message doesn't have are
+// skipped without being buffered.
+//
+// A length delimited field can't be checked against the size of the input as
+// it can in a ProtoBuffer, so fields longer than a maximum size are rejected
+// before any memory is allocated for them.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "sato/runtime/message.h"
+#include "sato/runtime/protobuf.h"
+#include "sato/runtime/ros.h"
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+namespace sato {
+
+class ProtoStreamParser {
+public:
+  static constexpr size_t kDefaultBlockSize = 4096;
+  static constexpr size_t kDefaultMaxFieldSize = 64 * 1024 * 1024;
+
+  explicit ProtoStreamParser(Message &msg,
+                             size_t block_size = kDefaultBlockSize,
+                             size_t max_field_size = kDefaultMaxFieldSize)
+      : msg_(msg), block_size_(block_size), max_field_size_(max_field_size) {}
+
+  // Feed the next chunk of the serialized message into the parser.  The
+  // chunk does not need to be kept alive after this returns.
+  absl::Status Feed(const char *data, size_t length) {
+    if (!started_) {
+      if (msg_.IsPopulated()) {
+        return absl::InvalidArgumentError("Message has already been parsed");
+      }
+      msg_.SetPopulated(true);
+      started_ = true;
+    }
+    const char *end = data + length;
+    while (data < end) {
+      switch (state_) {
+      case State::kTag: {
+        uint8_t byte = uint8_t(*data++);
+        varint_ |= uint64_t(byte & 0x7f) << shift_;
+        shift_ += 7;
+        if ((byte & 0x80) != 0) {
+          if (shift_ >= 35) {
+            return absl::InternalError("Tag varint too long");
+          }
+          break;
+        }
+        tag_ = uint32_t(varint_);
+        varint_ = 0;
+        shift_ = 0;
+        if (absl::Status status = StartField(); !status.ok()) {
+          return status;
+        }
+        break;
+      }
+
+      case State::kVarint: {
+        uint8_t byte = uint8_t(*data++);
+        scratch_[scratch_length_++] = char(byte);
+        if ((byte & 0x80) == 0) {
+          if (absl::Status status = Complete(scratch_, scratch_length_);
+              !status.ok()) {
+            return status;
+          }
+        } else if (scratch_length_ == sizeof(scratch_)) {
+          return absl::InternalError("Varint too long");
+        }
+        break;
+      }
+
+      case State::kFixed: {
+        size_t n = std::min(size_t(end - data), field_length_ - field_pos_);
+        memcpy(scratch_ + field_pos_, data, n);
+        data += n;
+        field_pos_ += n;
+        if (field_pos_ == field_length_) {
+          if (absl::Status status = Complete(scratch_, field_length_);
+              !status.ok()) {
+            return status;
+          }
+        }
+        break;
+      }
+
+      case State::kLength: {
+        uint8_t byte = uint8_t(*data++);
+        scratch_[scratch_length_++] = char(byte);
+        varint_ |= uint64_t(byte & 0x7f) << shift_;
+        shift_ += 7;
+        if ((byte & 0x80) != 0) {
+          if (shift_ >= 35) {
+            return absl::InternalError("Length varint too long");
+          }
+          break;
+        }
+        if (skip_) {
+          field_length_ = size_t(varint_);
+          field_pos_ = 0;
+          varint_ = 0;
+          shift_ = 0;
+          state_ = field_length_ == 0 ? State::kTag : State::kSkip;
+          break;
+        }
+        if (varint_ > max_field_size_) {
+          return absl::InvalidArgumentError(absl::StrFormat(
+              "Field %d has length %d, more than the maximum of %d",
+              tag_ >> ProtoBuffer::kFieldIdShift, varint_, max_field_size_));
+        }
+        // The field contains the length followed by the payload so that it
+        // can be parsed by the regular field parsers.
+        field_length_ = scratch_length_ + size_t(varint_);
+        field_ = Allocate(field_length_);
+        memcpy(field_, scratch_, scratch_length_);
+        field_pos_ = scratch_length_;
+        varint_ = 0;
+        shift_ = 0;
+        if (field_pos_ == field_length_) {
+          if (absl::Status status = Dispatch(field_, field_length_);
+              !status.ok()) {
+            return status;
+          }
+          break;
+        }
+        state_ = State::kPayload;
+        break;
+      }
+
+      case State::kPayload: {
+        size_t n = std::min(size_t(end - data), field_length_ - field_pos_);
+        memcpy(field_ + field_pos_, data, n);
+        data += n;
+        field_pos_ += n;
+        if (field_pos_ == field_length_) {
+          if (absl::Status status = Dispatch(field_, field_length_);
+              !status.ok()) {
+            return status;
+          }
+        }
+        break;
+      }
+
+      case State::kSkip: {
+        size_t n = std::min(size_t(end - data), field_length_ - field_pos_);
+        data += n;
+        field_pos_ += n;
+        if (field_pos_ == field_length_) {
+          state_ = State::kTag;
+        }
+        break;
+      }
+      }
+    }
+    bytes_consumed_ += length;
+    return absl::OkStatus();
+  }
+
+  absl::Status Feed(std::string_view data) {
+    return Feed(data.data(), data.size());
+  }
+
+  // Signal the end of the serialized message.  It is an error if the
+  // message ends in the middle of a field.
+  absl::Status Finish() {
+    if (state_ != State::kTag || shift_ != 0) {
+      return absl::InternalError(absl::StrFormat(
+          "Serialized message truncated after %d bytes", bytes_consumed_));
+    }
+    if (!started_) {
+      // Empty message.
+      return Feed(nullptr, 0);
+    }
+    return absl::OkStatus();
+  }
+
+  // Finish the message and write it in ROS format.
+  absl::Status Finish(ROSBuffer &ros_buffer, uint64_t timestamp = 0) {
+    if (absl::Status status = Finish(); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = msg_.WriteROS(ros_buffer, timestamp);
+        !status.ok()) {
+      return status;
+    }
+    return ros_buffer.Flush();
+  }
+
+  // Are we between fields?
+  bool AtFieldBoundary() const { return state_ == State::kTag && shift_ == 0; }
+
+  size_t BytesConsumed() const { return bytes_consumed_; }
+
+private:
+  enum class State {
+    kTag,     // Reading the tag varint.
+    kVarint,  // Reading a varint value.
+    kFixed,   // Reading a 4 or 8 byte fixed value.
+    kLength,  // Reading the length of a length delimited field.
+    kPayload, // Reading the payload of a length delimited field.
+    kSkip,    // Skipping the payload of a length delimited field.
+  };
+
+  absl::Status StartField() {
+    scratch_length_ = 0;
+    field_pos_ = 0;
+    int field_number = int(tag_ >> ProtoBuffer::kFieldIdShift);
+    skip_ =
+        !msg_.IsProjected(field_number) || !msg_.HasProtoField(field_number);
+    switch (WireType(tag_ & ProtoBuffer::kWireTypeMask)) {
+    case WireType::kVarint:
+      state_ = State::kVarint;
+      break;
+    case WireType::kFixed64:
+      field_length_ = 8;
+      state_ = State::kFixed;
+      break;
+    case WireType::kFixed32:
+      field_length_ = 4;
+      state_ = State::kFixed;
+      break;
+    case WireType::kLengthDelimited:
+      state_ = State::kLength;
+      break;
+    default:
+      return absl::InternalError("Unsupported wire type");
+    }
+    return absl::OkStatus();
+  }
+
+  // A varint or fixed value is complete.
+  absl::Status Complete(char *data, size_t length) {
+    if (skip_) {
+      state_ = State::kTag;
+      return absl::OkStatus();
+    }
+    return Dispatch(data, length);
+  }
+
+  absl::Status Dispatch(char *data, size_t length) {
+    state_ = State::kTag;
+    ProtoBuffer buffer(data, length);
+    return msg_.ParseProtoField(tag_, buffer);
+  }
+
+  // Allocate memory that will not move for the lifetime of the parser.
+  char *Allocate(size_t n) {
+    if (n > size_t(block_end_ - block_pos_)) {
+      size_t size = std::max(n, block_size_);
+      blocks_.push_back(std::make_unique<char[]>(size));
+      block_pos_ = blocks_.back().get();
+      block_end_ = block_pos_ + size;
+    }
+    char *p = block_pos_;
+    block_pos_ += n;
+    return p;
+  }
+
+  Message &msg_;
+  size_t block_size_;
+  size_t max_field_size_;
+  bool started_ = false;
+  bool skip_ = false; // The current field is not parsed.
+  State state_ = State::kTag;
+  uint64_t varint_ = 0;
+  int shift_ = 0;
+  uint32_t tag_ = 0;
+  char scratch_[10]; // Varint or fixed value being assembled.
+  size_t scratch_length_ = 0;
+  char *field_ = nullptr; // Length delimited field being assembled.
+  size_t field_length_ = 0;
+  size_t field_pos_ = 0;
+  size_t bytes_consumed_ = 0;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *block_pos_ = nullptr;
+  char *block_end_ = nullptr;
+};
+
+} // namespace sato
@@ -14,14 +14,15 @@
 #include <string>
 #include <string_view>
 #include <tuple>
-#include <vector>
+#include <utility>
+#include <variant>
 
 namespace sato {
 
 // Primitive union fields are just regular primitive fields.
 #define DEFINE_PRIMITIVE_UNION_FIELD(cname, type)                              \
-  template <bool FixedSize = false, bool Signed = false>                       \
-  using Union##cname##Field = cname##Field<FixedSize, Signed>;
+  template <int FieldNumber, bool FixedSize = false, bool Signed = false>      \
+  using Union##cname##Field = cname##Field<FieldNumber, FixedSize, Signed>;
 
 DEFINE_PRIMITIVE_UNION_FIELD(Int32, int32_t)
 DEFINE_PRIMITIVE_UNION_FIELD(Uint32, uint32_t)
@@ -33,23 +34,22 @@ DEFINE_PRIMITIVE_UNION_FIELD(Bool, bool)
 
 #undef DEFINE_PRIMITIVE_UNION_FIELD
 
-using UnionStringField = StringField;
+template <int FieldNumber> using UnionStringField = StringField<FieldNumber>;
 // The union contains an offset to the string data (length and bytes).
 
 // Messages within unions are fields but they are encoded as an array of
 // messages in ROS format so that they can be omitted if they are not present.
-template <typename MessageType> class UnionMessageField : public Field {
+template <int FieldNumber, typename MessageType>
+class UnionMessageField : public Field<FieldNumber> {
 public:
-  UnionMessageField() {}
-
   size_t SerializedProtoSize() const {
-    return ProtoBuffer::LengthDelimitedSize(Number(),
-                                            msg_.SerializedProtoSize());
+    return ProtoBuffer::LengthDelimitedSize<FieldNumber>(
+        msg_.SerializedProtoSize());
   }
 
   size_t SerializedROSSize() const {
-    size_t size = 4; // 4 bytes for the discriminator
-    if (msg_.IsPresent()) {
+    size_t size = 4; // 4 bytes for the array size
+    if (present_) {
       size += msg_.SerializedROSSize();
     }
     return size;
@@ -60,7 +60,7 @@ public:
   }
 
   absl::Status WriteROS(ROSBuffer &buffer) const {
-    int array_size = msg_.IsPresent() ? 1 : 0;
+    int array_size = present_ ? 1 : 0;
     if (absl::Status status = Write(buffer, array_size); !status.ok()) {
       return status;
     }
@@ -71,6 +71,7 @@ public:
   }
 
   absl::Status ParseProto(ProtoBuffer &buffer) {
+    present_ = true;
     return msg_.ParseProto(buffer);
   }
 
@@ -80,40 +81,63 @@ public:
       return status;
     }
     if (array_size > 0) {
+      present_ = true;
       return msg_.ParseROS(buffer);
     }
     return absl::OkStatus();
   }
 
+  // Skip an inactive member.
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    int array_size = 0;
+    if (absl::Status status = Read(buffer, array_size); !status.ok()) {
+      return status;
+    }
+    if (array_size > 0) {
+      return MessageType::SkipROS(buffer);
+    }
+    return absl::OkStatus();
+  }
+
+  bool HasValue() const { return present_; }
+
+  const MessageType &Get() const { return msg_.Get(); }
+  MessageType *Mutable() {
+    present_ = true;
+    return msg_.Mutable();
+  }
+
 private:
-  MessageField<MessageType> msg_;
-}; // namespace sato
+  MessageField<FieldNumber, MessageType> msg_;
+  bool present_ = false; // This is the active member of the union.
+};
 
-template <typename... T> class UnionField : public Field {
+// A oneof.  Only the active member is stored (in a variant) and the field
+// numbers are part of the member types so there is nothing to set up at
+// construction.  In ROS format all members are expanded inline, so the
+// inactive ones are written with their default value.
+template <typename... T> class UnionField {
 public:
+  template <size_t I>
+  using MemberType = std::tuple_element_t<I, std::tuple<T...>>;
+
   UnionField() = default;
-  UnionField(std::vector<int> field_numbers)
-      : Field(0), field_numbers_(field_numbers) {
-    size_t i = 0;
-    std::apply(
-        [&](auto &...args) { (args.SetNumber(field_numbers_[i++]), ...); },
-        value_);
+
+  int32_t Discriminator() const {
+    size_t index = value_.index();
+    return index == 0 ? 0 : kFieldNumbers[index - 1];
   }
 
-  int32_t Discriminator() const { return discriminator_; }
+  // Make no member active.
+  void Clear() { value_.template emplace<0>(); }
 
   template <int Id> size_t SerializedProtoSize() const {
-    return std::get<Id>(value_).SerializedProtoSize();
+    return std::get<Id + 1>(value_).SerializedProtoSize();
   }
 
   size_t SerializedROSSize() const {
-    size_t size = 4; // 4 bytes for the discriminator
-    // Iterate through all tuple elements at runtime and call SerializedROSSize
-    // on each
-    std::apply(
-        [&](auto &...args) { size += (args.SerializedROSSize() + ... + 0); },
-        value_);
-    return size;
+    // 4 bytes for the discriminator.
+    return 4 + SerializedROSSize(std::index_sequence_for<T...>());
   }
 
   absl::Status WriteDiscriminator(ROSBuffer &buffer) const {
@@ -121,53 +145,97 @@ public:
   }
 
   template <int Id> absl::Status WriteProto(ProtoBuffer &buffer) const {
-    if (std::get<Id>(value_).IsPresent()) {
-      return std::get<Id>(value_).WriteProto(buffer);
+    if (value_.index() == Id + 1) {
+      return std::get<Id + 1>(value_).WriteProto(buffer);
     }
     return absl::OkStatus();
   }
 
   template <int Id> absl::Status ParseProto(ProtoBuffer &buffer) {
-    if (absl::Status status = std::get<Id>(value_).ParseProto(buffer);
-        !status.ok()) {
-      return status;
+    if (value_.index() != Id + 1) {
+      value_.template emplace<Id + 1>();
     }
-    discriminator_ = field_numbers_[Id];
-    return absl::OkStatus();
+    return std::get<Id + 1>(value_).ParseProto(buffer);
   }
 
   absl::Status WriteROS(ROSBuffer &buffer) const {
-    // Write the discrimintor and then the contents of the value tuple
+    // Write the discriminator and then all the members.
     if (absl::Status status = Write(buffer, Discriminator()); !status.ok()) {
       return status;
     }
-    // Iterate through all tuple elements at runtime and call WriteROS on each
+    return WriteROS(buffer, std::index_sequence_for<T...>());
+  }
+
+  // Skip the discriminator and all the members.
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    if (absl::Status status = SkipValues<int32_t>(buffer); !status.ok()) {
+      return status;
+    }
     absl::Status result = absl::OkStatus();
-    std::apply(
-        [&](auto &...args) {
-          ((result = args.WriteROS(buffer), result.ok()) && ...);
-        },
-        value_);
+    ((result = T::SkipROS(buffer), result.ok()) && ...);
     return result;
   }
 
   absl::Status ParseROS(ROSBuffer &buffer) {
-    if (absl::Status status = Read(buffer, discriminator_); !status.ok()) {
+    int32_t discriminator = 0;
+    if (absl::Status status = Read(buffer, discriminator); !status.ok()) {
       return status;
     }
-    // Iterate through all tuple elements at runtime and call ParseROS on each
+    value_.template emplace<0>();
+    return ParseROS(buffer, discriminator, std::index_sequence_for<T...>());
+  }
+
+  // A member, which is the default value if it's not active.
+  template <size_t I> const MemberType<I> &Get() const { return Value<I>(); }
+
+  // Make a member active and return it.
+  template <size_t I> MemberType<I> *Mutable() {
+    if (value_.index() != I + 1) {
+      value_.template emplace<I + 1>();
+    }
+    return &std::get<I + 1>(value_);
+  }
+
+private:
+  static constexpr int kFieldNumbers[] = {T::kNumber...};
+
+  // The value of a member, which is the default value if it's not active.
+  template <size_t I> const MemberType<I> &Value() const {
+    if (value_.index() == I + 1) {
+      return std::get<I + 1>(value_);
+    }
+    static const MemberType<I> default_value;
+    return default_value;
+  }
+
+  template <size_t... I>
+  size_t SerializedROSSize(std::index_sequence<I...>) const {
+    return (Value<I>().SerializedROSSize() + ... + 0);
+  }
+
+  template <size_t... I>
+  absl::Status WriteROS(ROSBuffer &buffer, std::index_sequence<I...>) const {
     absl::Status result = absl::OkStatus();
-    std::apply(
-        [&](auto &...args) {
-          ((result = args.ParseROS(buffer), result.ok()) && ...);
-        },
-        value_);
+    ((result = Value<I>().WriteROS(buffer), result.ok()) && ...);
     return result;
   }
 
-private:
-  std::vector<int> field_numbers_; // field number for each tuple type
-  int discriminator_;
-  std::tuple<T...> value_;
+  template <size_t... I>
+  absl::Status ParseROS(ROSBuffer &buffer, int32_t discriminator,
+                        std::index_sequence<I...>) {
+    absl::Status result = absl::OkStatus();
+    ((result = ParseROSMember<I>(buffer, discriminator), result.ok()) && ...);
+    return result;
+  }
+
+  template <size_t I>
+  absl::Status ParseROSMember(ROSBuffer &buffer, int32_t discriminator) {
+    if (MemberType<I>::kNumber != discriminator) {
+      return MemberType<I>::SkipROS(buffer);
+    }
+    return value_.template emplace<I + 1>().ParseROS(buffer);
+  }
+
+  std::variant<std::monostate, T...> value_;
 };
 } // namespace sato
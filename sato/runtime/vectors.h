@@ -9,8 +9,13 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/base/optimization.h"
+#include "absl/strings/str_format.h"
+#include "sato/runtime/fields.h"
+#include "sato/runtime/message.h"
 #include "sato/runtime/protobuf.h"
 #include "sato/runtime/ros.h"
+#include <algorithm>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string>
@@ -25,13 +30,10 @@ class ROSBuffer;
 // This is a variable length vector of T.  It looks like a std::vector<T>.
 // The binary message contains a toolbelt::VectorHeader at the binary offset.
 // This contains the number of elements and the base offset for the data.
-template <typename T, bool FixedSize = false, bool Signed = false,
-          bool Packed = true>
-class PrimitiveVectorField : public Field {
+template <int FieldNumber, typename T, bool FixedSize = false,
+          bool Signed = false, bool Packed = true>
+class PrimitiveVectorField : public Field<FieldNumber> {
 public:
-  PrimitiveVectorField() = default;
-  explicit PrimitiveVectorField(int number) : Field(number) {}
-
   size_t SerializedProtoSize() const {
     size_t sz = values_.size();
     if (sz == 0) {
@@ -42,29 +44,28 @@ public:
     // Packed is default in proto3 but optional in proto2.
     if constexpr (Packed) {
       if constexpr (FixedSize) {
-        return ProtoBuffer::LengthDelimitedSize(Number(), sz * sizeof(T));
+        return ProtoBuffer::LengthDelimitedSize<FieldNumber>(sz * sizeof(T));
       } else {
         for (size_t i = 0; i < sz; i++) {
           length += ProtoBuffer::VarintSize<T, Signed>(values_[i]);
         }
-        return ProtoBuffer::LengthDelimitedSize(Number(), length);
+        return ProtoBuffer::LengthDelimitedSize<FieldNumber>(length);
       }
     }
 
     // Not packed, just a sequence of individual fields, all with the same
     // tag.
     if constexpr (FixedSize) {
-      length += sz * (ProtoBuffer::TagSize(Number(),
-                                           ProtoBuffer::FixedWireType<T>()) +
+      length += sz * (ProtoBuffer::TagSize<FieldNumber,
+                                           ProtoBuffer::FixedWireType<T>()>() +
                       sizeof(T));
     } else {
       for (size_t i = 0; i < sz; i++) {
-        length += ProtoBuffer::TagSize(Number(), WireType::kVarint) +
+        length += ProtoBuffer::TagSize<FieldNumber, WireType::kVarint>() +
                   ProtoBuffer::VarintSize<T, Signed>(values_[i]);
       }
     }
-
-    return ProtoBuffer::LengthDelimitedSize(Number(), length);
+    return length;
   }
   size_t SerializedROSSize() const { return 4 + values_.size() * sizeof(T); }
 
@@ -77,9 +78,8 @@ public:
     // Packed is default in proto3 but optional in proto2.
     if constexpr (Packed) {
       if constexpr (FixedSize) {
-        return buffer.SerializeLengthDelimited(
-            Number(), reinterpret_cast<const char *>(values_.data()),
-            sz * sizeof(T));
+        return buffer.SerializeLengthDelimited<FieldNumber>(
+            reinterpret_cast<const char *>(values_.data()), sz * sizeof(T));
       } else {
         size_t length = 0;
         for (size_t i = 0; i < sz; i++) {
@@ -87,7 +87,7 @@ public:
         }
 
         if (absl::Status status =
-                buffer.SerializeLengthDelimitedHeader(Number(), length);
+                buffer.SerializeLengthDelimitedHeader<FieldNumber>(length);
             !status.ok()) {
           return status;
         }
@@ -108,7 +108,7 @@ public:
     if constexpr (FixedSize) {
       for (size_t i = 0; i < sz; i++) {
         if (absl::Status status =
-                buffer.SerializeFixed<T>(Number(), values_[i]);
+                buffer.SerializeFixed<FieldNumber, T>(values_[i]);
             !status.ok()) {
           return status;
         }
@@ -116,7 +116,7 @@ public:
     } else {
       for (size_t i = 0; i < sz; i++) {
         if (absl::Status status =
-                buffer.SerializeVarint<T, Signed>(Number(), values_[i]);
+                buffer.SerializeVarint<FieldNumber, T, Signed>(values_[i]);
             !status.ok()) {
           return status;
         }
@@ -169,58 +169,196 @@ public:
     return absl::OkStatus();
   }
 
-  absl::Status ParseROS(ROSBuffer &buffer) {
-    if (absl::Status status = Read(buffer, values_); !status.ok()) {
+  absl::Status ParseROS(ROSBuffer &buffer) { return Read(buffer, values_); }
+
+  bool HasValue() const { return !values_.empty(); }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    uint32_t num_elements = 0;
+    if (absl::Status status = Read(buffer, num_elements); !status.ok()) {
       return status;
     }
-    present_ = values_.size() > 0;
-    return absl::OkStatus();
+    return SkipValues<T>(buffer, num_elements);
   }
 
-private:
+  size_t size() const { return values_.size(); }
+  void Reserve(size_t n) { values_.reserve(n); }
+  T Get(size_t i) const { return values_[i]; }
+  void Set(size_t i, T v) { values_[i] = v; }
+  void Add(T v) { values_.push_back(v); }
+
+protected:
   std::vector<T> values_;
 };
-template <typename T> class MessageVectorField : public Field {
+
+// A repeated numeric field with (sato.ros_fixed_size) = N.  In ROS it is the
+// fixed size array T[N] with no count so it can be copied in one go and the
+// message can have a fixed layout.  Only the first N elements are written
+// and missing ones are zero, so it always has N elements when parsed from
+// ROS.
+template <int FieldNumber, typename T, bool FixedSize, bool Signed,
+          bool Packed, size_t N>
+class FixedArrayField
+    : public PrimitiveVectorField<FieldNumber, T, FixedSize, Signed, Packed> {
 public:
-  MessageVectorField() = default;
-  explicit MessageVectorField(int number) : Field(number) {}
+  size_t SerializedROSSize() const { return N * sizeof(T); }
+
+  absl::Status WriteROS(ROSBuffer &buffer) const {
+    if (absl::Status status = CheckROSFixed(); !status.ok()) {
+      return status;
+    }
+    if (ABSL_PREDICT_TRUE(buffer.HasFixedLayout())) {
+      if (absl::Status status = buffer.HasSpaceFor(N * sizeof(T));
+          !status.ok()) {
+        return status;
+      }
+      WriteROSFixed(buffer.Addr());
+      buffer.Addr() += N * sizeof(T);
+      return absl::OkStatus();
+    }
+    for (size_t i = 0; i < N; i++) {
+      T v = i < this->values_.size() ? this->values_[i] : T{};
+      if (absl::Status status = Write(buffer, v); !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) {
+    if (ABSL_PREDICT_TRUE(buffer.HasFixedLayout())) {
+      if (absl::Status status = buffer.Check(N * sizeof(T)); !status.ok()) {
+        return status;
+      }
+      ParseROSFixed(buffer.Addr());
+      buffer.Addr() += N * sizeof(T);
+      return absl::OkStatus();
+    }
+    this->values_.resize(N);
+    for (size_t i = 0; i < N; i++) {
+      if (absl::Status status = Read(buffer, this->values_[i]);
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
 
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    return SkipValues<T>(buffer, N);
+  }
+
+  // Short arrays are padded with zeros but elements past N can't be written.
+  // WriteROSFixed assumes this has been checked.
+  absl::Status CheckROSFixed() const {
+    if (ABSL_PREDICT_FALSE(this->values_.size() > N)) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Field %d has %d elements but its ROS array has a fixed size of %d",
+          FieldNumber, this->values_.size(), N));
+    }
+    return absl::OkStatus();
+  }
+
+  void WriteROSFixed(char *addr) const {
+    size_t n = this->values_.size();
+    memcpy(addr, this->values_.data(), n * sizeof(T));
+    memset(addr + n * sizeof(T), 0, (N - n) * sizeof(T));
+  }
+
+  void ParseROSFixed(const char *addr) {
+    this->values_.resize(N);
+    memcpy(this->values_.data(), addr, N * sizeof(T));
+  }
+};
+
+// Number of elements ahead to prefetch in the write loops.
+constexpr size_t kPrefetchDistance = 4;
+
+// Maximum number of elements to reserve based on a count in a ROS buffer.
+// The count comes from the wire so we don't trust it too much.
+constexpr size_t kMaxROSReserve = 64 * 1024;
+
+inline void Prefetch(const void *p) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(p);
+#endif
+}
+
+// Repeated message field.  The messages are stored directly in the vector.
+template <int FieldNumber, typename T>
+class MessageVectorField : public Field<FieldNumber> {
+public:
   size_t SerializedProtoSize() const {
     size_t length = 0;
-    for (size_t i = 0; i < msgs_.size(); i++) {
-      length += msgs_[i].SerializedProtoSize();
+    for (const T &msg : msgs_) {
+      length += ProtoBuffer::LengthDelimitedSize<FieldNumber>(
+          msg.SerializedProtoSize());
     }
     return length;
   }
-  size_t SerializedROSSize() const { 
-    size_t length = 0;
-    for (size_t i = 0; i < msgs_.size(); i++) {
-      length += msgs_[i].SerializedROSSize();
+  size_t SerializedROSSize() const {
+    if constexpr (HasFixedROSSize<T>::value) {
+      return 4 + msgs_.size() * T::kFixedROSSize;
+    } else {
+      size_t length = 0;
+      for (const T &msg : msgs_) {
+        length += msg.SerializedROSSize();
+      }
+      return 4 + length;
     }
-    return 4 + length;
   }
 
   absl::Status WriteProto(ProtoBuffer &buffer) const {
     size_t sz = msgs_.size();
-    if (sz == 0) {
-      return absl::OkStatus();
-    }
-
-    for (const auto &msg : msgs_) {
+    for (size_t i = 0; i < sz; i++) {
+      if (i + kPrefetchDistance < sz) {
+        Prefetch(&msgs_[i + kPrefetchDistance]);
+      }
+      const T &msg = msgs_[i];
+      if (absl::Status status =
+              buffer.SerializeLengthDelimitedHeader<FieldNumber>(
+                  msg.SerializedProtoSize());
+          !status.ok()) {
+        return status;
+      }
       if (absl::Status status = msg.WriteProto(buffer); !status.ok()) {
         return status;
       }
     }
     return absl::OkStatus();
   }
+
   absl::Status WriteROS(ROSBuffer &buffer) const {
-    if (absl::Status status =
-            Write(buffer, static_cast<uint32_t>(msgs_.size()));
+    size_t sz = msgs_.size();
+    if (absl::Status status = Write(buffer, static_cast<uint32_t>(sz));
         !status.ok()) {
       return status;
     }
-    for (const auto &msg : msgs_) {
-      if (absl::Status status = msg.WriteROS(buffer); !status.ok()) {
+    if constexpr (HasFixedROSSize<T>::value) {
+      // Fixed layout messages are written back to back after a single
+      // space check.
+      if (ABSL_PREDICT_TRUE(buffer.HasFixedLayout())) {
+        if (absl::Status status = buffer.HasSpaceFor(sz * T::kFixedROSSize);
+            !status.ok()) {
+          return status;
+        }
+        char *addr = buffer.Addr();
+        for (const T &msg : msgs_) {
+          if (absl::Status status = msg.CheckROSFixed(); !status.ok()) {
+            return status;
+          }
+          msg.WriteROSFixed(addr);
+          addr += T::kFixedROSSize;
+        }
+        buffer.Addr() = addr;
+        return absl::OkStatus();
+      }
+    }
+    for (size_t i = 0; i < sz; i++) {
+      if (i + kPrefetchDistance < sz) {
+        Prefetch(&msgs_[i + kPrefetchDistance]);
+      }
+      if (absl::Status status = msgs_[i].WriteROS(buffer); !status.ok()) {
         return status;
       }
     }
@@ -228,63 +366,137 @@ public:
   }
 
   absl::Status ParseProto(ProtoBuffer &buffer) {
-    msgs_.push_back(MessageField<T>(Number()));
-    if (absl::Status status = msgs_.back().ParseProto(buffer); !status.ok()) {
-      return status;
+    if (msgs_.empty()) {
+      // First one, count the rest so that we only allocate once.
+      msgs_.reserve(buffer.CountFields(kTag));
     }
-    return absl::OkStatus();
+    absl::StatusOr<absl::Span<char>> s = buffer.DeserializeLengthDelimited();
+    if (!s.ok()) {
+      return s.status();
+    }
+    return ParseProtoElement(*s);
+  }
+
+  // Parse the bytes of one element and append it.
+  absl::Status ParseProtoElement(absl::Span<char> bytes) {
+    ProtoBuffer sub_buffer(bytes);
+    return msgs_.emplace_back().ParseProto(sub_buffer);
   }
 
+  void Reserve(size_t n) { msgs_.reserve(n); }
+
+  size_t size() const { return msgs_.size(); }
+  const T &Get(size_t i) const { return msgs_[i]; }
+  T *Mutable(size_t i) { return &msgs_[i]; }
+  // The pointer is invalidated by the next Add.
+  T *Add() { return &msgs_.emplace_back(); }
+
   absl::Status ParseROS(ROSBuffer &buffer) {
-    int num_msgs = 0;
+    uint32_t num_msgs = 0;
     if (absl::Status status = Read(buffer, num_msgs); !status.ok()) {
       return status;
     }
-    for (int i = 0; i < num_msgs; i++) {
-      msgs_.push_back(MessageField<T>(Number()));
-      if (absl::Status status = msgs_.back().ParseROS(buffer); !status.ok()) {
+    if constexpr (HasFixedROSSize<T>::value) {
+      // The whole array is checked at once so the size can be trusted.
+      if (ABSL_PREDICT_TRUE(buffer.HasFixedLayout() &&
+                            buffer.Check(size_t(num_msgs) * T::kFixedROSSize)
+                                .ok() &&
+                            HasFixedROSHeaders(buffer.Addr(), num_msgs))) {
+        const char *addr = buffer.Addr();
+        size_t first = msgs_.size();
+        msgs_.resize(first + num_msgs);
+        for (size_t i = first; i < msgs_.size(); i++) {
+          msgs_[i].ParseROSFixed(addr);
+          addr += T::kFixedROSSize;
+        }
+        buffer.Addr() += size_t(num_msgs) * T::kFixedROSSize;
+        return absl::OkStatus();
+      }
+    }
+    msgs_.reserve(msgs_.size() + std::min(size_t(num_msgs), kMaxROSReserve));
+    for (uint32_t i = 0; i < num_msgs; i++) {
+      if (absl::Status status = msgs_.emplace_back().ParseROS(buffer);
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  bool HasValue() const { return !msgs_.empty(); }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    uint32_t num_elements = 0;
+    if (absl::Status status = Read(buffer, num_elements); !status.ok()) {
+      return status;
+    }
+    if constexpr (HasFixedROSSize<T>::value) {
+      // CDR has padding and compact buffers can't be looked into.
+      if (ABSL_PREDICT_TRUE(
+              buffer.HasFixedLayout() &&
+              buffer.Check(size_t(num_elements) * T::kFixedROSSize).ok() &&
+              HasFixedROSHeaders(buffer.Addr(), num_elements))) {
+        return buffer.Skip(size_t(num_elements) * T::kFixedROSSize);
+      }
+    }
+    for (uint32_t i = 0; i < num_elements; i++) {
+      if (absl::Status status = T::SkipROS(buffer); !status.ok()) {
         return status;
       }
     }
-    present_ = num_msgs > 0;
     return absl::OkStatus();
   }
 
 private:
-  std::vector<MessageField<T>> msgs_;
+  static constexpr uint32_t kTag =
+      (FieldNumber << ProtoBuffer::kFieldIdShift) |
+      uint32_t(WireType::kLengthDelimited);
+
+  // True if n fixed layout messages at addr all have empty frame_ids.
+  static bool HasFixedROSHeaders(const char *addr, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      if (!T::HasFixedROSHeaders(addr + i * T::kFixedROSSize)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::vector<T> msgs_;
 };
 
-class StringVectorField : public Field {
+// Repeated string field.  The strings are not copied.  They are almost
+// always in the same buffer so they are stored as 8 byte offsets and
+// lengths relative to the first one rather than 16 byte string_views.  Any
+// that are too far away are kept as string_views in far_.
+template <int FieldNumber>
+class StringVectorField : public Field<FieldNumber> {
 public:
-  StringVectorField() = default;
-  explicit StringVectorField(int number) : Field(number) {}
-
   size_t SerializedProtoSize() const {
     size_t length = 0;
-    for (size_t i = 0; i < strings_.size(); i++) {
-      length +=
-          sato::ProtoBuffer::LengthDelimitedSize(Number(), strings_[i].size());
+    for (size_t i = 0; i < entries_.size(); i++) {
+      length += ProtoBuffer::LengthDelimitedSize<FieldNumber>(Length(i));
     }
     return length;
   }
 
   size_t SerializedROSSize() const {
     size_t length = 0;
-    for (size_t i = 0; i < strings_.size(); i++) {
-      length += 4 + strings_[i].size();
+    for (size_t i = 0; i < entries_.size(); i++) {
+      length += 4 + Length(i);
     }
     return 4 + length;
   }
 
   absl::Status WriteProto(ProtoBuffer &buffer) const {
-    size_t sz = strings_.size();
-    if (sz == 0) {
-      return absl::OkStatus();
-    }
-
-    for (const auto &s : strings_) {
+    size_t sz = entries_.size();
+    for (size_t i = 0; i < sz; i++) {
+      if (i + kPrefetchDistance < sz) {
+        Prefetch(Get(i + kPrefetchDistance).data());
+      }
+      std::string_view s = Get(i);
       if (absl::Status status =
-              buffer.SerializeLengthDelimited(Number(), s.data(), s.size());
+              buffer.SerializeLengthDelimited<FieldNumber>(s.data(), s.size());
           !status.ok()) {
         return status;
       }
@@ -293,13 +505,16 @@ public:
   }
 
   absl::Status WriteROS(ROSBuffer &buffer) const {
-    if (absl::Status status =
-            Write(buffer, static_cast<uint32_t>(strings_.size()));
+    size_t sz = entries_.size();
+    if (absl::Status status = Write(buffer, static_cast<uint32_t>(sz));
         !status.ok()) {
       return status;
     }
-    for (const auto &s : strings_) {
-      if (absl::Status status = Write(buffer, s); !status.ok()) {
+    for (size_t i = 0; i < sz; i++) {
+      if (i + kPrefetchDistance < sz) {
+        Prefetch(Get(i + kPrefetchDistance).data());
+      }
+      if (absl::Status status = Write(buffer, Get(i)); !status.ok()) {
         return status;
       }
     }
@@ -307,31 +522,96 @@ public:
   }
 
   absl::Status ParseProto(ProtoBuffer &buffer) {
+    if (entries_.empty()) {
+      entries_.reserve(buffer.CountFields(kTag));
+    }
     absl::StatusOr<std::string_view> v = buffer.DeserializeString();
     if (!v.ok()) {
       return v.status();
     }
-    strings_.push_back(*v);
+    Add(*v);
     return absl::OkStatus();
   }
-  absl::Status ParseROS(ROSBuffer &buffer) { 
-    int num_strings = 0;
+
+  absl::Status ParseROS(ROSBuffer &buffer) {
+    uint32_t num_strings = 0;
     if (absl::Status status = Read(buffer, num_strings); !status.ok()) {
       return status;
     }
-    for (int i = 0; i < num_strings; i++) {
+    entries_.reserve(entries_.size() +
+                     std::min(size_t(num_strings), kMaxROSReserve));
+    for (uint32_t i = 0; i < num_strings; i++) {
       std::string_view s;
       if (absl::Status status = Read(buffer, s); !status.ok()) {
         return status;
       }
-      strings_.push_back(s);
+      Add(s);
+    }
+    return absl::OkStatus();
+  }
+
+  bool HasValue() const { return !entries_.empty(); }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    uint32_t num_elements = 0;
+    if (absl::Status status = Read(buffer, num_elements); !status.ok()) {
+      return status;
+    }
+    for (uint32_t i = 0; i < num_elements; i++) {
+      if (absl::Status status = StringField<FieldNumber>::SkipROS(buffer);
+          !status.ok()) {
+        return status;
+      }
     }
-    present_ = num_strings > 0;
     return absl::OkStatus();
   }
 
+  size_t size() const { return entries_.size(); }
+  void Reserve(size_t n) { entries_.reserve(n); }
+
+  // The string is not copied so it must outlive the message.
+  void Add(std::string_view s) {
+    if (s.empty()) {
+      entries_.push_back({0, 0});
+      return;
+    }
+    if (base_ == 0) {
+      base_ = reinterpret_cast<uintptr_t>(s.data());
+    }
+    intptr_t offset = intptr_t(reinterpret_cast<uintptr_t>(s.data()) - base_);
+    if (offset >= INT32_MIN && offset <= INT32_MAX && s.size() < kFar) {
+      entries_.push_back({int32_t(offset), uint32_t(s.size())});
+      return;
+    }
+    entries_.push_back({int32_t(far_.size()), uint32_t(s.size()) | kFar});
+    far_.push_back(s);
+  }
+
+  std::string_view Get(size_t i) const {
+    const Entry &e = entries_[i];
+    if (ABSL_PREDICT_FALSE((e.length & kFar) != 0)) {
+      return far_[e.offset];
+    }
+    return std::string_view(
+        reinterpret_cast<const char *>(base_ + intptr_t(e.offset)), e.length);
+  }
+
 private:
-  std::vector<std::string_view> strings_;
+  static constexpr uint32_t kTag =
+      (FieldNumber << ProtoBuffer::kFieldIdShift) |
+      uint32_t(WireType::kLengthDelimited);
+  static constexpr uint32_t kFar = 0x80000000;
+
+  struct Entry {
+    int32_t offset; // From base_, or index into far_.
+    uint32_t length; // kFar bit set if in far_.
+  };
+
+  size_t Length(size_t i) const { return entries_[i].length & ~kFar; }
+
+  uintptr_t base_ = 0; // Address of the first string.
+  std::vector<Entry> entries_;
+  std::vector<std::string_view> far_;
 };
 
 } // namespace sato
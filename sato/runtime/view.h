@@ -0,0 +1,158 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// Read-only views over serialized ROS messages.
+//
+// For each message the generator emits a FooROSView class.  Its Create
+// function makes a single pass over the buffer to record the offsets of the
+// fields that follow a variable length field (the offsets of the fixed size
+// prefix of the message are constants) and to check that the whole message
+// is in the buffer.  The offsets are relative to the end of the std_msgs/Header
+// of a top level message, since the header's frame_id can be any length.
+// The getters then read directly from the buffer: scalars are returned by
+// value, strings as string_views, blobs as spans and other arrays of scalars
+// as ROSArrayViews, which copy each element out as it is read because ROS
+// data is not aligned.  The buffer must outlive the view.
+//
+// Views don't support compact or CDR ROS buffers.
+
+#include "absl/types/span.h"
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+namespace sato {
+
+// ROS data is not aligned so values are copied out.
+template <typename T> inline T ROSViewValue(const char *addr) {
+  T v;
+  memcpy(&v, addr, sizeof(v));
+  return v;
+}
+
+inline std::string_view ROSViewString(const char *addr) {
+  return std::string_view(addr + 4, ROSViewValue<uint32_t>(addr));
+}
+
+// An array of scalars in a ROS buffer.  The elements are unaligned so they
+// can't be referenced in place; indexing copies one out.
+template <typename T> class ROSArrayView {
+public:
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = T;
+
+    const_iterator() = default;
+    explicit const_iterator(const char *addr) : addr_(addr) {}
+
+    T operator*() const { return ROSViewValue<T>(addr_); }
+    const_iterator &operator++() {
+      addr_ += sizeof(T);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator it = *this;
+      addr_ += sizeof(T);
+      return it;
+    }
+    bool operator==(const const_iterator &it) const { return addr_ == it.addr_; }
+    bool operator!=(const const_iterator &it) const { return addr_ != it.addr_; }
+
+  private:
+    const char *addr_ = nullptr;
+  };
+
+  ROSArrayView() = default;
+  ROSArrayView(const char *addr, size_t size) : addr_(addr), size_(size) {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  T operator[](size_t i) const { return ROSViewValue<T>(addr_ + i * sizeof(T)); }
+
+  const_iterator begin() const { return const_iterator(addr_); }
+  const_iterator end() const { return const_iterator(addr_ + size_ * sizeof(T)); }
+
+  std::vector<T> ToVector() const {
+    std::vector<T> v(size_);
+    if (size_ > 0) {
+      memcpy(v.data(), addr_, size_ * sizeof(T));
+    }
+    return v;
+  }
+
+private:
+  const char *addr_ = nullptr;
+  size_t size_ = 0;
+};
+
+template <typename T> inline ROSArrayView<T> ROSViewArray(const char *addr) {
+  return ROSArrayView<T>(addr + 4, ROSViewValue<uint32_t>(addr));
+}
+
+// A fixed size array has no count.
+template <typename T, size_t N>
+inline ROSArrayView<T> ROSViewFixedArray(const char *addr) {
+  return ROSArrayView<T>(addr, N);
+}
+
+// Bytes have no alignment so a blob can be a span.
+inline absl::Span<const char> ROSViewBlob(const char *addr) {
+  return absl::Span<const char>(addr + 4, ROSViewValue<uint32_t>(addr));
+}
+
+inline std::vector<std::string_view> ROSViewStrings(const char *addr) {
+  uint32_t n = ROSViewValue<uint32_t>(addr);
+  addr += 4;
+  std::vector<std::string_view> result;
+  result.reserve(n);
+  for (uint32_t i = 0; i < n; i++) {
+    std::string_view s = ROSViewString(addr);
+    addr += 4 + s.size();
+    result.push_back(s);
+  }
+  return result;
+}
+
+// The views are only created for messages that have already been checked by
+// the enclosing view's Create, so they can't fail.
+template <typename View>
+inline View ROSViewMessage(const char *addr, const char *end) {
+  return *View::Create(addr, end - addr);
+}
+
+template <typename View>
+inline std::vector<View> ROSViewMessages(const char *addr, const char *end) {
+  uint32_t n = ROSViewValue<uint32_t>(addr);
+  addr += 4;
+  std::vector<View> result;
+  result.reserve(n);
+  for (uint32_t i = 0; i < n; i++) {
+    View v = ROSViewMessage<View>(addr, end);
+    addr += v.SerializedSize();
+    result.push_back(v);
+  }
+  return result;
+}
+
+// A message in a oneof is an array of 0 or 1 messages.
+template <typename View>
+inline std::optional<View> ROSViewOptionalMessage(const char *addr,
+                                                  const char *end) {
+  if (ROSViewValue<int32_t>(addr) == 0) {
+    return std::nullopt;
+  }
+  return ROSViewMessage<View>(addr + 4, end);
+}
+
+} // namespace sato
@@ -0,0 +1,362 @@
+// This is heavily based on Phaser (https://github.com/dallison/phaser) and
+// Neutron (https://github.com/dallison/neutron).
+// Copyright (C) 2025 David Allison.  All Rights Reserved.
+
+#pragma once
+
+// The google.protobuf well-known types that have a ROS builtin.
+//
+// Like Any, these are hand-coded message classes that the generator uses in
+// place of the generated ones.  Timestamp and Duration are the ROS time and
+// duration builtins (two 32 bit numbers) rather than a nested message, and
+// the wrapper types (DoubleValue etc.) are flattened to their value.  ROS
+// has no presence so a wrapper with a default value is the same as a
+// missing one.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "sato/runtime/fields.h"
+#include "sato/runtime/message.h"
+#include "sato/runtime/protobuf.h"
+#include "sato/runtime/ros.h"
+#include "sato/runtime/view.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace sato {
+
+// Base for the well-known messages: parsing of the protobuf fields.
+template <typename Derived> class WellKnownMessage : public Message {
+public:
+  absl::Status ParseProto(ProtoBuffer &buffer) override {
+    while (!buffer.Eof()) {
+      absl::StatusOr<uint32_t> tag = buffer.DeserializeVarint<uint32_t, false>();
+      if (!tag.ok()) {
+        return tag.status();
+      }
+      if (absl::Status status =
+              static_cast<Derived *>(this)->Derived::ParseProtoField(*tag,
+                                                                     buffer);
+          !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+};
+
+// google.protobuf.Timestamp and Duration.  Sec and Nsec are the ROS types
+// of the seconds and nanoseconds.
+template <typename Derived, typename Sec, typename Nsec>
+class TimeMessage : public WellKnownMessage<Derived> {
+public:
+  static constexpr size_t kFixedROSSize = sizeof(Sec) + sizeof(Nsec);
+
+  int64_t seconds() const { return seconds_.Value(); }
+  int32_t nanos() const { return nanos_.Value(); }
+  Derived &set_seconds(int64_t v) {
+    seconds_.Set(v);
+    return static_cast<Derived &>(*this);
+  }
+  Derived &set_nanos(int32_t v) {
+    nanos_.Set(v);
+    return static_cast<Derived &>(*this);
+  }
+
+  int64_t ToNanos() const { return seconds() * 1000000000 + nanos(); }
+
+  size_t SerializedProtoSize() const override {
+    size_t size = 0;
+    if (seconds_.HasValue()) {
+      size += seconds_.SerializedProtoSize();
+    }
+    if (nanos_.HasValue()) {
+      size += nanos_.SerializedProtoSize();
+    }
+    return size;
+  }
+
+  size_t SerializedROSSize() const override { return kFixedROSSize; }
+
+  absl::Status WriteProto(ProtoBuffer &buffer) const override {
+    if (seconds_.HasValue()) {
+      if (absl::Status status = seconds_.WriteProto(buffer); !status.ok()) {
+        return status;
+      }
+    }
+    if (nanos_.HasValue()) {
+      return nanos_.WriteProto(buffer);
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteROS(ROSBuffer &buffer,
+                        uint64_t timestamp = 0) const override {
+    if (absl::Status status = Write(buffer, Sec(seconds())); !status.ok()) {
+      return status;
+    }
+    return Write(buffer, Nsec(nanos()));
+  }
+
+  absl::Status ParseProtoField(uint32_t tag, ProtoBuffer &buffer) override {
+    switch (tag >> ProtoBuffer::kFieldIdShift) {
+    case 1:
+      return seconds_.ParseProto(buffer);
+    case 2:
+      return nanos_.ParseProto(buffer);
+    default:
+      return buffer.SkipTag(tag);
+    }
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) override {
+    Sec sec = 0;
+    Nsec nsec = 0;
+    if (absl::Status status = Read(buffer, sec); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = Read(buffer, nsec); !status.ok()) {
+      return status;
+    }
+    seconds_.Set(sec);
+    nanos_.Set(nsec);
+    return absl::OkStatus();
+  }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    if (absl::Status status = SkipValues<Sec>(buffer); !status.ok()) {
+      return status;
+    }
+    return SkipValues<Nsec>(buffer);
+  }
+
+  void WriteROSFixed(char *addr, uint64_t timestamp = 0) const {
+    Sec sec = Sec(seconds());
+    Nsec nsec = Nsec(nanos());
+    memcpy(addr, &sec, sizeof(sec));
+    memcpy(addr + sizeof(sec), &nsec, sizeof(nsec));
+  }
+
+  static bool HasFixedROSHeaders(const char *) { return true; }
+  absl::Status CheckROSFixed() const { return absl::OkStatus(); }
+
+  void ParseROSFixed(const char *addr) {
+    Sec sec;
+    Nsec nsec;
+    memcpy(&sec, addr, sizeof(sec));
+    memcpy(&nsec, addr + sizeof(sec), sizeof(nsec));
+    seconds_.Set(sec);
+    nanos_.Set(nsec);
+  }
+
+  bool IsPresent() const { return seconds_.HasValue() || nanos_.HasValue(); }
+
+  template <typename Proto> absl::Status FromProtoObject(const Proto &pb) {
+    seconds_.Set(pb.seconds());
+    nanos_.Set(pb.nanos());
+    return absl::OkStatus();
+  }
+
+  template <typename Proto> absl::Status ToProtoObject(Proto *pb) const {
+    pb->set_seconds(seconds());
+    pb->set_nanos(nanos());
+    return absl::OkStatus();
+  }
+
+private:
+  Int64Field<1> seconds_;
+  Int32Field<2> nanos_;
+};
+
+// The wrapper types.  The value is field 1 and in ROS it's just the value.
+template <typename Derived, typename ValueField, typename T>
+class WrapperMessage : public WellKnownMessage<Derived> {
+public:
+  T value() const { return value_.Value(); }
+  Derived &set_value(T v) {
+    value_.Set(v);
+    return static_cast<Derived &>(*this);
+  }
+
+  size_t SerializedProtoSize() const override {
+    return value_.HasValue() ? value_.SerializedProtoSize() : 0;
+  }
+
+  size_t SerializedROSSize() const override {
+    return value_.SerializedROSSize();
+  }
+
+  absl::Status WriteProto(ProtoBuffer &buffer) const override {
+    if (value_.HasValue()) {
+      return value_.WriteProto(buffer);
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteROS(ROSBuffer &buffer,
+                        uint64_t timestamp = 0) const override {
+    return value_.WriteROS(buffer);
+  }
+
+  absl::Status ParseProtoField(uint32_t tag, ProtoBuffer &buffer) override {
+    if ((tag >> ProtoBuffer::kFieldIdShift) == 1) {
+      return value_.ParseProto(buffer);
+    }
+    return buffer.SkipTag(tag);
+  }
+
+  absl::Status ParseROS(ROSBuffer &buffer) override {
+    return value_.ParseROS(buffer);
+  }
+
+  static absl::Status SkipROS(ROSBuffer &buffer) {
+    return ValueField::SkipROS(buffer);
+  }
+
+  bool IsPresent() const { return value_.HasValue(); }
+
+  template <typename Proto> absl::Status FromProtoObject(const Proto &pb) {
+    value_.Set(pb.value());
+    return absl::OkStatus();
+  }
+
+  template <typename Proto> absl::Status ToProtoObject(Proto *pb) const {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+      pb->set_value(std::string(value()));
+    } else {
+      pb->set_value(value());
+    }
+    return absl::OkStatus();
+  }
+
+protected:
+  ValueField value_;
+};
+
+// Wrappers of scalars have a fixed ROS layout.
+template <typename Derived, typename ValueField, typename T>
+class FixedWrapperMessage : public WrapperMessage<Derived, ValueField, T> {
+public:
+  static constexpr size_t kFixedROSSize = sizeof(T);
+
+  void WriteROSFixed(char *addr, uint64_t timestamp = 0) const {
+    this->value_.WriteROSFixed(addr);
+  }
+  void ParseROSFixed(const char *addr) { this->value_.ParseROSFixed(addr); }
+  static bool HasFixedROSHeaders(const char *) { return true; }
+  absl::Status CheckROSFixed() const { return absl::OkStatus(); }
+};
+
+#define DEFINE_WELL_KNOWN_MESSAGE(name, base, ...)                             \
+  class name##Message : public base<name##Message, __VA_ARGS__> {              \
+  public:                                                                      \
+    static std::string Name() { return #name; }                                \
+    static std::string FullName() { return "google.protobuf." #name; }         \
+    std::string GetName() const override { return Name(); }                    \
+    std::string GetFullName() const override { return FullName(); }            \
+  };
+
+// ROS time is unsigned and duration is signed.
+DEFINE_WELL_KNOWN_MESSAGE(Timestamp, TimeMessage, uint32_t, uint32_t)
+DEFINE_WELL_KNOWN_MESSAGE(Duration, TimeMessage, int32_t, int32_t)
+DEFINE_WELL_KNOWN_MESSAGE(DoubleValue, FixedWrapperMessage,
+                          DoubleField<1, true>, double)
+DEFINE_WELL_KNOWN_MESSAGE(FloatValue, FixedWrapperMessage, FloatField<1, true>,
+                          float)
+DEFINE_WELL_KNOWN_MESSAGE(Int64Value, FixedWrapperMessage, Int64Field<1>,
+                          int64_t)
+DEFINE_WELL_KNOWN_MESSAGE(UInt64Value, FixedWrapperMessage, Uint64Field<1>,
+                          uint64_t)
+DEFINE_WELL_KNOWN_MESSAGE(Int32Value, FixedWrapperMessage, Int32Field<1>,
+                          int32_t)
+DEFINE_WELL_KNOWN_MESSAGE(UInt32Value, FixedWrapperMessage, Uint32Field<1>,
+                          uint32_t)
+DEFINE_WELL_KNOWN_MESSAGE(BoolValue, FixedWrapperMessage, BoolField<1>, bool)
+DEFINE_WELL_KNOWN_MESSAGE(StringValue, WrapperMessage, StringField<1>,
+                          std::string_view)
+DEFINE_WELL_KNOWN_MESSAGE(BytesValue, WrapperMessage, StringField<1>,
+                          std::string_view)
+
+#undef DEFINE_WELL_KNOWN_MESSAGE
+
+// Views of the well-known types for the generated ROS views.  Create only
+// checks that the value is in the buffer.
+template <typename Sec, typename Nsec> class TimeROSView {
+public:
+  static absl::StatusOr<TimeROSView> Create(const char *data, size_t size) {
+    if (size < kSize) {
+      return absl::InternalError(
+          absl::StrFormat("ROS buffer too small for time: %d", size));
+    }
+    TimeROSView view;
+    view.data_ = data;
+    return view;
+  }
+
+  size_t SerializedSize() const { return kSize; }
+
+  int64_t seconds() const { return ROSViewValue<Sec>(data_); }
+  int32_t nanos() const { return int32_t(ROSViewValue<Nsec>(data_ + sizeof(Sec))); }
+
+private:
+  static constexpr size_t kSize = sizeof(Sec) + sizeof(Nsec);
+  const char *data_ = nullptr;
+};
+
+template <typename T> class WrapperROSView {
+public:
+  static absl::StatusOr<WrapperROSView> Create(const char *data, size_t size) {
+    if (size < sizeof(T)) {
+      return absl::InternalError(
+          absl::StrFormat("ROS buffer too small for value: %d", size));
+    }
+    WrapperROSView view;
+    view.data_ = data;
+    return view;
+  }
+
+  size_t SerializedSize() const { return sizeof(T); }
+
+  T value() const { return ROSViewValue<T>(data_); }
+
+private:
+  const char *data_ = nullptr;
+};
+
+template <> class WrapperROSView<std::string_view> {
+public:
+  static absl::StatusOr<WrapperROSView> Create(const char *data, size_t size) {
+    if (size < 4 || size - 4 < ROSViewValue<uint32_t>(data)) {
+      return absl::InternalError(
+          absl::StrFormat("ROS buffer too small for string: %d", size));
+    }
+    WrapperROSView view;
+    view.data_ = data;
+    return view;
+  }
+
+  size_t SerializedSize() const { return 4 + ROSViewValue<uint32_t>(data_); }
+
+  std::string_view value() const { return ROSViewString(data_); }
+
+private:
+  const char *data_ = nullptr;
+};
+
+using TimestampMessageROSView = TimeROSView<uint32_t, uint32_t>;
+using DurationMessageROSView = TimeROSView<int32_t, int32_t>;
+using DoubleValueMessageROSView = WrapperROSView<double>;
+using FloatValueMessageROSView = WrapperROSView<float>;
+using Int64ValueMessageROSView = WrapperROSView<int64_t>;
+using UInt64ValueMessageROSView = WrapperROSView<uint64_t>;
+using Int32ValueMessageROSView = WrapperROSView<int32_t>;
+using UInt32ValueMessageROSView = WrapperROSView<uint32_t>;
+using BoolValueMessageROSView = WrapperROSView<bool>;
+using StringValueMessageROSView = WrapperROSView<std::string_view>;
+using BytesValueMessageROSView = WrapperROSView<std::string_view>;
+
+} // namespace sato
@@ -15,7 +15,10 @@
 
 #include "toolbelt/hexdump.h"
 #include <gtest/gtest.h>
+#include <limits>
+#include <memory_resource>
 #include <sstream>
+#include <thread>
 
 TEST(SatoBasicTest, Basic) {
   foo::bar::TestMessage msg;
@@ -88,6 +91,64 @@ TEST(SatoBasicTest, Basic) {
   ASSERT_EQ(serialized_size, proto_serialized_size);
 }
 
+TEST(SatoBasicTest, BufferGrowth) {
+  // A single write of more than twice the size of the buffer.
+  std::string big(1000, 'x');
+  sato::ProtoBuffer proto_buffer(16);
+  ASSERT_TRUE(proto_buffer.SerializeLengthDelimited(1, big.data(), big.size())
+                  .ok());
+  ASSERT_EQ(std::string("\x0a\xe8\x07", 3) + big, proto_buffer.AsString());
+
+  sato::ROSBuffer ros_buffer(16);
+  ASSERT_TRUE(sato::Write(ros_buffer, std::string_view(big)).ok());
+  ASSERT_EQ(std::string("\xe8\x03\x00\x00", 4) + big, ros_buffer.AsString());
+}
+
+TEST(SatoBasicTest, OneofInitialized) {
+  // A new message has no oneof member set, whatever was in its memory.
+  auto ros_bytes = [](char fill) {
+    using Message = foo::bar::sato::TestMessage;
+    std::vector<char> mem(sizeof(Message) + alignof(Message), fill);
+    void *addr = mem.data();
+    size_t space = mem.size();
+    std::align(alignof(Message), sizeof(Message), addr, space);
+    Message *msg = new (addr) Message;
+    sato::ROSBuffer buffer;
+    EXPECT_TRUE(msg->WriteROS(buffer).ok());
+    msg->~Message();
+    return buffer.AsString();
+  };
+  ASSERT_EQ(ros_bytes(0), ros_bytes(char(0xff)));
+}
+
+TEST(SatoBasicTest, AnyValue) {
+  // The value of an Any is parsed from its own bytes, so the message in it
+  // survives a round trip through ROS.  Its length takes two bytes, which
+  // don't parse as a tag.
+  foo::bar::TestMessage msg;
+  foo::bar::InnerMessage any;
+  any.set_str(std::string(200, 'a'));
+  any.set_f(0x12345678);
+  msg.mutable_any()->PackFrom(any);
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+  foo::bar::InnerMessage any2;
+  ASSERT_TRUE(msg2.any().UnpackTo(&any2));
+  ASSERT_EQ(any.DebugString(), any2.DebugString());
+}
+
 TEST(SatoBasicTest, Multiplexer) {
   foo::bar::TestMessage msg;
   msg.set_x(1234);
@@ -247,3 +308,1443 @@ TEST(SatoBasicTest, ProtoToROS) {
 
   
 }
+
+TEST(SatoBasicTest, StreamingParser) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_y(-5678);
+  msg.set_s("hello world");
+  msg.add_vi32(1);
+  msg.add_vi32(200000);
+  msg.add_vstr("one");
+  msg.add_vstr("two");
+
+  auto m = msg.mutable_m();
+  m->set_str("Inner message");
+  m->set_f(1234567890);
+
+  auto inner = msg.mutable_vm()->Add();
+  inner->set_str("Inner1");
+  inner->set_f(999);
+
+  msg.set_u1b(0x0102030405060708);
+  msg.set_buffer(std::string(1000, 'x'));
+  msg.set_fl(1.5);
+  msg.set_db(2.5);
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  // Reference conversion with the whole message available.
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer, 1234).ok());
+
+  // Feed the message in chunks of different sizes so that we split in the
+  // middle of tags, varints, fixed values and length delimited fields.
+  for (size_t chunk_size : {1, 2, 3, 7, 16, 100, 4096}) {
+    foo::bar::sato::TestMessage t2;
+    sato::ProtoStreamParser parser(t2, 64);
+    for (size_t i = 0; i < serialized.size(); i += chunk_size) {
+      size_t n = std::min(chunk_size, serialized.size() - i);
+      // Use a copy of the chunk that goes away to make sure the parser
+      // doesn't keep references to it.
+      std::string chunk = serialized.substr(i, n);
+      ASSERT_TRUE(parser.Feed(chunk).ok());
+    }
+    sato::ROSBuffer ros_buffer2;
+    absl::Status status = parser.Finish(ros_buffer2, 1234);
+    ASSERT_TRUE(status.ok()) << status;
+    ASSERT_EQ(ros_buffer.size(), ros_buffer2.size());
+    ASSERT_EQ(0,
+              memcmp(ros_buffer.data(), ros_buffer2.data(), ros_buffer.size()));
+  }
+
+  // A truncated message is an error.
+  foo::bar::sato::TestMessage t3;
+  sato::ProtoStreamParser parser(t3);
+  ASSERT_TRUE(
+      parser.Feed(std::string_view(serialized).substr(0, serialized.size() - 1))
+          .ok());
+  ASSERT_FALSE(parser.Finish().ok());
+
+  // A length that is too big is rejected before anything is allocated.
+  foo::bar::sato::TestMessage t4;
+  sato::ProtoStreamParser parser4(t4);
+  absl::Status status = parser4.Feed(
+      std::string_view("\xb2\x06\x80\x80\x80\x80\x40", 7));
+  ASSERT_EQ(absl::StatusCode::kInvalidArgument, status.code()) << status;
+
+  // Fields that are not projected or unknown are skipped, so they are not
+  // limited by the maximum size.
+  sato::Projection projection = {100};
+  foo::bar::sato::TestMessage t5;
+  t5.SetProjection(&projection);
+  sato::ProtoStreamParser parser5(t5, 64, 16);
+  for (size_t i = 0; i < serialized.size(); i += 7) {
+    ASSERT_TRUE(parser5.Feed(std::string_view(serialized).substr(i, 7)).ok());
+  }
+  ASSERT_TRUE(parser5.Finish().ok());
+  ASSERT_EQ(1234, t5.x());
+  ASSERT_TRUE(t5.s().empty());
+
+  sato::ProtoBuffer unknown;
+  ASSERT_TRUE((unknown.SerializeVarint<int32_t, false>(100, 42).ok()));
+  std::string payload(100, 'u');
+  ASSERT_TRUE(unknown.SerializeLengthDelimited(999, payload.data(),
+                                               payload.size())
+                  .ok());
+  foo::bar::sato::TestMessage t6;
+  sato::ProtoStreamParser parser6(t6, 64, 16);
+  ASSERT_TRUE(parser6.Feed(unknown.AsString()).ok());
+  ASSERT_TRUE(parser6.Finish().ok());
+  ASSERT_EQ(42, t6.x());
+}
+
+TEST(SatoBasicTest, OutputSink) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_s("hello world");
+  msg.add_vi32(1);
+  msg.add_vi32(2);
+  msg.add_vstr("one");
+  auto m = msg.mutable_m();
+  m->set_str("Inner message");
+  m->set_f(1234567890);
+  auto inner = msg.mutable_vm()->Add();
+  inner->set_str("Inner1");
+  inner->set_f(999);
+  msg.set_u2b("union string");
+  // Bigger than the chunk so that it bypasses the chunk.
+  msg.set_buffer(std::string(10000, 'x'));
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer, 1234).ok());
+
+  // ROS output to a callback sink in small chunks.
+  std::string ros_output;
+  size_t max_chunk = 0;
+  sato::CallbackSink ros_sink([&](const char *data, size_t length) {
+    ros_output.append(data, length);
+    if (length < 10000) {
+      max_chunk = std::max(max_chunk, length);
+    }
+    return absl::OkStatus();
+  });
+  foo::bar::sato::TestMessage t2;
+  sato::ProtoBuffer buffer2(serialized);
+  sato::ROSBuffer ros_stream(&ros_sink, 64);
+  ASSERT_TRUE(t2.ProtoToROS(buffer2, ros_stream, 1234).ok());
+  ASSERT_EQ(ros_buffer.AsString(), ros_output);
+  ASSERT_EQ(ros_output.size(), ros_stream.TotalSize());
+  ASSERT_LE(max_chunk, 64);
+
+  // Protobuf output to a file descriptor.
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  foo::bar::sato::TestMessage t3;
+  sato::ROSBuffer ros_buffer3(ros_buffer.data(), ros_buffer.size());
+  sato::FileDescriptorSink proto_sink(fds[1]);
+  sato::ProtoBuffer proto_stream(&proto_sink, 128);
+  std::string proto_output;
+  std::thread reader([&]() {
+    char buf[256];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+      proto_output.append(buf, n);
+    }
+  });
+  absl::Status status = t3.ROSToProto(ros_buffer3, proto_stream);
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+  ASSERT_TRUE(status.ok()) << status;
+  ASSERT_EQ(serialized.size(), proto_output.size());
+  ASSERT_EQ(serialized.size(), proto_stream.TotalSize());
+}
+
+namespace {
+// Memory resource that counts the allocations made through it.
+class CountingResource : public std::pmr::memory_resource {
+public:
+  int allocations = 0;
+  int deallocations = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    allocations++;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    deallocations++;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+} // namespace
+
+TEST(SatoBasicTest, MemoryResource) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_s("hello world");
+  msg.add_vstr("one");
+  msg.mutable_m()->set_str("Inner message");
+  msg.set_buffer(std::string(1000, 'x'));
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+
+  CountingResource resource;
+  {
+    foo::bar::sato::TestMessage t2;
+    sato::ProtoBuffer buffer2(serialized);
+    sato::ROSBuffer ros_buffer2(16, &resource);
+    ASSERT_TRUE(t2.ProtoToROS(buffer2, ros_buffer2).ok());
+    ASSERT_EQ(ros_buffer.AsString(), ros_buffer2.AsString());
+
+    // Back to protobuf, growing in the resource.
+    foo::bar::sato::TestMessage t3;
+    sato::ROSBuffer ros_buffer3(ros_buffer.data(), ros_buffer.size());
+    sato::ProtoBuffer proto_buffer(16, &resource);
+    ASSERT_TRUE(t3.ROSToProto(ros_buffer3, proto_buffer).ok());
+    ASSERT_EQ(serialized, proto_buffer.AsString());
+  }
+  ASSERT_GT(resource.allocations, 2);
+  ASSERT_EQ(resource.allocations, resource.deallocations);
+
+  // A monotonic resource over memory provided by a transport.
+  char transport_memory[4096];
+  std::pmr::monotonic_buffer_resource arena(
+      transport_memory, sizeof(transport_memory),
+      std::pmr::null_memory_resource());
+  foo::bar::sato::TestMessage t4;
+  sato::ProtoBuffer buffer4(serialized);
+  sato::ROSBuffer ros_buffer4(2048, &arena);
+  ASSERT_TRUE(t4.ProtoToROS(buffer4, ros_buffer4).ok());
+  ASSERT_EQ(ros_buffer.AsString(), ros_buffer4.AsString());
+
+  // A zero size still grows and a null resource uses malloc.
+  foo::bar::sato::TestMessage t5;
+  sato::ProtoBuffer buffer5(serialized);
+  sato::ROSBuffer ros_buffer5(0, &resource);
+  ASSERT_TRUE(t5.ProtoToROS(buffer5, ros_buffer5).ok());
+  ASSERT_EQ(ros_buffer.AsString(), ros_buffer5.AsString());
+  foo::bar::sato::TestMessage t6;
+  sato::ROSBuffer ros_buffer6(ros_buffer.data(), ros_buffer.size());
+  sato::ProtoBuffer proto_buffer6(0, nullptr);
+  ASSERT_TRUE(t6.ROSToProto(ros_buffer6, proto_buffer6).ok());
+  ASSERT_EQ(serialized, proto_buffer6.AsString());
+}
+
+TEST(SatoBasicTest, BufferPool) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_s("hello world");
+  msg.set_buffer(std::string(3000, 'x'));
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  sato::BufferPool &pool = sato::BufferPool::Default();
+  size_t warm_allocations = 0;
+  for (int i = 0; i < 100; i++) {
+    if (i == 10) {
+      warm_allocations = pool.SystemAllocations();
+    }
+    absl::StatusOr<size_t> ros_estimate =
+        sato::MultiplexerEstimatedROSSize("foo.bar.TestMessage");
+    ASSERT_TRUE(ros_estimate.ok());
+    foo::bar::sato::TestMessage t;
+    sato::ProtoBuffer buffer(serialized);
+    sato::ROSBuffer ros_buffer = sato::PooledROSBuffer(*ros_estimate);
+    ASSERT_TRUE(
+        sato::MultiplexerParseProto("foo.bar.TestMessage", t, buffer).ok());
+    ASSERT_TRUE(
+        sato::MultiplexerWriteROS("foo.bar.TestMessage", t, ros_buffer).ok());
+
+    absl::StatusOr<size_t> proto_estimate =
+        sato::MultiplexerEstimatedProtoSize("foo.bar.TestMessage");
+    ASSERT_TRUE(proto_estimate.ok());
+    sato::ProtoBuffer proto_buffer = sato::PooledProtoBuffer(*proto_estimate);
+    ASSERT_TRUE(
+        sato::MultiplexerWriteProto("foo.bar.TestMessage", t, proto_buffer)
+            .ok());
+    ASSERT_EQ(serialized, proto_buffer.AsString());
+  }
+  ASSERT_GE(*sato::MultiplexerEstimatedROSSize("foo.bar.TestMessage"), 3000);
+
+  // Once warmed up, the conversions don't allocate from the system.
+  ASSERT_EQ(warm_allocations, pool.SystemAllocations());
+}
+
+TEST(SatoBasicTest, CompactROS) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_s("hello world");
+  msg.add_vstr("one");
+  msg.add_vstr("");
+  msg.add_vi32(0);
+  msg.add_vi32(70000);
+  msg.set_u2b("oneof string");
+  msg.set_buffer(std::string(600, '\0') + "end");
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+
+  foo::bar::sato::TestMessage t2;
+  sato::ProtoBuffer buffer2(serialized);
+  sato::ROSBuffer compact_buffer;
+  compact_buffer.SetCompact(true);
+  ASSERT_TRUE(t2.ProtoToROS(buffer2, compact_buffer).ok());
+  ASSERT_LT(compact_buffer.Size() * 4, ros_buffer.Size());
+
+  // Back to protobuf from the compact buffer.
+  foo::bar::sato::TestMessage t3;
+  sato::ROSBuffer ros_buffer3(compact_buffer.data(), compact_buffer.Size());
+  ros_buffer3.SetCompact(true);
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t3.ROSToProto(ros_buffer3, proto_buffer).ok());
+  ASSERT_TRUE(ros_buffer3.CheckAtEnd().ok());
+
+  // Same as converting the normal ROS buffer.
+  foo::bar::sato::TestMessage t4;
+  sato::ROSBuffer ros_buffer4(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer4;
+  ASSERT_TRUE(t4.ROSToProto(ros_buffer4, proto_buffer4).ok());
+  ASSERT_EQ(proto_buffer4.AsString(), proto_buffer.AsString());
+}
+
+TEST(SatoBasicTest, Oneof) {
+  foo::bar::TestMessage msg;
+  msg.mutable_m()->set_str("Inner message");
+  msg.set_u1b(0x123456789);
+  msg.mutable_u3b()->set_str("oneof message");
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+  // Inactive members are expanded inline.
+  ASSERT_EQ(t.SerializedROSSize(), ros_buffer.Size());
+
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer).ok());
+
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(msg.DebugString(), msg2.DebugString());
+
+  // The last member parsed wins.
+  msg.set_u3a(42);
+  msg.SerializeToString(&serialized);
+  sato::ProtoBuffer buffer3(serialized);
+  foo::bar::sato::TestMessage t3;
+  ASSERT_TRUE(t3.ParseProto(buffer3).ok());
+  sato::ProtoBuffer proto_buffer3;
+  ASSERT_TRUE(t3.WriteProto(proto_buffer3).ok());
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer3.AsString()));
+  ASSERT_EQ(42, msg2.u3a());
+}
+
+TEST(SatoBasicTest, Presence) {
+  // The fields hold only their values: the field numbers are template
+  // parameters and the presence is a bitmap in the message.
+  ASSERT_LE(sizeof(foo::bar::sato::InnerMessage),
+            sizeof(sato::Message) + sizeof(sato::PresenceBits<2>) +
+                sizeof(std::string_view) + sizeof(int64_t));
+
+  // An unset nested message is not present after a round trip through ROS.
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_s("hello world");
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  ASSERT_TRUE(t2.IsPresent());
+  ASSERT_EQ(serialized, proto_buffer.AsString());
+}
+
+TEST(SatoBasicTest, RepeatedFields) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  for (int i = 0; i < 100; i++) {
+    auto *inner = msg.add_vm();
+    inner->set_str(absl::StrFormat("inner %d", i));
+    inner->set_f(i);
+    msg.add_vstr(i % 10 == 0 ? "" : absl::StrFormat("string %d", i));
+    msg.add_vi32(i);
+  }
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  sato::ProtoBuffer count_buffer(serialized);
+  absl::StatusOr<uint32_t> tag = count_buffer.DeserializeTag();
+  ASSERT_TRUE(tag.ok());
+  ASSERT_TRUE(count_buffer.SkipTag(*tag).ok());
+  // Skip to the first vm field and count them all.
+  for (;;) {
+    tag = count_buffer.DeserializeTag();
+    ASSERT_TRUE(tag.ok());
+    if ((*tag >> sato::ProtoBuffer::kFieldIdShift) == 106) {
+      break;
+    }
+    ASSERT_TRUE(count_buffer.SkipTag(*tag).ok());
+  }
+  ASSERT_EQ(100, count_buffer.CountFields(*tag));
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+  ASSERT_EQ(t.SerializedROSSize(), ros_buffer.Size());
+
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  ASSERT_EQ(t2.SerializedProtoSize(), proto_buffer.Size());
+
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(msg.DebugString(), msg2.DebugString());
+}
+
+TEST(SatoBasicTest, Map) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  for (int i = 0; i < 500; i++) {
+    (*msg.mutable_values())[absl::StrFormat("key %d", i)] = i * 3;
+  }
+  // Entries with a default key and value.
+  (*msg.mutable_values())[""] = 0;
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+  ASSERT_EQ(t.SerializedROSSize(), ros_buffer.Size());
+
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  ASSERT_EQ(t2.SerializedProtoSize(), proto_buffer.Size());
+
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(501, msg2.values().size());
+  for (auto &[key, value] : msg.values()) {
+    auto it = msg2.values().find(key);
+    ASSERT_NE(msg2.values().end(), it);
+    ASSERT_EQ(value, it->second);
+  }
+  ASSERT_EQ(msg.x(), msg2.x());
+}
+
+TEST(SatoBasicTest, FixedLayout) {
+  // Header + 2 * (header + 3 doubles) + seq + valid + e.
+  static_assert(foo::bar::sato::Imu::kFixedROSSize ==
+                16 + 2 * (16 + 24) + 4 + 1 + 4);
+  static_assert(
+      !sato::HasFixedROSSize<foo::bar::sato::TestMessage>::value);
+
+  foo::bar::ImuBatch batch;
+  for (int i = 0; i < 100; i++) {
+    foo::bar::Imu *imu = batch.add_samples();
+    imu->set_seq(i);
+    imu->mutable_angular_velocity()->set_x(i * 0.5 + 1);
+    imu->mutable_angular_velocity()->set_z(-i);
+    if (i % 3 != 0) {
+      imu->mutable_linear_acceleration()->set_y(9.81);
+    }
+    imu->set_valid(i % 2 == 0);
+    imu->set_e(foo::bar::BAR);
+  }
+  std::string serialized;
+  batch.SerializeToString(&serialized);
+
+  for (bool compact : {false, true}) {
+    foo::bar::sato::ImuBatch t;
+    sato::ProtoBuffer buffer(serialized);
+    sato::ROSBuffer ros_buffer;
+    ros_buffer.SetCompact(compact);
+    ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+    if (!compact) {
+      ASSERT_EQ(t.SerializedROSSize(), ros_buffer.Size());
+      ASSERT_EQ(16 + 4 + 100 * foo::bar::sato::Imu::kFixedROSSize,
+                ros_buffer.Size());
+    }
+
+    foo::bar::sato::ImuBatch t2;
+    sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+    ros_buffer2.SetCompact(compact);
+    sato::ProtoBuffer proto_buffer;
+    ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer).ok());
+    ASSERT_TRUE(ros_buffer2.CheckAtEnd().ok());
+
+    foo::bar::ImuBatch batch2;
+    ASSERT_TRUE(batch2.ParseFromString(proto_buffer.AsString()));
+    ASSERT_EQ(batch.DebugString(), batch2.DebugString());
+  }
+
+  // A truncated buffer fails the single bounds check.
+  foo::bar::sato::Imu imu;
+  std::string imu_serialized = batch.samples(1).SerializeAsString();
+  sato::ProtoBuffer buffer(imu_serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(imu.ProtoToROS(buffer, ros_buffer).ok());
+  ASSERT_EQ(foo::bar::sato::Imu::kFixedROSSize, ros_buffer.Size());
+  foo::bar::sato::Imu imu2;
+  sato::ROSBuffer short_buffer(ros_buffer.data(), ros_buffer.Size() - 1);
+  ASSERT_FALSE(imu2.ParseROS(short_buffer).ok());
+}
+
+// Messages from a ROS publisher can have a frame_id in their headers, which
+// moves the fields after it.
+TEST(SatoBasicTest, FixedLayoutFrameId) {
+  auto write_vector3 = [](sato::ROSBuffer &b, std::string_view frame_id,
+                          double x) {
+    ASSERT_TRUE(sato::WriteROSHeader(b, 0, frame_id).ok());
+    ASSERT_TRUE(sato::Write(b, x).ok());
+    ASSERT_TRUE(sato::Write(b, 2.0).ok());
+    ASSERT_TRUE(sato::Write(b, 3.0).ok());
+  };
+  sato::ROSBuffer vec;
+  write_vector3(vec, "map", 1.5);
+  ASSERT_EQ(43, vec.Size());
+
+  foo::bar::sato::Vector3 v;
+  sato::ROSBuffer vec_in(vec.data(), vec.Size());
+  ASSERT_TRUE(v.ParseROS(vec_in).ok());
+  ASSERT_EQ(1.5, v.x());
+  ASSERT_EQ(3.0, v.z());
+  ASSERT_TRUE(vec_in.CheckAtEnd().ok());
+  sato::ROSBuffer vec_skip(vec.data(), vec.Size());
+  ASSERT_TRUE(foo::bar::sato::Vector3::SkipROS(vec_skip).ok());
+  ASSERT_TRUE(vec_skip.CheckAtEnd().ok());
+
+  // A frame_id in a nested header, in an array of fixed messages.
+  sato::ROSBuffer batch;
+  ASSERT_TRUE(sato::WriteROSHeader(batch, 0).ok());
+  ASSERT_TRUE(sato::Write(batch, uint32_t(2)).ok());
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(sato::WriteROSHeader(batch, 0, i == 0 ? "" : "imu").ok());
+    ASSERT_TRUE(sato::Write(batch, uint32_t(10 + i)).ok());
+    write_vector3(batch, "", i + 0.5);
+    write_vector3(batch, i == 0 ? "base_link" : "", 9.81);
+    ASSERT_TRUE(sato::Write(batch, uint8_t(1)).ok());
+    ASSERT_TRUE(sato::Write(batch, int32_t(foo::bar::BAR)).ok());
+  }
+
+  foo::bar::sato::ImuBatch b;
+  sato::ROSBuffer batch_in(batch.data(), batch.Size());
+  ASSERT_TRUE(b.ParseROS(batch_in).ok());
+  ASSERT_TRUE(batch_in.CheckAtEnd().ok());
+  ASSERT_EQ(2, b.samples_size());
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(10 + i, b.samples(i).seq());
+    ASSERT_EQ(i + 0.5, b.samples(i).angular_velocity().x());
+    ASSERT_EQ(9.81, b.samples(i).linear_acceleration().x());
+    ASSERT_EQ(3.0, b.samples(i).linear_acceleration().z());
+    ASSERT_TRUE(b.samples(i).valid());
+    ASSERT_EQ(foo::bar::BAR, b.samples(i).e());
+  }
+  sato::ROSBuffer batch_skip(batch.data(), batch.Size());
+  ASSERT_TRUE(foo::bar::sato::ImuBatch::SkipROS(batch_skip).ok());
+  ASSERT_TRUE(batch_skip.CheckAtEnd().ok());
+}
+
+TEST(SatoBasicTest, EncodedTags) {
+  static_assert(sato::ProtoBuffer::TagSize<1, sato::WireType::kVarint>() == 1);
+  static_assert(sato::ProtoBuffer::TagSize<16, sato::WireType::kVarint>() == 2);
+  static_assert(
+      sato::ProtoBuffer::TagSize<(1 << 29) - 1, sato::WireType::kFixed32>() ==
+      5);
+
+  // The pre-encoded tags write the same bytes as the runtime encoding.
+  sato::ProtoBuffer runtime;
+  ASSERT_TRUE((runtime.SerializeVarint<int32_t, false>(1, 100).ok()));
+  ASSERT_TRUE((runtime.SerializeVarint<int64_t, true>(300, -5).ok()));
+  ASSERT_TRUE((runtime.SerializeFixed<double>(20000, 1.5).ok()));
+  ASSERT_TRUE(runtime.SerializeLengthDelimited(117, "hello", 5).ok());
+  ASSERT_TRUE(runtime.SerializeFixed<uint32_t>((1 << 29) - 1, 42).ok());
+
+  sato::ProtoBuffer constant;
+  ASSERT_TRUE((constant.SerializeVarint<1, int32_t, false>(100).ok()));
+  ASSERT_TRUE((constant.SerializeVarint<300, int64_t, true>(-5).ok()));
+  ASSERT_TRUE((constant.SerializeFixed<20000, double>(1.5).ok()));
+  ASSERT_TRUE(constant.SerializeLengthDelimited<117>("hello", 5).ok());
+  ASSERT_TRUE((constant.SerializeFixed<(1 << 29) - 1, uint32_t>(42).ok()));
+
+  ASSERT_EQ(runtime.AsString(), constant.AsString());
+}
+
+TEST(SatoBasicTest, Varints) {
+  // Negative int32 and int64 values are sign extended to 10 bytes and 64 bit
+  // values don't fit in 32.
+  foo::bar::TestMessage msg;
+  msg.set_x(-1);
+  msg.set_y(-(int64_t(1) << 40));
+  msg.set_u2a(int64_t(1) << 40);
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  ASSERT_TRUE(t.ParseProto(buffer).ok());
+  ASSERT_EQ(-1, t.x());
+  ASSERT_EQ(-(int64_t(1) << 40), t.y());
+  ASSERT_EQ(int64_t(1) << 40, t.u2a());
+
+  sato::ProtoBuffer out;
+  ASSERT_TRUE(t.WriteProto(out).ok());
+  ASSERT_EQ(serialized.size(), t.SerializedProtoSize());
+  ASSERT_EQ(serialized, out.AsString());
+
+  // Zigzag encoding at the limits of the types.
+  constexpr int32_t kMin32 = std::numeric_limits<int32_t>::min();
+  constexpr int64_t kMin64 = std::numeric_limits<int64_t>::min();
+  constexpr int64_t kMax64 = std::numeric_limits<int64_t>::max();
+  sato::ProtoBuffer zigzag;
+  ASSERT_TRUE((zigzag.SerializeVarint<1, int32_t, true>(kMin32).ok()));
+  ASSERT_TRUE((zigzag.SerializeVarint<2, int64_t, true>(kMin64).ok()));
+  ASSERT_TRUE((zigzag.SerializeVarint<3, int64_t, true>(kMax64).ok()));
+  std::string zigzag_bytes = zigzag.AsString();
+  sato::ProtoBuffer in(zigzag_bytes);
+  ASSERT_TRUE(in.DeserializeTag().ok());
+  absl::StatusOr<int32_t> i32 = in.DeserializeVarint<int32_t, true>();
+  ASSERT_TRUE(i32.ok());
+  ASSERT_EQ(kMin32, *i32);
+  ASSERT_TRUE(in.DeserializeTag().ok());
+  absl::StatusOr<int64_t> i64 = in.DeserializeVarint<int64_t, true>();
+  ASSERT_TRUE(i64.ok());
+  ASSERT_EQ(kMin64, *i64);
+  ASSERT_TRUE(in.DeserializeTag().ok());
+  i64 = in.DeserializeVarint<int64_t, true>();
+  ASSERT_TRUE(i64.ok());
+  ASSERT_EQ(kMax64, *i64);
+}
+
+TEST(SatoBasicTest, StaticConvert) {
+  static_assert(std::is_final_v<foo::bar::sato::TestMessage>);
+  static_assert(sato::MessageTraits<foo::bar::sato::Imu>::kHasFixedROSSize);
+  ASSERT_EQ("foo.bar.TestMessage",
+            sato::MessageTraits<foo::bar::sato::TestMessage>::FullName());
+
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_s("static dispatch");
+  msg.mutable_m()->set_str("inner");
+  msg.add_vi32(1);
+  msg.add_vi32(2);
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  // Same result as going through the virtual interface.
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer, 1234567890).ok());
+
+  sato::ProtoBuffer buffer2(serialized);
+  sato::ROSBuffer ros_buffer2;
+  ASSERT_TRUE((sato::Convert<foo::bar::sato::TestMessage>(buffer2, ros_buffer2,
+                                                         1234567890)
+                   .ok()));
+  ASSERT_EQ(ros_buffer.AsString(), ros_buffer2.AsString());
+
+  sato::ROSBuffer ros_buffer3(ros_buffer2.data(), ros_buffer2.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(
+      sato::Convert<foo::bar::sato::TestMessage>(ros_buffer3, proto_buffer)
+          .ok());
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(msg.DebugString(), msg2.DebugString());
+}
+
+TEST(SatoBasicTest, Projection) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_y(5678);
+  msg.set_s("projected");
+  msg.set_buffer(std::string(100000, 'x'));
+  msg.mutable_m()->set_str("inner");
+  msg.set_u2b("oneof string");
+  msg.add_vi32(1);
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  // Only x, s and the u2 oneof.  The big buffer is skipped.
+  sato::Projection projection = {100, 102, 110};
+
+  foo::bar::sato::TestMessage t;
+  t.SetProjection(&projection);
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+  ASSERT_LT(ros_buffer.Size(), 1000);
+
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+
+  foo::bar::TestMessage expected;
+  expected.set_x(1234);
+  expected.set_s("projected");
+  expected.set_u2b("oneof string");
+  ASSERT_EQ(expected.DebugString(), msg2.DebugString());
+
+  // Projecting the ROS to protobuf direction.
+  sato::ProtoBuffer buffer3(serialized);
+  foo::bar::sato::TestMessage t3;
+  sato::ROSBuffer ros_buffer3;
+  ASSERT_TRUE(t3.ProtoToROS(buffer3, ros_buffer3).ok());
+
+  sato::Projection projection2 = {101, 103};
+  foo::bar::sato::TestMessage t4;
+  t4.SetProjection(&projection2);
+  sato::ROSBuffer ros_buffer4(ros_buffer3.data(), ros_buffer3.Size());
+  sato::ProtoBuffer proto_buffer4;
+  ASSERT_TRUE(t4.ROSToProto(ros_buffer4, proto_buffer4).ok());
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer4.AsString()));
+  expected.Clear();
+  expected.set_y(5678);
+  expected.mutable_m()->set_str("inner");
+  ASSERT_EQ(expected.DebugString(), msg2.DebugString());
+
+  // The size doesn't count the repeated fields that were projected out.
+  sato::Projection projection3 = {100};
+  foo::bar::sato::TestMessage t5;
+  t5.SetProjection(&projection3);
+  sato::ROSBuffer ros_buffer5(ros_buffer3.data(), ros_buffer3.Size());
+  sato::ProtoBuffer proto_buffer5;
+  ASSERT_TRUE(t5.ROSToProto(ros_buffer5, proto_buffer5).ok());
+  ASSERT_EQ(proto_buffer5.Size(), t5.SerializedProtoSize());
+  ASSERT_EQ(4, t5.SerializedProtoSize());
+}
+
+TEST(SatoBasicTest, LazyFields) {
+  foo::bar::LazyTest msg;
+  msg.set_x(42);
+  msg.mutable_m()->set_str("lazy inner");
+  msg.mutable_m()->set_f(-1);
+  for (int i = 0; i < 10; i++) {
+    auto *inner = msg.add_vm();
+    inner->set_str(absl::StrFormat("inner %d", i));
+    inner->set_f(i);
+  }
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  // Protobuf to protobuf copies the nested messages through.
+  foo::bar::sato::LazyTest t;
+  sato::ProtoBuffer buffer(serialized);
+  ASSERT_TRUE(t.ParseProto(buffer).ok());
+  ASSERT_EQ(serialized.size(), t.SerializedProtoSize());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t.WriteProto(proto_buffer).ok());
+  ASSERT_EQ(serialized, proto_buffer.AsString());
+
+  // Decoded when written to ROS.
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.WriteROS(ros_buffer).ok());
+  ASSERT_EQ(t.SerializedROSSize(), ros_buffer.Size());
+
+  foo::bar::sato::LazyTest t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer2;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer2, proto_buffer2).ok());
+  foo::bar::LazyTest msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer2.AsString()));
+  ASSERT_EQ(msg.DebugString(), msg2.DebugString());
+
+  // A malformed nested message: field 10 claims 16 bytes but there are none.
+  // The error isn't lost by accessing the field before writing it.
+  // Field 2 is m and field 3 is vm.
+  std::string_view bad_m("\x08\x2a\x12\x02\x52\x10", 6);
+  std::string_view bad_vm("\x08\x2a\x1a\x02\x52\x10", 6);
+  for (std::string_view bad : {bad_m, bad_vm}) {
+    foo::bar::sato::LazyTest t3;
+    sato::ProtoBuffer bad_buffer(bad);
+    ASSERT_TRUE(t3.ParseProto(bad_buffer).ok());
+    (void)t3.SerializedROSSize();
+    sato::ROSBuffer bad_ros;
+    ASSERT_FALSE(t3.WriteROS(bad_ros).ok());
+    sato::ROSBuffer bad_ros2;
+    ASSERT_FALSE(t3.WriteROS(bad_ros2).ok());
+
+    // The bytes are still copied through to protobuf.
+    sato::ProtoBuffer bad_proto;
+    ASSERT_TRUE(t3.WriteProto(bad_proto).ok());
+    ASSERT_EQ(bad, bad_proto.AsString());
+  }
+}
+
+TEST(SatoBasicTest, ROSView) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_y(-5678);
+  msg.set_s("hello world");
+  msg.mutable_m()->set_str("inner");
+  msg.mutable_m()->set_f(42);
+  for (int i = 0; i < 10; i++) {
+    msg.add_vi32(i * 2);
+    msg.add_vstr(absl::StrFormat("string %d", i));
+    auto *inner = msg.add_vm();
+    inner->set_str(absl::StrFormat("inner %d", i));
+    inner->set_f(i);
+  }
+  msg.set_u2b("oneof string");
+  msg.mutable_u3b()->set_str("oneof message");
+  (*msg.mutable_values())["key"] = 1;
+  msg.set_e(foo::bar::FOO);
+  msg.set_db(3.5);
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer).ok());
+
+  absl::StatusOr<foo::bar::sato::TestMessageROSView> view =
+      foo::bar::sato::TestMessageROSView::Create(ros_buffer.data(),
+                                                 ros_buffer.Size());
+  ASSERT_TRUE(view.ok()) << view.status();
+  ASSERT_EQ(ros_buffer.Size(), view->SerializedSize());
+  ASSERT_EQ(1234, view->x());
+  ASSERT_EQ(-5678, view->y());
+  ASSERT_EQ("hello world", view->s());
+  ASSERT_EQ("inner", view->m().str());
+  ASSERT_EQ(42, view->m().f());
+
+  sato::ROSArrayView<int32_t> vi32 = view->vi32();
+  ASSERT_EQ(10, vi32.size());
+  std::vector<int32_t> vi32_copy = vi32.ToVector();
+  ASSERT_EQ(std::vector<int32_t>(vi32.begin(), vi32.end()), vi32_copy);
+  std::vector<std::string_view> vstr = view->vstr();
+  ASSERT_EQ(10, vstr.size());
+  std::vector<foo::bar::sato::InnerMessageROSView> vm = view->vm();
+  ASSERT_EQ(10, vm.size());
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(i * 2, vi32[i]);
+    ASSERT_EQ(absl::StrFormat("string %d", i), vstr[i]);
+    ASSERT_EQ(absl::StrFormat("inner %d", i), vm[i].str());
+    ASSERT_EQ(i, vm[i].f());
+  }
+
+  ASSERT_EQ(0, view->u1_case());
+  ASSERT_EQ(110, view->u2_case());
+  ASSERT_EQ("oneof string", view->u2b());
+  ASSERT_EQ(112, view->u3_case());
+  ASSERT_TRUE(view->u3b().has_value());
+  ASSERT_EQ("oneof message", view->u3b()->str());
+
+  ASSERT_EQ(foo::bar::FOO, view->e());
+  ASSERT_EQ(3.5, view->db());
+
+  // Fixed layout messages have only constant offsets.
+  foo::bar::Imu imu;
+  imu.set_seq(7);
+  imu.mutable_linear_acceleration()->set_z(9.81);
+  imu.set_valid(true);
+  imu.SerializeToString(&serialized);
+  foo::bar::sato::Imu s_imu;
+  sato::ProtoBuffer imu_buffer(serialized);
+  sato::ROSBuffer imu_ros_buffer;
+  ASSERT_TRUE(s_imu.ProtoToROS(imu_buffer, imu_ros_buffer).ok());
+  absl::StatusOr<foo::bar::sato::ImuROSView> imu_view =
+      foo::bar::sato::ImuROSView::Create(imu_ros_buffer.data(),
+                                         imu_ros_buffer.Size());
+  ASSERT_TRUE(imu_view.ok());
+  ASSERT_EQ(7, imu_view->seq());
+  ASSERT_EQ(9.81, imu_view->linear_acceleration().z());
+  ASSERT_TRUE(imu_view->valid());
+
+  // A truncated buffer is rejected.
+  ASSERT_FALSE(foo::bar::sato::TestMessageROSView::Create(
+                   ros_buffer.data(), ros_buffer.Size() - 1)
+                   .ok());
+}
+
+TEST(SatoBasicTest, ROSViewFrameId) {
+  // A view finds the fields after a header with a frame_id.
+  sato::ROSBuffer vec;
+  ASSERT_TRUE(sato::WriteROSHeader(vec, 0, "map").ok());
+  ASSERT_TRUE(sato::Write(vec, 1.5).ok());
+  ASSERT_TRUE(sato::Write(vec, 2.0).ok());
+  ASSERT_TRUE(sato::Write(vec, 3.0).ok());
+  ASSERT_EQ(43, vec.Size());
+  auto view = foo::bar::sato::Vector3ROSView::Create(vec.data(), vec.Size());
+  ASSERT_TRUE(view.ok()) << view.status();
+  ASSERT_EQ(43, view->SerializedSize());
+  ASSERT_EQ(1.5, view->x());
+  ASSERT_EQ(3.0, view->z());
+
+  // And a nested message's header.
+  sato::ROSBuffer imu;
+  ASSERT_TRUE(sato::WriteROSHeader(imu, 0).ok());
+  ASSERT_TRUE(sato::Write(imu, uint32_t(7)).ok());
+  for (std::string_view frame_id : {"base_link", ""}) {
+    ASSERT_TRUE(sato::WriteROSHeader(imu, 0, frame_id).ok());
+    ASSERT_TRUE(sato::Write(imu, 0.5).ok());
+    ASSERT_TRUE(sato::Write(imu, 0.0).ok());
+    ASSERT_TRUE(sato::Write(imu, 9.81).ok());
+  }
+  ASSERT_TRUE(sato::Write(imu, uint8_t(1)).ok());
+  ASSERT_TRUE(sato::Write(imu, int32_t(foo::bar::BAR)).ok());
+  auto imu_view = foo::bar::sato::ImuROSView::Create(imu.data(), imu.Size());
+  ASSERT_TRUE(imu_view.ok()) << imu_view.status();
+  ASSERT_EQ(imu.Size(), imu_view->SerializedSize());
+  ASSERT_EQ(7, imu_view->seq());
+  ASSERT_EQ(0.5, imu_view->angular_velocity().x());
+  ASSERT_EQ(9.81, imu_view->linear_acceleration().z());
+  ASSERT_TRUE(imu_view->valid());
+  ASSERT_EQ(foo::bar::BAR, imu_view->e());
+}
+
+TEST(SatoBasicTest, Accessors) {
+  // Build the message directly rather than parsing it.
+  foo::bar::sato::TestMessage t;
+  t.set_x(1234).set_y(-5678).set_s("hello").set_e(foo::bar::BAR).set_db(1.5);
+  t.mutable_m()->set_str("inner").set_f(42);
+  std::vector<std::string> strings;
+  for (int i = 0; i < 10; i++) {
+    strings.push_back(absl::StrFormat("string %d", i));
+  }
+  for (int i = 0; i < 10; i++) {
+    t.add_vi32(i * 2).add_vstr(strings[i]);
+    t.add_vm()->set_str(strings[i]).set_f(i);
+  }
+  t.set_u2b("oneof string");
+  t.mutable_u3b()->set_str("oneof message");
+  *t.mutable_values()->Add("key") = 99;
+
+  ASSERT_TRUE(t.has_x());
+  ASSERT_FALSE(t.has_fl());
+  ASSERT_EQ(1234, t.x());
+  ASSERT_EQ("hello", t.s());
+  ASSERT_EQ("inner", t.m().str());
+  ASSERT_EQ(10, t.vm_size());
+  ASSERT_EQ(18, t.vi32(9));
+  ASSERT_EQ("string 3", t.vstr(3));
+  ASSERT_EQ(110, t.u2_case());
+  ASSERT_TRUE(t.has_u3b());
+  ASSERT_EQ(0, t.u1a());
+
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t.WriteProto(proto_buffer).ok());
+  foo::bar::TestMessage msg;
+  ASSERT_TRUE(msg.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(1234, msg.x());
+  ASSERT_EQ(-5678, msg.y());
+  ASSERT_EQ("hello", msg.s());
+  ASSERT_EQ(foo::bar::BAR, msg.e());
+  ASSERT_EQ(42, msg.m().f());
+  ASSERT_EQ(10, msg.vm_size());
+  ASSERT_EQ("string 9", msg.vm(9).str());
+  ASSERT_EQ("oneof string", msg.u2b());
+  ASSERT_EQ("oneof message", msg.u3b().str());
+  ASSERT_EQ(99, msg.values().at("key"));
+
+  // Written straight to ROS.
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(t.WriteROS(ros_buffer).ok());
+  ASSERT_EQ(t.SerializedROSSize(), ros_buffer.Size());
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  ASSERT_TRUE(t2.ParseROS(ros_buffer2).ok());
+  ASSERT_EQ(-5678, t2.y());
+  ASSERT_EQ("string 5", t2.vm(5).str());
+  ASSERT_EQ("oneof message", t2.u3b().str());
+}
+
+TEST(SatoBasicTest, ProtoObject) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_y(-5678);
+  msg.set_s("hello");
+  msg.set_e(foo::bar::FOO);
+  msg.set_fl(2.5);
+  msg.mutable_m()->set_str("inner");
+  for (int i = 0; i < 10; i++) {
+    msg.add_vi32(-i);
+    msg.add_vstr(absl::StrFormat("string %d", i));
+    auto *inner = msg.add_vm();
+    inner->set_str(absl::StrFormat("inner %d", i));
+    inner->set_f(i);
+  }
+  msg.set_u1b(0x123456789);
+  msg.mutable_u3b()->set_f(-1);
+  (*msg.mutable_values())["a"] = 1;
+  (*msg.mutable_values())["b"] = 2;
+  msg.add_buffers("bytes");
+
+  // Straight from the object to ROS, same as going through protobuf bytes.
+  sato::ROSBuffer ros_buffer;
+  absl::Status status =
+      sato::ProtoObjectToROS<foo::bar::sato::TestMessage>(msg, ros_buffer);
+  ASSERT_TRUE(status.ok()) << status;
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer2;
+  ASSERT_TRUE(t.ProtoToROS(buffer, ros_buffer2).ok());
+  // The map order is not defined so compare the sizes.
+  ASSERT_EQ(ros_buffer2.Size(), ros_buffer.Size());
+
+  // Straight from ROS to an object.
+  foo::bar::TestMessage msg2;
+  sato::ROSBuffer ros_buffer3(ros_buffer.data(), ros_buffer.Size());
+  status = sato::ROSToProtoObject<foo::bar::sato::TestMessage>(ros_buffer3,
+                                                               &msg2);
+  ASSERT_TRUE(status.ok()) << status;
+  ASSERT_EQ(msg.DebugString(), msg2.DebugString());
+}
+
+TEST(SatoBasicTest, ROSStructs) {
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_y(-5678);
+  msg.set_s("hello");
+  msg.set_e(foo::bar::FOO);
+  msg.set_db(3.25);
+  msg.mutable_m()->set_str("inner");
+  for (int i = 0; i < 10; i++) {
+    msg.add_vi32(-i);
+    msg.add_vstr(absl::StrFormat("string %d", i));
+    msg.add_vm()->set_f(i);
+  }
+  msg.set_u2b("oneof string");
+  msg.mutable_u3b()->set_str("oneof message");
+  (*msg.mutable_values())["a"] = 1;
+  msg.add_buffers("bytes");
+
+  std::string serialized;
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::ros::TestMessage s;
+  sato::ProtoBuffer buffer(serialized);
+  ASSERT_TRUE(s.ParseProto(buffer).ok());
+  ASSERT_EQ(1234, s.x);
+  ASSERT_EQ(-5678, s.y);
+  ASSERT_EQ("hello", s.s);
+  ASSERT_EQ(foo::bar::FOO, s.e);
+  ASSERT_EQ("inner", s.m.str);
+  ASSERT_EQ(10, s.vi32.size());
+  ASSERT_EQ(-9, s.vi32[9]);
+  ASSERT_EQ("string 3", s.vstr[3]);
+  ASSERT_EQ(7, s.vm[7].f);
+  ASSERT_EQ(110, s.u2_case);
+  ASSERT_EQ("oneof string", s.u2b);
+  ASSERT_EQ(112, s.u3_case);
+  ASSERT_EQ(1, s.u3b.size());
+  ASSERT_EQ("oneof message", s.u3b[0].str);
+  ASSERT_EQ(0, s.u1_case);
+  ASSERT_EQ(1, s.values.size());
+  ASSERT_EQ("a", s.values[0].key);
+  ASSERT_EQ(1, s.values[0].value);
+
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(s.WriteProto(proto_buffer).ok());
+  ASSERT_EQ(s.SerializedProtoSize(), proto_buffer.Size());
+
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(msg.DebugString(), msg2.DebugString());
+}
+
+TEST(SatoBasicTest, CDR) {
+  foo::bar::Vector3 vec;
+  vec.set_x(1.5);
+  vec.set_y(-2.5);
+  vec.set_z(3.5);
+  std::string serialized;
+  vec.SerializeToString(&serialized);
+
+  foo::bar::sato::Vector3 v;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ros_buffer.SetCDR(true);
+  ASSERT_TRUE(v.ProtoToROS(buffer, ros_buffer).ok());
+  // Encapsulation, stamp, frame_id of 1 byte (the NUL), padding to 8 and
+  // then the doubles.
+  ASSERT_EQ(4 + 16 + 24, ros_buffer.Size());
+  ASSERT_EQ(0, ros_buffer.data()[0]);
+  ASSERT_EQ(1, ros_buffer.data()[1]);
+  double x;
+  memcpy(&x, ros_buffer.data() + 4 + 16, sizeof(x));
+  ASSERT_EQ(1.5, x);
+
+  // A message with everything in it round trips through CDR.
+  foo::bar::TestMessage msg;
+  msg.set_x(1234);
+  msg.set_y(-5678);
+  msg.set_s("hello");
+  msg.set_e(foo::bar::FOO);
+  msg.set_db(3.25);
+  msg.mutable_m()->set_str("inner");
+  for (int i = 0; i < 10; i++) {
+    msg.add_vi32(-i);
+    msg.add_vstr(absl::StrFormat("string %d", i));
+    msg.add_vm()->set_f(i);
+  }
+  msg.set_u1b(0x123456789);
+  msg.mutable_u3b()->set_str("oneof message");
+  (*msg.mutable_values())["a"] = 1;
+  msg.add_buffers("bytes");
+  msg.SerializeToString(&serialized);
+
+  foo::bar::sato::TestMessage t;
+  sato::ProtoBuffer buffer2(serialized);
+  sato::ROSBuffer ros_buffer2;
+  ros_buffer2.SetCDR(true);
+  ASSERT_TRUE(t.ProtoToROS(buffer2, ros_buffer2).ok());
+
+  foo::bar::sato::TestMessage t2;
+  sato::ROSBuffer ros_buffer3(ros_buffer2.data(), ros_buffer2.Size());
+  ros_buffer3.SetCDR(true);
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(t2.ROSToProto(ros_buffer3, proto_buffer).ok());
+  ASSERT_TRUE(ros_buffer3.CheckAtEnd().ok());
+
+  foo::bar::TestMessage msg2;
+  ASSERT_TRUE(msg2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(msg.DebugString(), msg2.DebugString());
+
+  // CDR can't be used in compact mode.
+  sato::ROSBuffer compact;
+  compact.SetCDR(true);
+  compact.SetCompact(true);
+  ASSERT_EQ(absl::StatusCode::kInvalidArgument, t.WriteROS(compact).code());
+  sato::ROSBuffer compact_in(ros_buffer2.data(), ros_buffer2.Size());
+  compact_in.SetCDR(true);
+  compact_in.SetCompact(true);
+  foo::bar::sato::TestMessage t3;
+  ASSERT_EQ(absl::StatusCode::kInvalidArgument,
+            t3.ParseROS(compact_in).code());
+}
+
+TEST(SatoBasicTest, FieldOptions) {
+  foo::bar::PoseWithCovariance pose;
+  pose.mutable_position()->set_x(1.5);
+  for (int i = 0; i < 9; i++) {
+    pose.add_covariance(i * 0.5);
+  }
+  std::string serialized;
+  pose.SerializeToString(&serialized);
+
+  // float64[9] has no count so the message has a fixed layout.
+  // Vector3 is a top level message so it has a header too.
+  ASSERT_EQ(16 + 16 + 24 + 9 * 8,
+            foo::bar::sato::PoseWithCovariance::kFixedROSSize);
+  foo::bar::sato::PoseWithCovariance p;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(p.ProtoToROS(buffer, ros_buffer).ok());
+  ASSERT_EQ(foo::bar::sato::PoseWithCovariance::kFixedROSSize,
+            ros_buffer.Size());
+
+  auto view = foo::bar::sato::PoseWithCovarianceROSView::Create(
+      ros_buffer.data(), ros_buffer.Size());
+  ASSERT_TRUE(view.ok());
+  ASSERT_EQ(9, view->covariance().size());
+  ASSERT_EQ(4.0, view->covariance()[8]);
+
+  foo::bar::sato::PoseWithCovariance p2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(p2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  foo::bar::PoseWithCovariance pose2;
+  ASSERT_TRUE(pose2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(pose.DebugString(), pose2.DebugString());
+
+  // Too many elements for float64[9] is an error, not a truncation.
+  pose.add_covariance(99);
+  pose.SerializeToString(&serialized);
+  for (bool cdr : {false, true}) {
+    foo::bar::sato::PoseWithCovariance p3;
+    sato::ProtoBuffer long_buffer(serialized);
+    sato::ROSBuffer long_ros_buffer;
+    long_ros_buffer.SetCDR(cdr);
+    absl::Status status = p3.ProtoToROS(long_buffer, long_ros_buffer);
+    ASSERT_EQ(absl::StatusCode::kInvalidArgument, status.code()) << status;
+  }
+
+  // Too few are padded with zeros.
+  pose.clear_covariance();
+  pose.add_covariance(1.0);
+  pose.SerializeToString(&serialized);
+  foo::bar::sato::PoseWithCovariance p4;
+  sato::ProtoBuffer short_buffer(serialized);
+  sato::ROSBuffer short_ros_buffer;
+  ASSERT_TRUE(p4.ProtoToROS(short_buffer, short_ros_buffer).ok());
+  auto short_view = foo::bar::sato::PoseWithCovarianceROSView::Create(
+      short_ros_buffer.data(), short_ros_buffer.Size());
+  ASSERT_TRUE(short_view.ok());
+  ASSERT_EQ(1.0, short_view->covariance()[0]);
+  ASSERT_EQ(0.0, short_view->covariance()[8]);
+
+  // uint8[] has no trailing NUL in CDR.
+  foo::bar::ImageData image;
+  image.set_width(2);
+  image.set_height(1);
+  image.set_data("abcdef");
+  image.SerializeToString(&serialized);
+  foo::bar::sato::ImageData im;
+  sato::ProtoBuffer buffer3(serialized);
+  sato::ROSBuffer ros_buffer3;
+  ros_buffer3.SetCDR(true);
+  ASSERT_TRUE(im.ProtoToROS(buffer3, ros_buffer3).ok());
+  // Encapsulation, header, width, height, count and bytes.
+  ASSERT_EQ(4 + 16 + 4 + 4 + 4 + 6, ros_buffer3.Size());
+
+  foo::bar::sato::ImageData im2;
+  sato::ROSBuffer ros_buffer4(ros_buffer3.data(), ros_buffer3.Size());
+  ros_buffer4.SetCDR(true);
+  sato::ProtoBuffer proto_buffer2;
+  ASSERT_TRUE(im2.ROSToProto(ros_buffer4, proto_buffer2).ok());
+  foo::bar::ImageData image2;
+  ASSERT_TRUE(image2.ParseFromString(proto_buffer2.AsString()));
+  ASSERT_EQ(image.DebugString(), image2.DebugString());
+}
+
+TEST(SatoBasicTest, WellKnownTypes) {
+  foo::bar::StampedReading reading;
+  reading.mutable_header()->set_timestamp(1234000000567);
+  reading.mutable_header()->set_frame_id("base_link");
+  reading.mutable_start()->set_seconds(100);
+  reading.mutable_start()->set_nanos(200);
+  reading.mutable_period()->set_seconds(-3);
+  reading.mutable_value()->set_value(2.5);
+  reading.mutable_label()->set_value("temp");
+  reading.add_samples()->set_seconds(7);
+  reading.add_samples()->set_nanos(8);
+  std::string serialized;
+  reading.SerializeToString(&serialized);
+
+  foo::bar::sato::StampedReading r;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(r.ProtoToROS(buffer, ros_buffer).ok());
+  ASSERT_EQ(100, r.start().seconds());
+  ASSERT_EQ(2.5, r.value().value());
+  // The header field is the std_msgs/Header, time and duration are two 32
+  // bit numbers and the wrappers are just their values.
+  ASSERT_EQ(16 + 9 + 8 + 8 + 8 + 4 + 4 + 4 + 2 * 8, ros_buffer.Size());
+  ASSERT_EQ(r.SerializedROSSize(), ros_buffer.Size());
+  uint32_t stamp[2];
+  memcpy(stamp, ros_buffer.data() + 4, sizeof(stamp));
+  ASSERT_EQ(1234, stamp[0]);
+  ASSERT_EQ(567, stamp[1]);
+
+  auto view = foo::bar::sato::StampedReadingROSView::Create(ros_buffer.data(),
+                                                            ros_buffer.Size());
+  ASSERT_TRUE(view.ok());
+  ASSERT_EQ(200, view->start().nanos());
+  ASSERT_EQ(-3, view->period().seconds());
+  ASSERT_EQ(2.5, view->value().value());
+  ASSERT_EQ("temp", view->label().value());
+  ASSERT_EQ(2, view->samples().size());
+
+  foo::bar::sato::StampedReading r2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(r2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  foo::bar::StampedReading reading2;
+  ASSERT_TRUE(reading2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(reading.DebugString(), reading2.DebugString());
+
+  // Without a header field the timestamp argument is used, and messages of
+  // fixed size well-known types have a fixed layout.
+  ASSERT_EQ(16 + 8 + 4, foo::bar::sato::TimedValue::kFixedROSSize);
+  foo::bar::TimedValue timed;
+  timed.mutable_stamp()->set_seconds(5);
+  timed.mutable_value()->set_value(1.5);
+  timed.SerializeToString(&serialized);
+  foo::bar::sato::TimedValue t;
+  ASSERT_TRUE(t.FromProtoObject(timed).ok());
+  sato::ROSBuffer ros_buffer3;
+  ASSERT_TRUE(t.WriteROS(ros_buffer3, 9000000000).ok());
+  ASSERT_EQ(foo::bar::sato::TimedValue::kFixedROSSize, ros_buffer3.Size());
+  foo::bar::TimedValue timed2;
+  sato::ROSBuffer ros_buffer4(ros_buffer3.data(), ros_buffer3.Size());
+  ASSERT_TRUE(sato::ROSToProtoObject<foo::bar::sato::TimedValue>(ros_buffer4,
+                                                                 &timed2)
+                  .ok());
+  ASSERT_EQ(timed.DebugString(), timed2.DebugString());
+}
+
+TEST(SatoBasicTest, Blob) {
+  foo::bar::PointCloud cloud;
+  cloud.set_id(3);
+  for (int i = 0; i < 100; i++) {
+    foo::bar::CloudPoint *p = cloud.add_points();
+    p->set_x(i * 0.5f);
+    p->set_y(-i);
+    p->set_intensity(i * 2);
+    p->set_valid(i % 2 == 0);
+    p->set_t(-i * 1000);
+  }
+  std::string serialized;
+  cloud.SerializeToString(&serialized);
+
+  foo::bar::sato::PointCloud c;
+  sato::ProtoBuffer buffer(serialized);
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(c.ProtoToROS(buffer, ros_buffer).ok());
+  ASSERT_EQ(100, c.points_size());
+  ASSERT_EQ(99 * 2, c.points(99).intensity());
+  // The points are a uint8[] of 25 byte records with no headers.
+  ASSERT_EQ(25, foo::bar::sato::CloudPoint::kROSRecordSize);
+  ASSERT_EQ(16 + 4 + 4 + 100 * 25, ros_buffer.Size());
+
+  auto view = foo::bar::sato::PointCloudROSView::Create(ros_buffer.data(),
+                                                        ros_buffer.Size());
+  ASSERT_TRUE(view.ok());
+  ASSERT_EQ(100 * 25, view->points().size());
+  float x;
+  const auto &fields = foo::bar::sato::CloudPoint::kROSRecordFields;
+  ASSERT_EQ(std::string("x"), fields[0].name);
+  memcpy(&x, view->points().data() + 10 * 25 + fields[0].offset, sizeof(x));
+  ASSERT_EQ(5.0f, x);
+
+  foo::bar::sato::PointCloud c2;
+  sato::ROSBuffer ros_buffer2(ros_buffer.data(), ros_buffer.Size());
+  sato::ProtoBuffer proto_buffer;
+  ASSERT_TRUE(c2.ROSToProto(ros_buffer2, proto_buffer).ok());
+  foo::bar::PointCloud cloud2;
+  ASSERT_TRUE(cloud2.ParseFromString(proto_buffer.AsString()));
+  ASSERT_EQ(cloud.DebugString(), cloud2.DebugString());
+
+  // Through the proto object and CDR.
+  foo::bar::sato::PointCloud c3;
+  ASSERT_TRUE(c3.FromProtoObject(cloud).ok());
+  sato::ROSBuffer ros_buffer3;
+  ros_buffer3.SetCDR(true);
+  ASSERT_TRUE(c3.WriteROS(ros_buffer3).ok());
+  foo::bar::sato::PointCloud c4;
+  sato::ROSBuffer ros_buffer4(ros_buffer3.data(), ros_buffer3.Size());
+  ros_buffer4.SetCDR(true);
+  ASSERT_TRUE(c4.ParseROS(ros_buffer4).ok());
+  foo::bar::PointCloud cloud3;
+  ASSERT_TRUE(c4.ToProtoObject(&cloud3).ok());
+  ASSERT_EQ(cloud.DebugString(), cloud3.DebugString());
+}
+
+TEST(SatoBasicTest, ROSMetadata) {
+  static_assert(foo::bar::sato::CloudPoint::ROSDataType() ==
+                "foo_bar/CloudPoint");
+  // As computed by genmsg from the .msg files.
+  static_assert(foo::bar::sato::CloudPoint::ROSMd5Sum() ==
+                "15eddd286ebcef041419b893969c2fc6");
+  ASSERT_EQ("4a763305eb33e5429edb5044588050cc",
+            foo::bar::sato::PointCloud::ROSMd5Sum());
+
+  // The definition has the types used, once each.
+  std::string_view definition = foo::bar::sato::TestMessage::ROSDefinition();
+  ASSERT_EQ(0, definition.find("int32 kXFieldNumber = 100\n"));
+  size_t inner = definition.find("\nMSG: foo_bar/InnerMessage\n");
+  ASSERT_NE(std::string_view::npos, inner);
+  ASSERT_EQ(std::string_view::npos,
+            definition.find("MSG: foo_bar/InnerMessage", inner + 2));
+  ASSERT_NE(std::string_view::npos,
+            definition.find("\nMSG: std_msgs/Header\nuint32 seq\n"));
+  ASSERT_NE(std::string_view::npos,
+            definition.find("\nMSG: foo_bar_TestMessage/ValuesEntry\n"));
+
+  absl::StatusOr<std::string_view> md5 =
+      sato::MultiplexerROSMd5Sum("foo.bar.TestMessage");
+  ASSERT_TRUE(md5.ok());
+  ASSERT_EQ(foo::bar::sato::TestMessage::ROSMd5Sum(), *md5);
+  ASSERT_EQ("foo_bar/TestMessage",
+            *sato::MultiplexerROSDataType("foo.bar.TestMessage"));
+  ASSERT_EQ(definition, *sato::MultiplexerROSDefinition("foo.bar.TestMessage"));
+  ASSERT_FALSE(sato::MultiplexerROSMd5Sum("foo.bar.Unknown").ok());
+}
+
+TEST(SatoBasicTest, ConstantMessage) {
+  using Imu = foo::bar::sato::Imu;
+  using Vector3 = foo::bar::sato::Vector3;
+  constexpr Imu::Constant kImu =
+      Imu::Constant()
+          .set_seq(42)
+          .set_angular_velocity(Vector3::Constant().set_x(1.5).set_z(-2))
+          .set_valid(true)
+          .set_e(foo::bar::FOO);
+  constexpr auto kROS = Imu::ConstantROS(kImu, 3000000007);
+  constexpr auto kProto =
+      Imu::ConstantProto<Imu::ConstantProtoSize(kImu)>(kImu);
+  static_assert(kROS.size() == Imu::kFixedROSSize);
+  static_assert(kROS[16] == 42);
+
+  foo::bar::Imu pb;
+  pb.set_seq(42);
+  pb.mutable_angular_velocity()->set_x(1.5);
+  pb.mutable_angular_velocity()->set_z(-2);
+  pb.set_valid(true);
+  pb.set_e(foo::bar::FOO);
+
+  // The same bytes as serializing at run time.
+  Imu msg;
+  ASSERT_TRUE(msg.FromProtoObject(pb).ok());
+  sato::ROSBuffer ros_buffer;
+  ASSERT_TRUE(msg.WriteROS(ros_buffer, 3000000007).ok());
+  ASSERT_EQ(kROS.size(), ros_buffer.Size());
+  ASSERT_EQ(0, memcmp(kROS.data(), ros_buffer.data(), kROS.size()));
+
+  std::string serialized;
+  pb.SerializeToString(&serialized);
+  ASSERT_EQ(serialized, std::string(kProto.data(), kProto.size()));
+
+  sato::ROSBuffer out;
+  ASSERT_TRUE(sato::WriteROSConstant(out, kROS).ok());
+  ASSERT_EQ(kROS.size(), out.Size());
+  sato::ROSBuffer cdr;
+  cdr.SetCDR(true);
+  ASSERT_FALSE(sato::WriteROSConstant(cdr, kROS).ok());
+}
@@ -6,6 +6,12 @@ load("@bazel_skylib//lib:paths.bzl", "paths")
 
 MessageInfo = provider(fields = ["direct_sources", "transitive_sources", "cpp_outputs"])
 
+# Protos that are only used by the plugin.  It doesn't generate anything for them.
+_GENERATOR_ONLY_PROTOS = [
+    "sato/options.proto",
+    "google/protobuf/descriptor.proto",
+]
+
 def _sato_action(
         ctx,
         direct_sources,
@@ -14,7 +20,8 @@ def _sato_action(
         package_name,
         outputs,
         add_namespace,
-        target_name):
+        target_name,
+        ros_structs):
     # The protobuf compiler allow plugins to get arguments specified in the --plugin_out
     # argument.  The args are passed as a comma separated list of key=value pairs followed
     # by a colon and the output directory.
@@ -23,6 +30,8 @@ def _sato_action(
         options_and_out_dir = "--sato_out=add_namespace={},package_name={},target_name={}:{}".format(add_namespace, package_name, target_name, out_dir)
     else:
         options_and_out_dir = "--sato_out=package_name={},target_name={}:{}".format(package_name, target_name, out_dir)
+    if ros_structs:
+        options_and_out_dir = options_and_out_dir.replace("--sato_out=", "--sato_out=ros_structs=true,", 1)
 
     inputs = depset(direct = direct_sources, transitive = transitive_sources)
 
@@ -85,6 +94,8 @@ def _sato_aspect_impl(target, _ctx):
 
                 # Remove the first directory of v[1] to get the path relative to the package.
                 file_path = v[1].split("/", 1)[1]
+            if file_path in _GENERATOR_ONLY_PROTOS:
+                continue
             add_output(file_path)
 
     return [MessageInfo(
@@ -157,6 +168,7 @@ def _sato_impl(ctx):
         all_outputs,
         ctx.attr.add_namespace,
         ctx.attr.target_name,
+        ctx.attr.ros_structs,
     )
 
     # Unzip zip files to a "proto_msgs" directory
@@ -252,6 +264,7 @@ _sato_gen = rule(
         "add_namespace": attr.string(),
         "package_name": attr.string(),
         "target_name": attr.string(),
+        "ros_structs": attr.bool(),
     },
     implementation = _sato_impl,
 )
@@ -288,7 +301,7 @@ _find_proto_msgs = rule(
     implementation = _find_proto_msgs_impl,
 )
 
-def sato_proto_library(name, deps = [], runtime = "@sato//sato/runtime:sato_runtime", add_namespace = ""):
+def sato_proto_library(name, deps = [], runtime = "@sato//sato/runtime:sato_runtime", add_namespace = "", ros_structs = False):
     """
     Generate a cc_libary for protobuf files specified in deps.
 
@@ -298,6 +311,7 @@ def sato_proto_library(name, deps = [], runtime = "@sato//sato/runtime:sato_runt
         deps: dependencies
         runtime: label for sato runtime.
         add_namespace: add given namespace to the message output
+        ros_structs: also generate plain ROS structs in a nested ros namespace
     """
     sato = name + "_sato"
 
@@ -307,6 +321,7 @@ def sato_proto_library(name, deps = [], runtime = "@sato//sato/runtime:sato_runt
         add_namespace = add_namespace,
         package_name = native.package_name(),
         target_name = name,
+        ros_structs = ros_structs,
     )
 
     srcs = name + "_srcs"